@@ -7,8 +7,9 @@ typedef enum {
     ALLOCATOR_DELETE
 } Allocator_Message;
 
+// file and line of the call site come from mem_* macros, so wrappers can report them
 #define ALLOCATOR_PROC(name)\
-    void *name(void *p, u64 size, Allocator_Message message, void *data)
+    void *name(void *p, u64 size, Allocator_Message message, void *data, const char *file, s32 line)
 
 typedef ALLOCATOR_PROC(Allocator_Proc);
 
@@ -17,20 +18,23 @@ typedef struct {
     void           *data;
 } Allocator;
 
-#define mem_alloc(alloc, size)        (alloc).proc(NULL, size, ALLOCATOR_ALLOCATE,   (alloc).data)
-#define mem_realloc(alloc, ptr, size) (alloc).proc(ptr,  size, ALLOCATOR_REALLOCATE, (alloc).data)
-#define mem_free(alloc, ptr)          (alloc).proc(ptr,  0,    ALLOCATOR_DEALLOCATE, (alloc).data)
-#define mem_delete(alloc)             (alloc).proc(NULL, 0,    ALLOCATOR_DELETE,     (alloc).data)
+#define mem_alloc(alloc, size)        (alloc).proc(NULL, size, ALLOCATOR_ALLOCATE,   (alloc).data, __FILE__, __LINE__)
+#define mem_realloc(alloc, ptr, size) (alloc).proc(ptr,  size, ALLOCATOR_REALLOCATE, (alloc).data, __FILE__, __LINE__)
+#define mem_free(alloc, ptr)          (alloc).proc(ptr,  0,    ALLOCATOR_DEALLOCATE, (alloc).data, __FILE__, __LINE__)
+#define mem_delete(alloc)             (alloc).proc(NULL, 0,    ALLOCATOR_DELETE,     (alloc).data, __FILE__, __LINE__)
 
 
 Allocator get_stdlib_allocator(void);
 Allocator get_temporary_allocator(void);
 Allocator create_arena_allocator(u64 size);
+Allocator get_thread_arena_allocator(void);
 
 
 /// Stdlib Allocator
 ALLOCATOR_PROC(stdlib_allocator_proc) {
     UNUSED(data);
+    UNUSED(file);
+    UNUSED(line);
 
     switch (message) {
         case ALLOCATOR_ALLOCATE:
@@ -52,115 +56,178 @@ Allocator get_stdlib_allocator(void) {
 }
 
 
-/// Temp Allocator
+/// Arena allocator
+// Reserves the whole range up front and commits it by ARENA_COMMIT_SIZE as it fills,
+// so allocation is a pointer bump. Arena header sits at the start of the range.
+// Memory is not zeroed, after rollback you get back whatever was written there.
 
-#define TEMP_SIZE MB(50)
+#define ARENA_COMMIT_SIZE       KB(64)
+#define ARENA_DEFAULT_ALIGNMENT 16
+#define THREAD_ARENA_SIZE       GB(4)
 
-struct {
-    b32 initialized;
-    u64 index;
-    u8 data[TEMP_SIZE];
-} __temp_alloc;
+typedef struct {
+    u64 reserved;
+    u64 committed;
+    u64 occupied;
+    u64 last; // start of the last allocation, it can grow in place
+} Arena;
 
-void temp_reset(void) {
-    __temp_alloc.index = 0;
-}
+typedef struct {
+    Arena *arena;
+    u64    occupied;
+} Arena_Mark;
 
-void *temp_allocate(u64 size) {
-    if ((__temp_alloc.index + size) > TEMP_SIZE) {
-        TraceLog(LOG_ERROR, "Temp allocator wrapped!");
-        temp_reset();
-    }
+THREAD_LOCAL Arena *__thread_arena;
 
-    if ((__temp_alloc.index + size) > TEMP_SIZE) {
-        TraceLog(LOG_ERROR, "Too much space requested!");
+Arena *arena_create(u64 size) {
+    Arena *arena;
+
+    size  = ALIGN_UP(MAX(size, ARENA_COMMIT_SIZE), ARENA_COMMIT_SIZE);
+    arena = (Arena *)platform_reserve(size);
+
+    if (!arena || !platform_commit(arena, ARENA_COMMIT_SIZE)) {
+        TraceLog(LOG_FATAL, "Buy mem, failed to create arena!");
         return NULL;
     }
 
+    arena->reserved  = size;
+    arena->committed = ARENA_COMMIT_SIZE;
+    arena->occupied  = sizeof(Arena);
+    arena->last      = arena->occupied;
 
-    void *pos = (u8*)__temp_alloc.data + __temp_alloc.index;
-    __temp_alloc.index += size;
-    memset(pos, 0x00, size);
-    return pos;
+    return arena;
 }
 
-ALLOCATOR_PROC(temp_allocator_proc) {
-    UNUSED(data);
-    UNUSED(p);
+void arena_delete(Arena *arena) {
+    if (arena == NULL) return;
+
+    platform_release(arena, arena->reserved);
+}
 
-    if (!__temp_alloc.initialized) {
-        __temp_alloc.initialized = true; 
-        temp_reset(); 
+void *arena_allocate_aligned(u64 size, u64 alignment, Arena *arena) {
+    u64 start, end, commit;
+
+    assert(arena != NULL);
+    assert(IS_POW2(alignment));
+
+    start = ALIGN_UP(arena->occupied, alignment);
+    end   = start + size;
+
+    if (end > arena->reserved) {
+        ERRLOG("Arena is out of reserved memory, %llu of %llu bytes requested.", (unsigned long long)end, (unsigned long long)arena->reserved);
+        return NULL;
     }
 
-    switch (message) {
-        case ALLOCATOR_ALLOCATE:
-            return temp_allocate(size);
-        case ALLOCATOR_REALLOCATE:
-        case ALLOCATOR_DEALLOCATE:
-            break;
-        case ALLOCATOR_DELETE:
-            temp_reset();
-            break;
+    if (end > arena->committed) {
+        commit = ALIGN_UP(end, ARENA_COMMIT_SIZE) - arena->committed;
+
+        if (!platform_commit((u8*)arena + arena->committed, commit)) {
+            return NULL;
+        }
+
+        arena->committed += commit;
     }
 
-    return NULL;
+    arena->occupied = end;
+    arena->last     = start;
+
+    return (u8*)arena + start;
 }
 
-Allocator get_temporary_allocator(void) {
-    return CLITERAL(Allocator) { temp_allocator_proc, NULL };
+void *arena_allocate(u64 size, Arena *arena) {
+    return arena_allocate_aligned(size, ARENA_DEFAULT_ALIGNMENT, arena);
 }
 
-/// Arena allocator
+// last allocation grows in place, others are copied to the top of the arena,
+// new part of memory is not zeroed
+void *arena_resize(void *p, u64 size, Arena *arena) {
+    u64 offset, occupied, copy;
+    void *result;
 
-typedef struct Arena {
-    u64 size;
-    u64 occupied;
-    struct Arena *next;
-    u8 data[1]; // you dont have zero size arrays in MSVC...
-} Arena;
+    assert(arena != NULL);
 
-Arena *arena_create(u64 size) {
-    Allocator alloc = get_stdlib_allocator();
+    if (p == NULL) return arena_allocate(size, arena);
 
-    Arena *arena = (Arena *)mem_alloc(alloc, size);
+    offset = (u64)((u8*)p - (u8*)arena);
+    assert(offset >= sizeof(Arena) && offset <= arena->occupied);
 
-    if (!arena) {
-        TraceLog(LOG_FATAL, "Buy mem, failed to create arena!");
-        return NULL;
+    if (offset == arena->last) {
+        occupied        = arena->occupied;
+        arena->occupied = offset;
+
+        result = arena_allocate_aligned(size, 1, arena);
+
+        if (result == NULL) {
+            arena->occupied = occupied;
+        }
+
+        return result;
     }
 
-    memset(arena, 0, sizeof(Arena));
-    arena->size = size - sizeof(Arena);
+    // old size is not known, but it can't go past the top
+    copy   = MIN(size, arena->occupied - offset);
+    result = arena_allocate(size, arena);
 
-    return arena;
+    if (result != NULL) {
+        MEMCPY(result, p, copy);
+    }
+
+    return result;
 }
 
-void arena_delete(Arena *arena) {
-    if (arena->next != NULL) {
-        arena_delete(arena->next);
-    }
+Arena_Mark arena_get_mark(Arena *arena) {
+    assert(arena != NULL);
 
-    Allocator alloc = get_stdlib_allocator();
-    mem_free(alloc, arena);
+    return CLITERAL(Arena_Mark) { arena, arena->occupied };
 }
 
-void *arena_allocate(u64 size, Arena *arena) {
-    if (size <= (arena->size - arena->occupied)) {
-        u8* pos = arena->data + arena->occupied;
-        arena->occupied += size;
-        return (void*)pos;
+// everything allocated after the mark is gone, pages stay committed for reuse
+void arena_rollback(Arena_Mark mark) {
+    assert(mark.arena != NULL);
+    assert(mark.occupied <= mark.arena->occupied);
+
+    mark.arena->occupied = mark.occupied;
+    mark.arena->last     = MIN(mark.arena->last, mark.occupied);
+}
+
+void arena_reset(Arena *arena) {
+    assert(arena != NULL);
+
+    arena->occupied = sizeof(Arena);
+    arena->last     = arena->occupied;
+}
+
+// gives back committed pages above what is used now
+void arena_trim(Arena *arena) {
+    u64 keep;
+
+    assert(arena != NULL);
+
+    keep = ALIGN_UP(arena->occupied, ARENA_COMMIT_SIZE);
+
+    if (keep < arena->committed) {
+        platform_decommit((u8*)arena + keep, arena->committed - keep);
+        arena->committed = keep;
     }
+}
 
-    if (!arena->next) {
-        arena->next = arena_create((arena->size + sizeof(Arena)) * 2LL);
-    } 
+// every thread gets own arena on first call, worker should call thread_arena_release before exit
+Arena *get_thread_arena(void) {
+    if (__thread_arena == NULL) {
+        __thread_arena = arena_create(THREAD_ARENA_SIZE);
+    }
+
+    return __thread_arena;
+}
 
-    return arena_allocate(size, arena->next);
+void thread_arena_release(void) {
+    arena_delete(__thread_arena);
+    __thread_arena = NULL;
 }
 
 ALLOCATOR_PROC(arena_allocator_proc) {
-    UNUSED(p);
+    UNUSED(file);
+    UNUSED(line);
     assert(data != NULL);
 
     Arena *arena = (Arena*)data;
@@ -169,8 +236,7 @@ ALLOCATOR_PROC(arena_allocator_proc) {
         case ALLOCATOR_ALLOCATE:
             return arena_allocate(size, arena);
         case ALLOCATOR_REALLOCATE:
-            TraceLog(LOG_ERROR, "Arena doesn't reallocate.");
-            break;
+            return arena_resize(p, size, arena);
         case ALLOCATOR_DEALLOCATE:
             TraceLog(LOG_ERROR, "Arena doesn't free it's memory, please destroy arena itself.");
             break;
@@ -185,3 +251,400 @@ ALLOCATOR_PROC(arena_allocator_proc) {
 Allocator create_arena_allocator(u64 size) {
     return CLITERAL(Allocator) { arena_allocator_proc, arena_create(size) };
 }
+
+// doesn't own the arena, delete message is ignored
+ALLOCATOR_PROC(thread_arena_allocator_proc) {
+    UNUSED(data);
+
+    if (message == ALLOCATOR_DELETE) return NULL;
+
+    return arena_allocator_proc(p, size, message, get_thread_arena(), file, line);
+}
+
+Allocator get_thread_arena_allocator(void) {
+    return CLITERAL(Allocator) { thread_arena_allocator_proc, NULL };
+}
+
+
+/// Temp Allocator
+// Frame scoped scratch, every thread has it's own arena, so pages are committed
+// only as deep as that thread ever went. Running out of it is a bug, not something
+// to recover from: old version wrapped around and handed out memory that was still in use.
+
+#define TEMP_SIZE GB(1)
+
+THREAD_LOCAL Arena *__temp_arena;
+
+Arena *temp_get_arena(void) {
+    if (__temp_arena == NULL) {
+        __temp_arena = arena_create(TEMP_SIZE);
+    }
+
+    return __temp_arena;
+}
+
+void temp_reset(void) {
+    arena_reset(temp_get_arena());
+}
+
+// worker threads should call it before exit
+void temp_release(void) {
+    arena_delete(__temp_arena);
+    __temp_arena = NULL;
+}
+
+void *temp_allocate_nozero(u64 size) {
+    void *pos = arena_allocate(size, temp_get_arena());
+
+    if (pos == NULL) {
+        TraceLog(LOG_FATAL, "Temp allocator is out of memory, %llu bytes requested.", (unsigned long long)size);
+    }
+
+    return pos;
+}
+
+void *temp_allocate(u64 size) {
+    void *pos = temp_allocate_nozero(size);
+    MEMSET(pos, 0x00, size);
+    return pos;
+}
+
+void *temp_resize(void *p, u64 size) {
+    void *pos = arena_resize(p, size, temp_get_arena());
+
+    if (pos == NULL) {
+        TraceLog(LOG_FATAL, "Temp allocator is out of memory, %llu bytes requested.", (unsigned long long)size);
+    }
+
+    return pos;
+}
+
+ALLOCATOR_PROC(temp_allocator_proc) {
+    UNUSED(data);
+    UNUSED(file);
+    UNUSED(line);
+
+    switch (message) {
+        case ALLOCATOR_ALLOCATE:
+            return temp_allocate(size);
+        case ALLOCATOR_REALLOCATE:
+            return temp_resize(p, size);
+        case ALLOCATOR_DEALLOCATE:
+            break;
+        case ALLOCATOR_DELETE:
+            temp_reset();
+            break;
+    }
+
+    return NULL;
+}
+
+Allocator get_temporary_allocator(void) {
+    return CLITERAL(Allocator) { temp_allocator_proc, NULL };
+}
+
+
+/// Tracking allocator
+// Wraps other allocator and counts what goes through it per call site. Every block
+// gets a header with it's size and site, so frees can be accounted too. Sites are
+// kept in open addressing table, key is file pointer and line (one translation unit,
+// so the same file is the same literal).
+
+#define TRACKING_MAX_SITES   1024
+#define TRACKING_HEADER_SIZE 16
+
+typedef struct {
+    const char *file;
+    s32         line;
+
+    u64 allocations;
+    u64 reallocations;
+    u64 frees;
+    u64 bytes;
+    u64 live_bytes;
+    u64 peak_bytes;
+} Tracking_Site;
+
+typedef struct {
+    u64 size;
+    u32 site;
+    u32 unused;
+} Tracking_Header;
+
+typedef struct {
+    Allocator backing;
+    mtx_t     lock;
+
+    u64 live_bytes;
+    u64 peak_bytes;
+
+    u64           site_count;
+    Tracking_Site sites[TRACKING_MAX_SITES];
+} Tracking_Allocator;
+
+u32 tracking_get_site(Tracking_Allocator *tracking, const char *file, s32 line) {
+    u64 hash;
+    u32 i, index;
+    Tracking_Site *site;
+
+    hash = (u64)(uintptr_t)file * 31 + (u64)line;
+    hash ^= hash >> 17;
+    hash *= 0xed5ad4bbULL;
+
+    for (i = 0; i < TRACKING_MAX_SITES; i++) {
+        index = (u32)((hash + i) % TRACKING_MAX_SITES);
+        site  = &tracking->sites[index];
+
+        if (site->file == file && site->line == line) {
+            return index;
+        }
+
+        if (site->file == NULL) {
+            site->file = file;
+            site->line = line;
+            tracking->site_count++;
+            return index;
+        }
+    }
+
+    // table is full, everything else goes into the last slot
+    return TRACKING_MAX_SITES - 1;
+}
+
+void tracking_add_live(Tracking_Allocator *tracking, Tracking_Site *site, u64 added, u64 removed) {
+    tracking->live_bytes = tracking->live_bytes + added - removed;
+    tracking->peak_bytes = MAX(tracking->peak_bytes, tracking->live_bytes);
+
+    site->live_bytes = site->live_bytes + added - removed;
+    site->peak_bytes = MAX(site->peak_bytes, site->live_bytes);
+}
+
+ALLOCATOR_PROC(tracking_allocator_proc) {
+    Tracking_Allocator *tracking = (Tracking_Allocator*)data;
+    Tracking_Header *header = NULL, old;
+    Tracking_Site *site;
+    void *result = NULL;
+
+    assert(tracking != NULL);
+
+    if (p != NULL) {
+        header = (Tracking_Header*)((u8*)p - TRACKING_HEADER_SIZE);
+        old    = *header;
+    }
+
+    mtx_lock(&tracking->lock);
+
+    switch (message) {
+        case ALLOCATOR_ALLOCATE:
+        {
+            header = (Tracking_Header*)tracking->backing.proc(NULL, size + TRACKING_HEADER_SIZE, message, tracking->backing.data, file, line);
+            if (header == NULL) break;
+
+            header->size = size;
+            header->site = tracking_get_site(tracking, file, line);
+
+            site = &tracking->sites[header->site];
+            site->allocations++;
+            site->bytes += size;
+            tracking_add_live(tracking, site, size, 0);
+
+            result = (u8*)header + TRACKING_HEADER_SIZE;
+        } break;
+
+        case ALLOCATOR_REALLOCATE:
+        {
+            header = (Tracking_Header*)tracking->backing.proc(header, size + TRACKING_HEADER_SIZE, message, tracking->backing.data, file, line);
+            if (header == NULL) break;
+
+            // block belongs to the site that reallocated it last
+            header->size = size;
+            header->site = tracking_get_site(tracking, file, line);
+
+            if (p != NULL) {
+                tracking_add_live(tracking, &tracking->sites[old.site], 0, old.size);
+            }
+
+            site = &tracking->sites[header->site];
+            site->reallocations++;
+            site->bytes += size;
+            tracking_add_live(tracking, site, size, 0);
+
+            result = (u8*)header + TRACKING_HEADER_SIZE;
+        } break;
+
+        case ALLOCATOR_DEALLOCATE:
+        {
+            if (p == NULL) break;
+
+            site = &tracking->sites[old.site];
+            site->frees++;
+            tracking_add_live(tracking, site, 0, old.size);
+
+            tracking->backing.proc(header, 0, message, tracking->backing.data, file, line);
+        } break;
+
+        case ALLOCATOR_DELETE:
+        {
+            tracking->backing.proc(NULL, 0, message, tracking->backing.data, file, line);
+        } break;
+    }
+
+    mtx_unlock(&tracking->lock);
+
+    return result;
+}
+
+Allocator create_tracking_allocator(Allocator backing) {
+    Tracking_Allocator *tracking;
+
+    tracking = (Tracking_Allocator*)mem_alloc(get_stdlib_allocator(), sizeof(Tracking_Allocator));
+    assert(tracking != NULL);
+
+    tracking->backing = backing;
+    mtx_init(&tracking->lock, mtx_plain);
+
+    return CLITERAL(Allocator) { tracking_allocator_proc, tracking };
+}
+
+void tracking_allocator_destroy(Allocator *alloc) {
+    Tracking_Allocator *tracking = (Tracking_Allocator*)alloc->data;
+
+    if (tracking == NULL) return;
+
+    mtx_destroy(&tracking->lock);
+    mem_free(get_stdlib_allocator(), tracking);
+
+    alloc->data = NULL;
+}
+
+// descending by bytes, then by calls, equal sites are 0 so qsort gets consistent order
+int tracking_site_compare(const void *a, const void *b) {
+    const Tracking_Site *left = (const Tracking_Site*)a, *right = (const Tracking_Site*)b;
+    u64 left_calls, right_calls;
+
+    if (left->bytes != right->bytes) return left->bytes < right->bytes ? 1 : -1;
+
+    left_calls  = left->allocations  + left->reallocations;
+    right_calls = right->allocations + right->reallocations;
+
+    if (left_calls != right_calls) return left_calls < right_calls ? 1 : -1;
+
+    return 0;
+}
+
+// sites sorted by bytes that went through them, the hottest first
+void tracking_report(Allocator alloc, const char *name) {
+    Tracking_Allocator *tracking = (Tracking_Allocator*)alloc.data;
+    Tracking_Site *sites, *site;
+    u64 i, count = 0;
+
+    if (tracking == NULL) return;
+
+    mtx_lock(&tracking->lock);
+
+    sites = (Tracking_Site*)mem_alloc(get_stdlib_allocator(), sizeof(Tracking_Site) * tracking->site_count);
+
+    for (i = 0; i < TRACKING_MAX_SITES; i++) {
+        if (tracking->sites[i].file != NULL) {
+            sites[count++] = tracking->sites[i];
+        }
+    }
+
+    qsort(sites, count, sizeof(Tracking_Site), tracking_site_compare);
+
+    INFLOG("MEMORY: %s, %llu sites, %llu bytes live, %llu bytes peak.", name, (unsigned long long)count, (unsigned long long)tracking->live_bytes, (unsigned long long)tracking->peak_bytes);
+    INFLOG("MEMORY:     allocs    reallocs       frees           bytes      peak live        live  site");
+
+    for (i = 0; i < count; i++) {
+        site = &sites[i];
+
+        INFLOG("MEMORY: %10llu  %10llu  %10llu  %14llu  %13llu  %10llu  %s:%d",
+               (unsigned long long)site->allocations, (unsigned long long)site->reallocations, (unsigned long long)site->frees,
+               (unsigned long long)site->bytes, (unsigned long long)site->peak_bytes, (unsigned long long)site->live_bytes,
+               GetFileName(site->file), site->line);
+    }
+
+    mtx_unlock(&tracking->lock);
+
+    mem_free(get_stdlib_allocator(), sites);
+}
+
+/// Allocators benchmark
+// Same pattern for every allocator: batch of small blocks of mixed size that are
+// written once, then everything is thrown away, like scratch of one conversion.
+
+#define BENCH_ROUNDS     200
+#define BENCH_ALLOCS     10000
+#define BENCH_MAX_SIZE   1024
+
+typedef enum {
+    BENCH_STDLIB,
+    BENCH_TRACKING,
+    BENCH_ARENA,
+    BENCH_TEMP,
+    BENCH_COUNT,
+} Bench_Allocator;
+
+void allocators_benchmark(void) {
+    const char *names[BENCH_COUNT] = { "stdlib", "tracking(stdlib)", "arena", "temp" };
+    Allocator alloc, stdlib, tracking;
+    Arena *arena;
+    Arena_Mark mark;
+    void **blocks;
+    u64 round, i, size, bytes;
+    u32 seed, kind;
+    f64 start, elapsed;
+
+    stdlib   = get_stdlib_allocator();
+    tracking = create_tracking_allocator(stdlib);
+    arena    = arena_create(GB(1));
+    blocks   = (void**)mem_alloc(stdlib, sizeof(void*) * BENCH_ALLOCS);
+
+    for (kind = 0; kind < BENCH_COUNT; kind++) {
+        switch (kind) {
+            case BENCH_STDLIB:   alloc = stdlib;                                            break;
+            case BENCH_TRACKING: alloc = tracking;                                          break;
+            case BENCH_ARENA:    alloc = CLITERAL(Allocator) { arena_allocator_proc, arena }; break;
+            default:             alloc = get_temporary_allocator();                         break;
+        }
+
+        seed  = 1;
+        bytes = 0;
+        start = platform_get_time();
+
+        for (round = 0; round < BENCH_ROUNDS; round++) {
+            mark = arena_get_mark(arena);
+
+            for (i = 0; i < BENCH_ALLOCS; i++) {
+                seed = seed * 1103515245 + 12345;
+                size = 16 + (seed >> 16) % BENCH_MAX_SIZE;
+
+                blocks[i] = mem_alloc(alloc, size);
+                ((u8*)blocks[i])[0] = (u8)i;
+                bytes += size;
+            }
+
+            switch (kind) {
+                case BENCH_ARENA: arena_rollback(mark); break;
+                case BENCH_TEMP:  temp_reset();         break;
+                default:
+                {
+                    for (i = 0; i < BENCH_ALLOCS; i++) {
+                        mem_free(alloc, blocks[i]);
+                    }
+                } break;
+            }
+        }
+
+        elapsed = platform_get_time() - start;
+
+        INFLOG("BENCH: %-18s %8.2f ms, %6.1f ns per alloc, %.1f MB total.", names[kind], elapsed * 1000.0,
+               elapsed * 1e9 / (f64)(BENCH_ROUNDS * BENCH_ALLOCS), (f64)bytes / (f64)MB(1));
+    }
+
+    tracking_report(tracking, "benchmark");
+
+    mem_free(stdlib, blocks);
+    tracking_allocator_destroy(&tracking);
+    arena_delete(arena);
+}
@@ -0,0 +1,208 @@
+// Phrase bank tool: phrases are added to .lpcbank file, or replaced if bank already has them.
+//
+//     c_wizard --bank <file.lpcbank> [files...]
+//
+// Audio files are encoded with default settings, .bin files are taken as tms5220 streams as
+// they are. Name of the phrase is file name without extension, and Lpc_Code arrays are stored
+// too, so playback doesn't even parse the stream. Only new data, new index and header are
+// written, the rest of the file stays where it is. Without files bank is just listed.
+//
+// At runtime bank is mapped and used in place:
+//
+//     bytes = platform_map_file("speech.lpcbank", &size);
+//     lpc_bank_open(&bank, bytes, size);
+//     codes = lpc_bank_codes(bank, (u32)lpc_bank_find(bank, "hello"));
+//
+// mixer_bank_play does that and plays the codes from the mapping without copying them,
+// bank dropped into the window is played like that with keys 1-9.
+
+typedef struct {
+    Lpc_Bank_Phrase phrase;
+    b32             raw;    // stream is file data, not library memory
+} Bank_Input;
+
+b32 bank_input_load(const char *path, Bank_Input *input) {
+    Lpc_Sample_Buffer samples;
+    Lpc_Codes codes;
+    Wave wave;
+    const char *name;
+    s32 size;
+    u32 i;
+
+    memset(input, 0, sizeof(Bank_Input));
+
+    name = GetFileNameWithoutExt(path);
+    input->phrase.name = (const char*)MEMCPY(temp_allocate(strlen(name) + 1), name, strlen(name));
+
+    if (IsFileExtension(path, ".bin")) {
+        input->raw = true;
+        input->phrase.stream.bytes = LoadFileData(path, &size);
+        input->phrase.stream.count = size > 0 ? (u32)size : 0;
+
+        if (input->phrase.stream.bytes == NULL) return false;
+
+        // whatever is after stop frame is padding
+        codes = lpc_tms5220_decode(&lpc_context, input->phrase.stream);
+
+        for (i = 0; i < codes.count; i++) {
+            if (codes.code[i].energy == LPC_ENERGY_STOP) {
+                codes.count = i + 1;
+                break;
+            }
+        }
+
+        input->phrase.codes = codes;
+        return true;
+    }
+
+    wave = LoadWave(path);
+
+    if (!IsWaveValid(wave)) return false;
+
+    WaveFormat(&wave, LPC_SAMPLE_RATE, 32, 1);
+
+    samples.sample_rate = LPC_SAMPLE_RATE;
+    samples.channels    = 1;
+    samples.frame_count = wave.frameCount;
+    samples.samples     = (f32*)wave.data;
+
+    input->phrase.codes  = lpc_encode(&lpc_context, samples, LPC_DEFAULT_SETTINGS);
+    input->phrase.stream = lpc_tms5220_encode(&lpc_context, input->phrase.codes);
+
+    UnloadWave(wave);
+
+    return true;
+}
+
+void bank_input_free(Bank_Input *input) {
+    if (input->raw) {
+        UnloadFileData(input->phrase.stream.bytes);
+    } else {
+        lpc_tms5220_buffer_free(&lpc_context, &input->phrase.stream);
+    }
+
+    lpc_codes_free(&lpc_context, &input->phrase.codes);
+}
+
+// data goes first and header last, so bank that was cut in the middle of write still has valid header
+b32 bank_write(const char *path, b32 exists, Lpc_Bank_Update update) {
+    FILE *file;
+    b32 result;
+
+    file = fopen(path, exists ? "r+b" : "wb");
+
+    if (file == NULL) {
+        ERRLOG("Bank: failed to open %s for writing.", path);
+        return false;
+    }
+
+    result = fseek(file, (long)update.offset, SEEK_SET) == 0
+          && fwrite(update.bytes, 1, update.count, file) == update.count
+          && fflush(file) == 0
+          && fseek(file, 0, SEEK_SET) == 0
+          && fwrite(&update.header, sizeof(Lpc_Bank_Header), 1, file) == 1;
+
+    result = fclose(file) == 0 && result;
+
+    if (!result) {
+        ERRLOG("Bank: failed to write %s.", path);
+    }
+
+    return result;
+}
+
+void bank_list(const char *path) {
+    Lpc_Bank bank;
+    void *bytes;
+    u64 size;
+    u32 i;
+
+    bytes = platform_map_file(path, &size);
+
+    if (!lpc_bank_open(&bank, bytes, size)) {
+        ERRLOG("Bank: %s is not a phrase bank.", path);
+        platform_unmap_file(bytes, size);
+        return;
+    }
+
+    INFLOG("Bank: %s, %u phrases, %llu bytes, %llu of them are replaced data.", path, bank.header->entry_count,
+           (unsigned long long)bank.header->file_size, (unsigned long long)bank.header->dead_bytes);
+
+    for (i = 0; i < bank.header->entry_count; i++) {
+        INFLOG("Bank: %-32s %6u bytes %5u frames at 0x%08X", lpc_bank_name(bank, i), bank.entries[i].stream_size,
+               bank.entries[i].code_count, bank.entries[i].stream_offset);
+    }
+
+    platform_unmap_file(bytes, size);
+}
+
+s32 bank_run(const char *path, char **files, u32 file_count) {
+    Bank_Input *inputs;
+    Lpc_Bank_Phrase *phrases;
+    Lpc_Bank_Update update;
+    Lpc_Bank bank;
+    void *bytes;
+    u64 size;
+    u32 i, count;
+    b32 exists, written;
+
+    program_memory_init();
+
+    bytes  = platform_map_file(path, &size);
+    exists = bytes != NULL;
+
+    if (exists && !lpc_bank_open(&bank, bytes, size)) {
+        ERRLOG("Bank: %s is not a phrase bank.", path);
+        platform_unmap_file(bytes, size);
+        program_memory_deinit();
+        return 1;
+    }
+
+    written = true;
+
+    if (file_count > 0) {
+        inputs  = (Bank_Input*)temp_allocate(sizeof(Bank_Input) * file_count);
+        phrases = (Lpc_Bank_Phrase*)temp_allocate(sizeof(Lpc_Bank_Phrase) * file_count);
+        count   = 0;
+
+        for (i = 0; i < file_count; i++) {
+            if (!bank_input_load(files[i], &inputs[count])) {
+                ERRLOG("Bank: failed to load %s.", files[i]);
+                bank_input_free(&inputs[count]);
+                continue;
+            }
+
+            phrases[count] = inputs[count].phrase;
+            count++;
+        }
+
+        update = lpc_bank_update(&lpc_context, exists ? &bank : NULL, phrases, count);
+
+        // new data is appended after the old, mapping isn't needed to write it
+        platform_unmap_file(bytes, size);
+        bytes = NULL;
+
+        written = update.bytes != NULL && bank_write(path, exists, update);
+
+        if (written) {
+            INFLOG("Bank: %u phrases written to %s, %u bytes appended.", count, path, update.count);
+        }
+
+        lpc_bank_update_free(&lpc_context, &update);
+
+        for (i = 0; i < count; i++) {
+            bank_input_free(&inputs[i]);
+        }
+    }
+
+    platform_unmap_file(bytes, size);
+
+    if (written) {
+        bank_list(path);
+    }
+
+    temp_release();
+    program_memory_deinit();
+
+    return written ? 0 : 1;
+}
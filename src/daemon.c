@@ -0,0 +1,300 @@
+// Daemon mode: process starts once and converts requests, so process startup, window
+// and audio device are not paid for every phrase. Worker threads keep their library
+// context (scratch memory) and temp arena between requests.
+//
+//     c_wizard --daemon                  - requests on stdin, responses on stdout, logs go to stderr
+//     c_wizard --daemon <path> [workers] - unix socket at path, one worker per processor by default
+//
+// Every connection can send any number of requests, each one gets a response in order.
+// Worker serves one connection until it is closed, so clients shouldn't keep more
+// connections open than there are workers.
+// Numbers are in native byte order, settings are Lpc_Encoder_Settings as laid out in this build.
+//
+// request:  Daemon_Request, then payload_size bytes
+//           DAEMON_REQUEST_PATH - payload is path of audio file, without terminating zero
+//           DAEMON_REQUEST_PCM  - payload is mono s16 samples at sample_rate
+//           DAEMON_REQUEST_QUIT - no payload, stops accepting connections,
+//                                 daemon exits when other open connections are closed
+// response: Daemon_Response, then payload_size bytes,
+//           tms5220 stream on success, error message otherwise
+
+#define DAEMON_REQUEST_MAGIC  0x5243504c // "LPCR"
+#define DAEMON_RESPONSE_MAGIC 0x4143504c // "LPCA"
+
+#define DAEMON_MAX_PAYLOAD MB(256)
+
+typedef enum {
+    DAEMON_REQUEST_PATH = 1,
+    DAEMON_REQUEST_PCM  = 2,
+    DAEMON_REQUEST_QUIT = 3,
+} Daemon_Request_Type;
+
+typedef enum {
+    DAEMON_STATUS_OK,
+    DAEMON_STATUS_BAD_REQUEST,
+    DAEMON_STATUS_LOAD_FAILED,
+} Daemon_Status;
+
+typedef struct {
+    u32 magic;
+    u32 type;
+    u32 sample_rate;   // pcm only, at least LPC_SAMPLE_RATE
+    u32 settings_size; // sizeof(Lpc_Encoder_Settings), 0 to use defaults
+    Lpc_Encoder_Settings settings;
+    u32 payload_size;
+} Daemon_Request;
+
+typedef struct {
+    u32 magic;
+    u32 status;        // Daemon_Status
+    u32 sample_count;  // input samples at LPC_SAMPLE_RATE
+    u32 frame_count;   // codes with stop frame
+    u32 byte_count;
+    u32 encode_us;     // time of encoding, without loading and io
+    u32 payload_size;
+} Daemon_Response;
+
+typedef struct {
+    Thread      thread;
+    Lpc_Context context;
+    s32         listener;
+} Daemon_Worker;
+
+volatile b32 daemon_quit;
+
+// stdout can be the protocol stream, so everything goes to stderr
+void daemon_trace_log(int level, const char *text, va_list args) {
+    switch (level) {
+        case LOG_INFO:    fprintf(stderr, "INFO: ");    break;
+        case LOG_WARNING: fprintf(stderr, "WARNING: "); break;
+        case LOG_ERROR:   fprintf(stderr, "ERROR: ");   break;
+        case LOG_FATAL:   fprintf(stderr, "FATAL: ");   break;
+        default: break;
+    }
+
+    vfprintf(stderr, text, args);
+    fprintf(stderr, "\n");
+}
+
+b32 daemon_respond(s32 out, Daemon_Response response, const void *payload) {
+    response.magic = DAEMON_RESPONSE_MAGIC;
+
+    if (!platform_write_all(out, &response, sizeof(Daemon_Response))) return false;
+
+    return platform_write_all(out, payload, response.payload_size);
+}
+
+b32 daemon_respond_error(s32 out, Daemon_Status status, const char *message) {
+    Daemon_Response response;
+
+    memset(&response, 0, sizeof(Daemon_Response));
+    response.status       = status;
+    response.payload_size = (u32)strlen(message);
+
+    return daemon_respond(out, response, message);
+}
+
+// samples are in temp memory or wave, both are freed by caller
+b32 daemon_load_samples(Daemon_Request *request, u8 *payload, Wave *wave, Lpc_Sample_Buffer *samples) {
+    u32 i, count;
+    s16 *pcm;
+
+    memset(samples, 0, sizeof(Lpc_Sample_Buffer));
+    samples->channels = 1;
+
+    if (request->type == DAEMON_REQUEST_PATH) {
+        payload[request->payload_size] = 0;
+
+        *wave = LoadWave((const char*)payload);
+        if (!IsWaveValid(*wave)) return false;
+
+        WaveFormat(wave, LPC_SAMPLE_RATE, 32, 1);
+
+        samples->sample_rate = LPC_SAMPLE_RATE;
+        samples->frame_count = wave->frameCount;
+        samples->samples     = (f32*)wave->data;
+    } else {
+        pcm   = (s16*)payload;
+        count = request->payload_size / sizeof(s16);
+
+        samples->sample_rate = request->sample_rate;
+        samples->frame_count = count;
+        samples->samples     = (f32*)temp_allocate_nozero(sizeof(f32) * count);
+
+        for (i = 0; i < count; i++) {
+            samples->samples[i] = pcm[i] / 32768.0f;
+        }
+    }
+
+    return samples->frame_count > 0;
+}
+
+// serves requests until stream ends, returns false if daemon should quit
+b32 daemon_serve(Lpc_Context *context, s32 in, s32 out) {
+    Daemon_Request  request;
+    Daemon_Response response;
+    Lpc_Encoder_Settings settings;
+    Lpc_Sample_Buffer samples;
+    Lpc_TMS5220_Buffer buffer;
+    Lpc_Bitcodes codes;
+    Wave wave;
+    u8 *payload;
+    f64 start;
+    b32 sent, loaded;
+
+    while (platform_read_all(in, &request, sizeof(Daemon_Request))) {
+        temp_reset();
+
+        if (request.magic != DAEMON_REQUEST_MAGIC) {
+            // stream can't be resynchronized after that
+            daemon_respond_error(out, DAEMON_STATUS_BAD_REQUEST, "Bad request magic.");
+            return true;
+        }
+
+        if (request.type == DAEMON_REQUEST_QUIT) {
+            return false;
+        }
+
+        if (request.payload_size > DAEMON_MAX_PAYLOAD) {
+            daemon_respond_error(out, DAEMON_STATUS_BAD_REQUEST, "Payload is too big.");
+            return true;
+        }
+
+        payload = (u8*)temp_allocate_nozero(request.payload_size + 1);
+
+        if (!platform_read_all(in, payload, request.payload_size)) {
+            return true;
+        }
+
+        if (request.type != DAEMON_REQUEST_PATH && request.type != DAEMON_REQUEST_PCM) {
+            if (!daemon_respond_error(out, DAEMON_STATUS_BAD_REQUEST, "Unknown request type.")) return true;
+            continue;
+        }
+
+        if (request.settings_size != 0 && request.settings_size != sizeof(Lpc_Encoder_Settings)) {
+            if (!daemon_respond_error(out, DAEMON_STATUS_BAD_REQUEST, "Settings don't match this build.")) return true;
+            continue;
+        }
+
+        if (request.type == DAEMON_REQUEST_PCM && request.sample_rate < LPC_SAMPLE_RATE) {
+            if (!daemon_respond_error(out, DAEMON_STATUS_BAD_REQUEST, "Sample rate is lower than 8000.")) return true;
+            continue;
+        }
+
+        settings = request.settings_size ? request.settings : LPC_DEFAULT_SETTINGS;
+
+        memset(&wave, 0, sizeof(Wave));
+
+        TRACE_BEGIN("daemon: load");
+        loaded = daemon_load_samples(&request, payload, &wave, &samples);
+        TRACE_END();
+
+        if (!loaded) {
+            UnloadWave(wave);
+            if (!daemon_respond_error(out, DAEMON_STATUS_LOAD_FAILED, "Failed to load audio.")) return true;
+            continue;
+        }
+
+        start  = platform_get_time();
+        codes  = lpc_encode_bitcodes(context, samples, settings);
+        buffer = lpc_tms5220_encode_bitcodes(context, codes);
+
+        memset(&response, 0, sizeof(Daemon_Response));
+        response.status       = DAEMON_STATUS_OK;
+        response.sample_count = (u32)((u64)samples.frame_count * LPC_SAMPLE_RATE / samples.sample_rate);
+        response.frame_count  = codes.count;
+        response.byte_count   = buffer.count;
+        response.encode_us    = (u32)((platform_get_time() - start) * 1e6);
+        response.payload_size = buffer.count;
+
+        sent = daemon_respond(out, response, buffer.bytes);
+
+        UnloadWave(wave);
+        lpc_bitcodes_free(context, &codes);
+        lpc_tms5220_buffer_free(context, &buffer);
+
+        if (!sent) return true;
+    }
+
+    return true;
+}
+
+s32 daemon_worker_proc(void *data) {
+    Daemon_Worker *worker = (Daemon_Worker*)data;
+    s32 connection;
+
+    TRACE_THREAD("daemon worker");
+
+    while (!daemon_quit) {
+        connection = platform_socket_accept(worker->listener);
+        if (connection < 0) break;
+
+        if (!daemon_serve(&worker->context, connection, connection)) {
+            daemon_quit = true;
+            platform_socket_shutdown(worker->listener);
+        }
+
+        platform_close(connection);
+    }
+
+    lpc_context_free(&worker->context);
+    temp_release();
+
+    return 0;
+}
+
+s32 daemon_run(const char *socket_path, u32 worker_count) {
+    Daemon_Worker workers[MAX_THREADS];
+    s32 listener;
+    u32 i;
+
+    SetTraceLogCallback(daemon_trace_log);
+    SetTraceLogLevel(LOG_INFO);
+
+    program_memory_init();
+
+    if (socket_path == NULL) {
+        platform_stdio_binary();
+        INFLOG("Daemon: serving on stdin/stdout.");
+
+        daemon_serve(&lpc_context, PLATFORM_STDIN, PLATFORM_STDOUT);
+    } else {
+        listener = platform_socket_listen(socket_path);
+
+        if (listener < 0) {
+            program_memory_deinit();
+            return 1;
+        }
+
+        if (worker_count == 0) worker_count = platform_get_processor_count();
+        worker_count = MIN(worker_count, MAX_THREADS);
+
+        memset(workers, 0, sizeof(workers));
+
+        INFLOG("Daemon: serving on %s with %u workers.", socket_path, worker_count);
+
+        for (i = 0; i < worker_count; i++) {
+            program_lpc_context_init(&workers[i].context);
+            workers[i].listener = listener;
+
+            // main thread is a worker too
+            if (i == worker_count - 1 || !thread_start(&workers[i].thread, daemon_worker_proc, &workers[i])) {
+                daemon_worker_proc(&workers[i]);
+                break;
+            }
+        }
+
+        for (i = 0; i < worker_count; i++) {
+            thread_join(&workers[i].thread);
+        }
+
+        platform_close(listener);
+        remove(socket_path);
+    }
+
+    INFLOG("Daemon: stopped.");
+
+    program_memory_deinit();
+
+    return 0;
+}
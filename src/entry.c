@@ -1,3 +1,7 @@
+#if defined(__linux__)
+#   define _DEFAULT_SOURCE // MAP_ANONYMOUS and madvise are not in strict c11
+#endif
+
 #include "raylib.h"
 
 #define RAYMATH_IMPLEMENTATION
@@ -42,16 +46,21 @@ typedef uint32_t b32;
 
 #define PG(s) ((u64)(s) * KB(4))
 
+#define ALIGN_UP(x, a) (((u64)(x) + ((u64)(a) - 1)) & ~((u64)(a) - 1))
+#define IS_POW2(x)     ((x) != 0 && ((x) & ((x) - 1)) == 0)
+
 #define MAX(a, b) (a) > (b) ? (a) : (b)
 #define MIN(a, b) (a) < (b) ? (a) : (b)
 
 #if defined(__clang__) || defined(__GNUC__)
 #   define CLANG_COMPILER
 #   define __TRAP() __builtin_trap()
+#   define THREAD_LOCAL _Thread_local
 
 #elif _MSC_VER >= 1939
 #   define MSVC_COMPILER
 #   define __TRAP() *((int *)0) = 0
+#   define THREAD_LOCAL __declspec(thread)
 
 #else
 #   error "Unknown compiler"
@@ -96,12 +105,77 @@ typedef uint32_t b32;
 f32 window_width  = WINDOW_WIDTH;
 f32 window_height = WINDOW_HEIGHT;
 
+// library stages show up on the trace timeline, see trace.c
+#if TRACE
+void trace_begin(const char *name);
+void trace_end(void);
+
+#   define LPC_TRACE_BEGIN(name) trace_begin(name)
+#   define LPC_TRACE_END()       trace_end()
+#endif
+
+#define LPC_STATIC_DECL
+#define LPC_ENC_DEC_IMPLEMENTATION
+#include "lpc10_enc_dec.h" 
+
+#include "platform.c"
+#include "trace.c"
 #include "allocators.c" 
+#include "viewer.c"
+#include "mixer.c"
 #include "program.c"
+#include "daemon.c"
+#include "watch.c"
+#include "bank.c"
+#include "split.c"
 
 int main(int argc, char **argv) {
-    UNUSED(argc);
-    UNUSED(argv);
+    u32 sample_rate = 0;
+
+    TRACE_INIT();
+
+    if (argc > 1 && strcmp(argv[1], "--alloc-bench") == 0) {
+        allocators_benchmark();
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--synth-bench") == 0) {
+        synth_benchmark();
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--daemon") == 0) {
+        return daemon_run(argc > 2 ? argv[2] : NULL, argc > 3 ? (u32)atoi(argv[3]) : 0);
+    }
+
+    if (argc > 2 && strcmp(argv[1], "--watch") == 0) {
+        return watch_run(argv[2], argc > 3 ? argv[3] : NULL);
+    }
+
+    if (argc > 2 && strcmp(argv[1], "--fifo-check") == 0) {
+        return fifo_check_run(argv[2], argc > 3 ? (u32)atoi(argv[3]) : 0, argc > 4 ? atoi(argv[4]) : -1);
+    }
+
+    if (argc > 2 && strcmp(argv[1], "--scan-check") == 0) {
+        return scan_check_run(argv + 2, (u32)(argc - 2));
+    }
+
+    if (argc > 2 && strcmp(argv[1], "--stream-check") == 0) {
+        return stream_check_run(argv[2], argc > 3 ? (u32)atoi(argv[3]) : 0, argc > 4 ? (u32)atoi(argv[4]) : 0);
+    }
+
+    if (argc > 2 && strcmp(argv[1], "--bank") == 0) {
+        return bank_run(argv[2], argv + 3, (u32)(argc - 3));
+    }
+
+    if (argc > 2 && strcmp(argv[1], "--split") == 0) {
+        return split_run(argv[2], argc > 3 ? argv[3] : NULL);
+    }
+
+    // raylib doesn't tell the rate of the device, mixer opens the stream at this one
+    if (argc > 2 && strcmp(argv[1], "--rate") == 0) {
+        sample_rate = (u32)atoi(argv[2]);
+    }
 
     SetTraceLogLevel(LOG_FATAL);
 
@@ -120,7 +194,7 @@ int main(int argc, char **argv) {
     }
 
     SetTraceLogLevel(LOG_INFO);
-    program_init();
+    program_init(sample_rate);
 
     while (!WindowShouldClose()) {
         window_width  = GetScreenWidth();
@@ -128,8 +202,13 @@ int main(int argc, char **argv) {
 
         temp_reset();
 
+        TRACE_BEGIN("program_update");
         program_update();
+        TRACE_END();
+
+        TRACE_BEGIN("program_render");
         program_render();
+        TRACE_END();
     }
 
     program_deinit();
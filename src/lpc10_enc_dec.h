@@ -23,8 +23,68 @@
     NDEBUG                     (optional)      - will define internal asserts as (void)(expr).
 
     assert(expr)    - redefine to bypass standard assertion mechanism, it also bypases including stdio.h.
-    LPC_ALLOC(size) - redefine to change allocation strategies (also need to redefine LPC_FREE).
+    LPC_ALLOC(size) - redefine to change default allocator of lpc_context_init (also need to redefine LPC_FREE).
     LPC_FREE(ptr)   - same as LPC_ALLOC.
+    LPC_LANES       - how many segments encoder analyses at once, 8 by default (two SSE or one AVX register of floats).
+    LPC_TRACE_BEGIN(name), LPC_TRACE_END() - define both to time encoder stages, tms5220 encoder and decoder
+                      with your profiler, zones are nested and closed in the same function. Empty by default.
+
+    CONTEXT:
+
+    Every function that allocates or uses chip tables takes Lpc_Context, it holds allocator,
+    tables and scratch memory. Library has no mutable globals, so each thread can use it's own
+    context at the same time. Allocator can be shared between contexts if it is thread safe.
+
+    ```c
+
+    Lpc_Context context;
+    lpc_context_init(&context);           // LPC_ALLOC/LPC_FREE and tms5220 tables
+    context.allocator.alloc = my_alloc;   // optional
+    ...
+    codes = lpc_encode(&context, buffer, settings);
+    ...
+    lpc_context_free(&context);           // releases scratch memory
+
+    ```
+
+    STREAMING:
+
+    tms5220 bytes that come in chunks (serial link, flash pages) can be played
+    without waiting for the whole phrase, every frame is ready when its last bit arrives.
+
+    ```c
+
+    Lpc_TMS5220_Parser parser;
+    lpc_tms5220_parser_init(&parser);
+    lpc_decoder_init(&context, &decoder);
+
+    while (!parser.stopped && (count = read_chunk(chunk))) {
+        for (offset = 0; (offset < count || written) && !parser.stopped; offset += consumed) {
+            written = lpc_tms5220_parser_push(&parser, chunk + offset, count - offset, &consumed, codes, 8);
+            for (i = 0; i < written; i++) lpc_decoder_render_frame(&decoder, codes[i], samples);
+        }
+    }
+
+    ```
+
+    INCREMENTAL ENCODING:
+
+    Encoder can be advanced in small steps from the frame loop of single threaded host.
+    Library doesn't read clocks, so time budget is kept by the caller, few segments per step.
+    Every stage is bounded by that count, so length of the input only changes count of steps.
+
+    ```c
+
+    lpc_encode_begin(&context, &encoder, buffer, settings);
+
+    // every frame
+    do {
+        done = lpc_encode_step(&context, &encoder, 16);
+    } while (!done && now() < deadline);
+
+    if (done) codes = lpc_encode_end(&context, &encoder, &lead_in); // first frame starts lead_in / LPC_SAMPLE_RATE s into buffer
+
+    ```
 
 
     LICENSE:
@@ -53,6 +113,26 @@
     v1.0 Init version.
     v1.1 Adding LPC_UNUSED and LPC_INLINE macro as I forget to add it, preprocessor typos and coments style.
     v1.2 Deleted setting frame_size_ms, as tms5220 is always 25 ms, introduced LPC_FRAME_SIZE_MS.
+    v1.3 Added lpc_tms5220_rom_build for packing phrases into one VSM image, tms5220 encoder pads last byte instead of cutting stop frame.
+    v1.4 Added repeat frames (repeat_thresh setting), repeat bit is checked before unvoiced one like the chip does.
+    v1.5 Added rate-distortion trellis quantization (rd_lambda setting).
+    v1.6 Added tracking pitch search (pitch_search setting), coarse to fine search with smoothing.
+    v1.7 Added Lpc_Decoder for frame by frame synthesis and Lpc_TMS5220_Index for seeking in tms5220 streams.
+    v1.8 Added lpc_tms5220_scan for finding phrases in raw ROM dumps.
+    v2.0 Breaking: Lpc_Context is first argument of allocating functions, tables are const, lpc_decode is LPC_API.
+    v2.1 Faster synthesis kernel, pitch is interpolated in integers so constant pitch doesn't jitter by one sample.
+    v2.2 Added Lpc_Bitcodes (codes packed in 64 bits) with lpc_encode_bitcodes and lpc_tms5220_encode_bitcodes, encoder keeps segments as structure of arrays.
+    v2.3 Added Lpc_TMS5220_Parser, push parser for tms5220 bytes that arrive in chunks.
+    v2.4 Added lpc_tms5220_fifo_simulate, Speak External fifo model that finds underruns and required host rate.
+    v2.5 Added phrase bank (.lpcbank), indexed archive that is read in place and updated by appending.
+    v2.6 Encoder finds reflection coeffs for LPC_LANES segments at once (batched Leroux Gueguen), output is the same.
+    v2.7 Added LPC_TRACE_BEGIN/LPC_TRACE_END hooks for profilers.
+    v2.8 Added Lpc_Resampler, decoder renders straight at 44.1/48 kHz (polyphase interpolator), optionally as int16.
+    v2.9 Added lpc_split for cutting long recordings into phrases at silence.
+    v3.0 Silent frames skip analysis and go out as zero energy frames, silence at both ends is trimmed (silence_thresh setting).
+    v3.1 Added Lpc_Encoder (lpc_encode_begin/step/end) for encoding in steps, output is the same as of lpc_encode_bitcodes.
+    v3.2 Breaking: lpc_tms5220_scan_merge takes the dump, of candidates with the same stop frame the earliest is kept unless it starts with silence.
+    v3.3 Every stage of Lpc_Encoder (conversion, trimming, filters, trellis) does at most max_segments per step.
 */
 
 #if !defined(LPC_ENC_DEC_H)
@@ -115,6 +195,11 @@ extern "C" {
 #endif /* LPC_ALLOC */
 #endif /* LPC_FREE */
 
+#if !defined(LPC_TRACE_BEGIN)
+#define LPC_TRACE_BEGIN(name)
+#define LPC_TRACE_END()
+#endif
+
 #if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
 #define LPC_INLINE inline
 #elif defined(__GNUC__) || defined(__clang__)
@@ -165,6 +250,41 @@ typedef lpc_u8 lpc_u5;
 typedef lpc_u8 lpc_u6;
 typedef lpc_u8 lpc_u7;
 
+/*
+// Context
+//
+// Allocator should return zeroed memory, file and line are where the library allocates,
+// so they can be used by tracking allocators.
+*/
+
+typedef struct {
+    void *(*alloc)(void *user, lpc_u64 size, const char *file, lpc_s32 line);
+    void  (*free)(void *user, void *ptr, const char *file, lpc_s32 line);
+    void   *user;
+} Lpc_Allocator;
+
+/* quantization tables of the chip, library only reads them */
+typedef struct {
+    const lpc_f32 *chirp;
+    const lpc_f32 *energy;
+    const lpc_u32 *pitch;
+    const lpc_f32 *k[10];
+    lpc_u32        k_sizes[10];
+} Lpc_Tables;
+
+/*
+// Everything library needs from outside, there are no mutable globals, so different
+// contexts can be used from different threads at the same time. One context should be
+// used only by one thread at a time, as scratch memory is shared between calls.
+*/
+typedef struct {
+    Lpc_Allocator     allocator;
+    const Lpc_Tables *tables;
+
+    void   *scratch;
+    lpc_u64 scratch_size;
+} Lpc_Context;
+
 /*
 // Intermediate representation of tms5220 code,
 // just before converting it into bit stream
@@ -173,6 +293,11 @@ typedef lpc_u8 lpc_u7;
 
 typedef lpc_u64 lpc_bitcode;
 
+typedef enum {
+    LPC_PITCH_SEARCH_EXHAUSTIVE, /* every lag between min and max period         */
+    LPC_PITCH_SEARCH_TRACKING,   /* decimated search + pitch_table lags + smoothing */
+} Lpc_Pitch_Search;
+
 typedef struct {
     lpc_f32 pitch_low_cut, pitch_high_cut, pitch_q_factor;                /* filter settings that will be applied on pitch recognition        */
     lpc_f32 processing_low_cut, processing_high_cut, processing_q_factor; /* filter settings that will be applied on calculating K parameters */
@@ -183,6 +308,13 @@ typedef struct {
     lpc_f32 pre_emphasis_alpha;
     
     lpc_u32 window_size_in_segments;
+
+    lpc_f32 repeat_thresh; /* max difference of K values from last full frame to emit repeat frame, negative to disable */
+    lpc_f32 rd_lambda;     /* cost of one bit in trellis quantization, 0 to disable, replaces repeat_thresh when enabled */
+
+    lpc_u32 pitch_search;  /* Lpc_Pitch_Search */
+
+    lpc_f32 silence_thresh; /* RMS (full scale is 1) of segment below which it is silent, 0 to disable, see lpc_encode_end for trimmed lead in */
 } Lpc_Encoder_Settings;
 
 #define LPC_DEFAULT_SETTINGS CLITERAL(Lpc_Encoder_Settings) {\
@@ -190,7 +322,10 @@ typedef struct {
     50.0f, 4000.0f, 1.0f,  \
     -0.1f, 2.0f,           \
     true, -0.9373,         \
-    2                      \
+    2,                     \
+    0.0f, 0.0f,            \
+    LPC_PITCH_SEARCH_EXHAUSTIVE, \
+    0.001f                 \
 }
 
 /* 
@@ -221,33 +356,146 @@ typedef struct {
 
 typedef struct {
     lpc_u32 count;
-    /*
-    // @note: I use offsets from buffer start instead of pointers because
-    // it allows me to use multiple buffers with same segment info.
-    // So the info is shared.                       @bonmas
-    */
-    lpc_u32 buffer_offset;
-
-    lpc_u32 table_energy;
-    lpc_u32 table_pitch;
-    lpc_u32 table_k[10];
-} Lpc_Segment;
+    Lpc_Code *code;
+} Lpc_Codes;
 
+/* same codes packed with lpc_convert_to_bitcode_internal, 8 bytes per frame */
 typedef struct {
     lpc_u32 count;
-    Lpc_Code *code;
-} Lpc_Codes;
+    lpc_bitcode *code;
+} Lpc_Bitcodes;
 
+/*
+// Per frame analysis of encoder, kept as structure of arrays, so every pass over
+// one parameter of all frames walks contiguous memory. All arrays live in one block.
+//
+// @note: segment i starts at i * segment_size sample of the buffer, only the last
+// one can be shorter, so offsets and sizes are not stored.
+*/
 typedef struct {
-    lpc_u32      count;
-    Lpc_Segment *data;
+    lpc_u32 count;
+    lpc_u32 segment_size;
+    lpc_u32 sample_count;
+
+    /* table indices */
+    lpc_u8 *energy;
+    lpc_u8 *pitch;
+    lpc_u8 *table_k[10];
+    lpc_u8 *silent; /* below silence_thresh, analysis is skipped */
+
+    /* unquantized values, used by trellis quantization */
+    lpc_f32 *rms;
+    lpc_f32 *k[10];
 } Lpc_Segments;
 
+#define LPC_PITCH_CANDIDATES 4
+
+/* best pitch_table lags of one segment in tracking pitch search, the best one is first */
+typedef struct {
+    lpc_u32 count;
+    lpc_u32 index[LPC_PITCH_CANDIDATES];
+    lpc_f32 score[LPC_PITCH_CANDIDATES];
+} Lpc_Pitch_Candidates;
+
+typedef struct {
+    lpc_f32 b0, b1, b2;
+    lpc_f32 a0, a1, a2;
+
+    lpc_f32 x1, x2;
+    lpc_f32 y1, y2;
+} Lpc_Biquad_Filter;
+
+#define LPC_TRELLIS_CANDIDATES 4
+#define LPC_TRELLIS_BEAM       32
+
+/* few K sets that are tried for full frame in trellis quantization */
+typedef struct {
+    lpc_u32 count;
+    lpc_u8  k[LPC_TRELLIS_CANDIDATES][10];
+    lpc_f32 value[LPC_TRELLIS_CANDIDATES][10];
+} Lpc_Trellis_Candidates;
+
+typedef struct {
+    lpc_f32 cost;
+    lpc_u32 back;
+
+    lpc_b32 has_reference;
+    lpc_u32 reference_frame;
+    lpc_u8  reference_candidate;
+    lpc_u8  reference_voiced;
+
+    lpc_u8  choice;
+    lpc_u8  voiced;
+} Lpc_Trellis_Node;
+
+/* viterbi search of trellis quantization, frames are added and traced back in parts */
+typedef struct {
+    Lpc_Trellis_Candidates *candidates;
+    Lpc_Trellis_Node       *nodes;       /* LPC_TRELLIS_BEAM per frame */
+    lpc_u32                *node_counts;
+    lpc_u32                 back;        /* node of the last frame that is not traced yet */
+} Lpc_Trellis;
+
+/* every stage does at most max_segments segments (or frames) per step */
+typedef enum {
+    LPC_ENCODE_STAGE_PREPARE,  /* resampling, levels of segments for trimming           */
+    LPC_ENCODE_STAGE_EMPHASIS, /* silent segments, pitch filter and pre emphasis        */
+    LPC_ENCODE_STAGE_FILTER,   /* gain of pre emphasis and filter of buffer             */
+    LPC_ENCODE_STAGE_PITCH,
+    LPC_ENCODE_STAGE_ANALYSIS, /* rounded up to LPC_LANES                               */
+    LPC_ENCODE_STAGE_CODES,    /* quantization, or forward pass of trellis              */
+    LPC_ENCODE_STAGE_TRACE,    /* trace back of trellis                                 */
+    LPC_ENCODE_STAGE_DONE,
+} Lpc_Encode_Stage;
+
+/*
+// Encoder that is advanced in steps, for hosts that can't block or run threads.
+// Stage and cursor are where the next step continues, buffers are owned by it
+// until lpc_encode_end, the same context should be passed to every call.
+*/
+typedef struct {
+    Lpc_Encoder_Settings settings;
+    Lpc_Sample_Buffer    input;  /* not copied, should stay valid until prepare stage is done */
+
+    lpc_u32 stage;   /* Lpc_Encode_Stage */
+    lpc_u32 cursor;  /* next segment of the stage, trace goes from the end */
+    lpc_u32 lead_in; /* samples of silence trimmed from the start, at LPC_SAMPLE_RATE */
+
+    lpc_f32              *samples; /* allocation of buffer, trimming moves only the pointer of buffer */
+    Lpc_Sample_Buffer     buffer, pitch_buffer;
+    Lpc_Segments          segments;
+    Lpc_Pitch_Candidates *candidates; /* tracking pitch search only */
+    Lpc_Bitcodes          codes;
+
+    /* state that is carried from one step to next */
+    lpc_u32           loud_first, loud_last; /* loud segments of untrimmed buffer, last is exclusive */
+    Lpc_Biquad_Filter filter, pitch_filter;
+    lpc_f32           previous;              /* sample before cursor, as it was before pre emphasis */
+    lpc_f32           pre_energy, post_energy;
+    Lpc_Trellis       trellis;
+    lpc_b32           has_reference;
+    lpc_u32           reference;             /* last full frame, when codes are without trellis */
+} Lpc_Encoder;
+
 typedef struct {
     lpc_u32 count;
     lpc_u8 *bytes;
 } Lpc_TMS5220_Buffer;
 
+/*
+// Packed ROM image, offsets are byte addresses of phrases in the same order
+// as they were passed to lpc_tms5220_rom_build. Count is size of the whole
+// image, used is how much of it is occupied by phrases.
+*/
+typedef struct {
+    lpc_u32  count;
+    lpc_u32  used;
+    lpc_u8  *bytes;
+
+    lpc_u32  phrase_count;
+    lpc_u32 *offsets;
+} Lpc_TMS5220_Rom;
+
 typedef struct {
     lpc_bitcode code;
     lpc_u32     bits_count;
@@ -260,15 +508,223 @@ typedef struct {
     lpc_f32 k[10];
 } Lpc_Synth;
 
+/* synthesis state, lpc_decode uses it, but you can also render frame by frame */
 typedef struct {
-    lpc_f32 b0, b1, b2;
-    lpc_f32 a0, a1, a2;
+    const Lpc_Tables *tables;
+    Lpc_Synth previous, target, current;
+    lpc_f32   forward[10], backward[10];
+    lpc_u32   phase_counter;
+    lpc_u32   noise;
+} Lpc_Decoder;
 
-    lpc_f32 x1, x2;
-    lpc_f32 y1, y2;
-} Lpc_Biquad_Filter;
+/*
+// Fixed ratio polyphase interpolator from LPC_SAMPLE_RATE up to device rate, 44100 is 441/80
+// and 48000 is 6/1 of it. Filter is read only, so voices can share it, each with it's own
+// Lpc_Resampler_State. Zeroed state is start of stream, output is late by LPC_RESAMPLE_TAPS / 2
+// input samples.
+*/
+#define LPC_RESAMPLE_TAPS       16
+#define LPC_RESAMPLE_MAX_PHASES 2048
+
+typedef struct {
+    lpc_u32  rate;
+    lpc_u32  up, down; /* rate / LPC_SAMPLE_RATE as reduced fraction */
+    lpc_f32 *filter;   /* up phases of LPC_RESAMPLE_TAPS taps */
+} Lpc_Resampler;
+
+typedef struct {
+    lpc_u32 phase;     /* position of next output after current input sample, in 1 / up */
+    lpc_f32 history[LPC_RESAMPLE_TAPS - 1];
+} Lpc_Resampler_State;
+
+/*
+// Seek index of tms5220 stream, entry for every interval frames. Target is
+// the state of interpolation at the start of the frame, so the decoder can
+// continue from it (repeat frames need the Ks of earlier frame too), phase
+// and noise keep excitation in sync. Lattice filter starts from silence.
+*/
+typedef struct {
+    lpc_u32   bit_offset;
+    lpc_u32   phase_counter;
+    lpc_u32   noise;
+    Lpc_Synth target;
+} Lpc_TMS5220_Index_Entry;
+
+typedef struct {
+    lpc_u32 interval;
+    lpc_u32 frame_count;
+    lpc_u32 count;
+    Lpc_TMS5220_Index_Entry *entries;
+} Lpc_TMS5220_Index;
+
+/*
+// Push parser of tms5220 stream, for bytes that arrive in chunks. Only bits of
+// the unfinished frame are kept between calls, first received bit is the lowest one.
+*/
+typedef struct {
+    lpc_u64 bits;
+    lpc_u32 bits_count;
+    lpc_u32 frame_count; /* frames emitted so far, with stop frame */
+    lpc_b32 stopped;     /* stop frame was emitted, nothing is consumed after it */
+} Lpc_TMS5220_Parser;
+
+/*
+// Speak External feeding model. Host fills the fifo after speak command, chip starts when
+// it is more than half full, and then takes all bits of a frame when the frame starts.
+// When fifo drops to half or less, buffer low interrupt fires and after latency_us host
+// writes at host_bytes_per_second until the fifo is full again.
+*/
+typedef struct {
+    lpc_u32 host_bytes_per_second;
+    lpc_u32 latency_us;
+    lpc_u32 fifo_size;     /* in bytes, 16 on tms5220, at least 8 so full frame fits */
+    lpc_u32 window_frames; /* length of window for peak rate */
+} Lpc_Fifo_Settings;
+
+#define LPC_DEFAULT_FIFO_SETTINGS CLITERAL(Lpc_Fifo_Settings) {\
+    1000, 100, 16, 8 \
+}
+
+typedef struct {
+    lpc_u32 frame;        /* frame that started before all of its bits were in fifo */
+    lpc_u32 time_us;      /* from the speak command */
+    lpc_u32 missing_bits;
+} Lpc_Fifo_Underrun;
+
+/*
+// On underrun the real chip runs out of data and stops talking, simulation waits
+// for the missing bits instead, so every underrun point of the phrase is reported.
+*/
+typedef struct {
+    lpc_u32 frame_count;               /* with stop frame */
+    lpc_u32 interrupt_count;           /* buffer low interrupts */
+    lpc_u32 min_fifo_bits;             /* lowest fill when frame starts while host has data, headroom of the host */
+    lpc_f32 average_bytes_per_second;
+    lpc_f32 peak_bytes_per_second;     /* highest over window_frames */
+    lpc_u32 peak_frame;                /* first frame of that window */
+    lpc_u32 burst_frames;              /* longest run of voiced 50 bit frames */
+    lpc_u32 burst_frame;
+    lpc_u32 required_bytes_per_second; /* lowest host rate without underruns at this latency, 0 if phrase can't be streamed */
+
+    lpc_u32 underrun_count;
+    Lpc_Fifo_Underrun *underruns;
+} Lpc_Fifo_Report;
+
+/*
+// Splitting of long recordings into phrases at silence. Levels are in dB to the loudest window
+// of the recording, window is silent below silence_db and speech again above speech_db, between
+// them it keeps the previous state, so noise around one level doesn't cut a phrase in pieces.
+*/
+typedef struct {
+    lpc_u32 window_ms;     /* resolution of energy envelope */
+    lpc_f32 silence_db;
+    lpc_f32 speech_db;
+    lpc_u32 min_gap_ms;    /* shorter silences are kept inside of the phrase */
+    lpc_u32 min_phrase_ms; /* shorter phrases are dropped as clicks */
+    lpc_u32 padding_ms;    /* kept before and after every phrase, if there is that much silence */
+} Lpc_Split_Settings;
+
+#define LPC_DEFAULT_SPLIT_SETTINGS CLITERAL(Lpc_Split_Settings) {\
+    10, -40.0f, -34.0f, 300, 100, 50 \
+}
+
+typedef struct {
+    lpc_u32 first; /* frame of the buffer */
+    lpc_u32 count;
+} Lpc_Split_Range;
 
 typedef struct {
+    lpc_u32 count;
+    Lpc_Split_Range *ranges;
+} Lpc_Split;
+
+/*
+// Phrase bank (.lpcbank), file that is used straight from memory (mmap), numbers are
+// in native byte order. Header, then data of every phrase: name with terminating zero,
+// tms5220 stream and optional Lpc_Code array, each part 8 byte aligned. Index of entries
+// sorted by name hash (and name) is written after data. Update appends new data and new
+// index at the end and rewrites only the header, so old data is never moved.
+*/
+#define LPC_BANK_MAGIC   0x4b4e4142 /* "BANK" */
+#define LPC_BANK_VERSION 1
+
+typedef struct {
+    lpc_u32 magic;
+    lpc_u32 version;
+    lpc_u32 entry_count;
+    lpc_u32 code_size;    /* sizeof(Lpc_Code) of the writer, stored codes are ignored if it doesn't match */
+    lpc_u64 index_offset;
+    lpc_u64 file_size;    /* end of the index, file can be truncated to it */
+    lpc_u64 dead_bytes;   /* replaced phrases and old indices, only rewriting the bank removes them */
+    lpc_u64 reserved[3];
+} Lpc_Bank_Header;
+
+typedef struct {
+    lpc_u64 name_hash;
+    lpc_u32 name_offset;
+    lpc_u32 name_size;     /* without terminating zero */
+    lpc_u32 stream_offset;
+    lpc_u32 stream_size;
+    lpc_u32 codes_offset;  /* 0 if codes are not stored */
+    lpc_u32 code_count;    /* with stop frame */
+} Lpc_Bank_Entry;
+
+typedef struct {
+    const lpc_u8          *bytes;
+    lpc_u64                size;
+    const Lpc_Bank_Header *header;
+    const Lpc_Bank_Entry  *entries;
+} Lpc_Bank;
+
+typedef struct {
+    const char        *name;
+    Lpc_TMS5220_Buffer stream;
+    Lpc_Codes          codes;  /* count 0 to store only the stream */
+} Lpc_Bank_Phrase;
+
+/* bytes go to offset of the file, header goes to the start of it after them */
+typedef struct {
+    lpc_u64         offset;
+    lpc_u32         count;
+    lpc_u8         *bytes;
+    Lpc_Bank_Header header;
+} Lpc_Bank_Update;
+
+/*
+// ROM dump scanning, every byte offset is decoded until stop frame and
+// the run is checked to look like speech and not random bits.
+*/
+typedef struct {
+    lpc_u32 min_frames;       /* shorter runs are rejected, stop frame is not counted    */
+    lpc_u32 max_frames;       /* runs without stop frame in this many frames are rejected */
+    lpc_f32 max_silent_ratio; /* part of frames that have zero energy                    */
+
+    lpc_u32 max_energy_jump;  /* change of energy index between sounding frames          */
+    lpc_u32 max_pitch_jump;   /* change of pitch index between voiced frames             */
+    lpc_u32 max_k_jump;       /* change of K1 and K2 indices between full frames         */
+    lpc_f32 max_jump_ratio;   /* part of changes that can be bigger than max ones        */
+} Lpc_Scan_Settings;
+
+#define LPC_DEFAULT_SCAN_SETTINGS CLITERAL(Lpc_Scan_Settings) {\
+    10, 1024, 0.8f,      \
+    3, 8, 6, 0.2f        \
+}
+
+typedef struct {
+    lpc_u32 offset;      /* byte offset of phrase in the dump */
+    lpc_u32 bits_count;  /* with stop frame                   */
+    lpc_u32 frame_count; /* without stop frame                */
+    lpc_u32 silent_count;
+    lpc_f32 score;       /* part of changes that were too big, lower is more like speech */
+} Lpc_TMS5220_Phrase;
+
+typedef struct {
+    lpc_u32 count;
+    Lpc_TMS5220_Phrase *phrases;
+} Lpc_TMS5220_Scan;
+
+typedef struct {
+    Lpc_Context *context;
     lpc_u64 count;
     lpc_u64 capacity;
     lpc_u64 element_size;
@@ -282,17 +738,105 @@ typedef struct {
 /* Helper function to make sure, codes are correct */
 LPC_API Lpc_Code           lpc_code_clamp(Lpc_Code code);
 
-LPC_API Lpc_Codes          lpc_encode(Lpc_Sample_Buffer buffer, Lpc_Encoder_Settings settings);
-LPC_API Lpc_Sample_Buffer  lpc_decode(Lpc_Codes codes);
-
-LPC_API void               lpc_codes_free(Lpc_Codes *codes);
-LPC_API void               lpc_buffer_free(Lpc_Sample_Buffer *buffer);
-
-LPC_API Lpc_TMS5220_Buffer lpc_tms5220_encode(Lpc_Codes codes);
-LPC_API Lpc_Codes          lpc_tms5220_decode(Lpc_TMS5220_Buffer buffer);
-LPC_API void               lpc_tms5220_buffer_free(Lpc_TMS5220_Buffer *buffer);
-
-LPC_API Lpc_List           lpc_list_create(lpc_u64 init_size, lpc_u64 element_size);
+LPC_API Lpc_Bitcodes       lpc_codes_pack(Lpc_Context *context, Lpc_Codes codes);
+LPC_API Lpc_Codes          lpc_bitcodes_unpack(Lpc_Context *context, Lpc_Bitcodes bitcodes);
+
+/* default allocator (LPC_ALLOC, LPC_FREE) and tms5220 tables */
+LPC_API void               lpc_context_init(Lpc_Context *context);
+/* frees scratch memory, context can be used again after that */
+LPC_API void               lpc_context_free(Lpc_Context *context);
+
+LPC_API Lpc_Codes          lpc_encode(Lpc_Context *context, Lpc_Sample_Buffer buffer, Lpc_Encoder_Settings settings);
+/* same as lpc_encode, but codes stay packed, use it when codes are only stored or sent to lpc_tms5220_encode_bitcodes */
+LPC_API Lpc_Bitcodes       lpc_encode_bitcodes(Lpc_Context *context, Lpc_Sample_Buffer buffer, Lpc_Encoder_Settings settings);
+
+LPC_API void               lpc_encode_begin(Lpc_Context *context, Lpc_Encoder *encoder, Lpc_Sample_Buffer buffer, Lpc_Encoder_Settings settings);
+/* does one stage, or max_segments of it (0 for no limit), returns true when codes are ready */
+LPC_API lpc_b32            lpc_encode_step(Lpc_Context *context, Lpc_Encoder *encoder, lpc_u32 max_segments);
+/* frees encoder and returns codes, codes are empty if encoding is not done (cancel).
+ * lead_in (can be NULL) gets count of samples trimmed as silence before the first frame. */
+LPC_API Lpc_Bitcodes       lpc_encode_end(Lpc_Context *context, Lpc_Encoder *encoder, lpc_u32 *lead_in);
+LPC_API Lpc_Sample_Buffer  lpc_decode(Lpc_Context *context, Lpc_Codes codes);
+
+/* phrase ranges in order, split has to be freed */
+LPC_API Lpc_Split          lpc_split(Lpc_Context *context, Lpc_Sample_Buffer buffer, Lpc_Split_Settings settings);
+LPC_API void               lpc_split_free(Lpc_Context *context, Lpc_Split *split);
+/* part of buffer, samples are not copied */
+LPC_API Lpc_Sample_Buffer  lpc_split_range_buffer(Lpc_Sample_Buffer buffer, Lpc_Split_Range range);
+
+LPC_API void               lpc_decoder_init(Lpc_Context *context, Lpc_Decoder *decoder);
+/* renders LPC_SAMPLES samples, not normalized, returns false on stop frame */
+LPC_API lpc_b32            lpc_decoder_render_frame(Lpc_Decoder *decoder, Lpc_Code code, lpc_f32 *samples);
+
+/* rate has to be at least LPC_SAMPLE_RATE, returns false if ratio needs more than LPC_RESAMPLE_MAX_PHASES phases */
+LPC_API lpc_b32            lpc_resampler_init(Lpc_Context *context, Lpc_Resampler *resampler, lpc_u32 rate);
+LPC_API void               lpc_resampler_free(Lpc_Context *context, Lpc_Resampler *resampler);
+/* most samples that count input samples can give, output buffers should be this big */
+LPC_API lpc_u32            lpc_resampler_max_output(const Lpc_Resampler *resampler, lpc_u32 count);
+/* returns count of written samples */
+LPC_API lpc_u32            lpc_resample(const Lpc_Resampler *resampler, Lpc_Resampler_State *state, const lpc_f32 *input, lpc_u32 count, lpc_f32 *output);
+/* renders frame straight at resampler rate, returns count of written samples, 0 on stop frame */
+LPC_API lpc_u32            lpc_decoder_render_frame_resampled(Lpc_Decoder *decoder, const Lpc_Resampler *resampler, Lpc_Resampler_State *state, Lpc_Code code, lpc_f32 *samples);
+/* same, but samples are multiplied by gain and written as int16, that can go to the device as is */
+LPC_API lpc_u32            lpc_decoder_render_frame_s16(Lpc_Decoder *decoder, const Lpc_Resampler *resampler, Lpc_Resampler_State *state, Lpc_Code code, lpc_f32 gain, lpc_s16 *samples);
+/* lpc_decode at resampler rate, normalized the same way */
+LPC_API Lpc_Sample_Buffer  lpc_decode_resampled(Lpc_Context *context, Lpc_Codes codes, const Lpc_Resampler *resampler);
+
+LPC_API void               lpc_codes_free(Lpc_Context *context, Lpc_Codes *codes);
+LPC_API void               lpc_bitcodes_free(Lpc_Context *context, Lpc_Bitcodes *bitcodes);
+LPC_API void               lpc_buffer_free(Lpc_Context *context, Lpc_Sample_Buffer *buffer);
+
+LPC_API Lpc_TMS5220_Buffer lpc_tms5220_encode(Lpc_Context *context, Lpc_Codes codes);
+LPC_API Lpc_TMS5220_Buffer lpc_tms5220_encode_bitcodes(Lpc_Context *context, Lpc_Bitcodes bitcodes);
+LPC_API Lpc_Codes          lpc_tms5220_decode(Lpc_Context *context, Lpc_TMS5220_Buffer buffer);
+LPC_API void               lpc_tms5220_buffer_free(Lpc_Context *context, Lpc_TMS5220_Buffer *buffer);
+
+LPC_API Lpc_TMS5220_Index  lpc_tms5220_index_build(Lpc_Context *context, Lpc_TMS5220_Buffer buffer, lpc_u32 interval);
+LPC_API void               lpc_tms5220_index_free(Lpc_Context *context, Lpc_TMS5220_Index *index);
+/* decodes up to max_frames codes starting at frame, and if decoder is not NULL, prepares it to render them */
+LPC_API Lpc_Codes          lpc_tms5220_decode_from(Lpc_Context *context, Lpc_TMS5220_Buffer buffer, Lpc_TMS5220_Index index, lpc_u32 frame, lpc_u32 max_frames, Lpc_Decoder *decoder);
+LPC_API lpc_u32            lpc_tms5220_frame_from_ms(lpc_u32 ms);
+
+LPC_API void               lpc_tms5220_parser_init(Lpc_TMS5220_Parser *parser);
+/*
+// Takes bytes until max_codes frames are written or stop frame is parsed, returns count of written frames.
+// Frame is written as soon as its last bit arrives, bytes that were not consumed should be pushed again,
+// push with zero bytes writes frames that didn't fit last time. After stop frame rest of the byte is padding.
+*/
+LPC_API lpc_u32            lpc_tms5220_parser_push(Lpc_TMS5220_Parser *parser, const lpc_u8 *bytes, lpc_u32 count, lpc_u32 *consumed, Lpc_Code *codes, lpc_u32 max_codes);
+
+/* stream is read until stop frame, report has to be freed */
+LPC_API Lpc_Fifo_Report    lpc_tms5220_fifo_simulate(Lpc_Context *context, Lpc_TMS5220_Buffer buffer, Lpc_Fifo_Settings settings);
+LPC_API void               lpc_fifo_report_free(Lpc_Context *context, Lpc_Fifo_Report *report);
+
+/* checks header and index bounds, nothing is copied, memory should outlive the bank */
+LPC_API lpc_b32            lpc_bank_open(Lpc_Bank *bank, const void *bytes, lpc_u64 size);
+LPC_API lpc_u64            lpc_bank_hash(const char *name);
+/* binary search in the index, returns entry or -1 */
+LPC_API lpc_s64            lpc_bank_find(Lpc_Bank bank, const char *name);
+/* point into bank memory, don't free or change them, empty if entry is broken */
+LPC_API const char        *lpc_bank_name(Lpc_Bank bank, lpc_u32 entry);
+LPC_API Lpc_TMS5220_Buffer lpc_bank_stream(Lpc_Bank bank, lpc_u32 entry);
+LPC_API Lpc_Codes          lpc_bank_codes(Lpc_Bank bank, lpc_u32 entry);
+/* bank is NULL for a new file, phrases with names that are already in bank replace them */
+LPC_API Lpc_Bank_Update    lpc_bank_update(Lpc_Context *context, const Lpc_Bank *bank, const Lpc_Bank_Phrase *phrases, lpc_u32 phrase_count);
+LPC_API void               lpc_bank_update_free(Lpc_Context *context, Lpc_Bank_Update *update);
+
+/* If phrases don't fit in rom_size, bytes are NULL and used holds the size that was required */
+LPC_API Lpc_TMS5220_Rom    lpc_tms5220_rom_build(Lpc_Context *context, Lpc_TMS5220_Buffer *phrases, lpc_u32 phrase_count, lpc_u32 rom_size);
+LPC_API void               lpc_tms5220_rom_free(Lpc_Context *context, Lpc_TMS5220_Rom *rom);
+
+/* returns true and fills phrase if speech like run of frames starts at byte offset */
+LPC_API lpc_b32            lpc_tms5220_scan_offset(Lpc_TMS5220_Buffer buffer, lpc_u32 offset, Lpc_Scan_Settings settings, Lpc_TMS5220_Phrase *phrase);
+/* candidates at every byte offset in [first, last), doesn't share any state, so parts of dump can be scanned from different threads */
+LPC_API Lpc_TMS5220_Scan   lpc_tms5220_scan(Lpc_Context *context, Lpc_TMS5220_Buffer buffer, lpc_u32 first, lpc_u32 last, Lpc_Scan_Settings settings);
+/* scans of buffer should be in order of their ranges, overlapping candidates are resolved */
+LPC_API Lpc_TMS5220_Scan   lpc_tms5220_scan_merge(Lpc_Context *context, Lpc_TMS5220_Buffer buffer, Lpc_TMS5220_Scan *scans, lpc_u32 scan_count);
+LPC_API void               lpc_tms5220_scan_free(Lpc_Context *context, Lpc_TMS5220_Scan *scan);
+/* part of the dump that holds phrase, points into dump memory, don't free it */
+LPC_API Lpc_TMS5220_Buffer lpc_tms5220_phrase_buffer(Lpc_TMS5220_Buffer dump, Lpc_TMS5220_Phrase phrase);
+
+LPC_API Lpc_List           lpc_list_create(Lpc_Context *context, lpc_u64 init_size, lpc_u64 element_size);
 LPC_API void               lpc_list_destroy(Lpc_List *list);
 
 LPC_API void*              lpc_list_get(Lpc_List *list, lpc_u64 index);
@@ -307,7 +851,7 @@ LPC_API lpc_b32            lpc_list_append(Lpc_List *list, void *data);
 
 #define LPC_START_BIT         49LL
 #define LPC_UNVOICED_STOP_BIT 21LL
-#define LPC_REPEAT_STOP_BIT   38LL
+#define LPC_REPEAT_STOP_BIT   39LL
 
 #define LPC_SIGNAL_BIT        46LL
 #define LPC_REPEAT_BIT        45LL
@@ -339,7 +883,7 @@ LPC_API lpc_b32            lpc_list_append(Lpc_List *list, void *data);
 #define LPC_CHIRP_TABLE_SIZE  52
 
 /* LATER_CHIRP, from python_wizard: https://github.com/ptwz/python_wizard */
-LPC_API lpc_f32 chirp_table[LPC_CHIRP_TABLE_SIZE] = {
+LPC_API const lpc_f32 chirp_table[LPC_CHIRP_TABLE_SIZE] = {
      0,   3,   15,  40,  76,  108, 113,  80,
      37,  38,  76,  68,  26,  50,  59,  19,
      55,  26,  37,  31,  29,  0,   0,   0,
@@ -349,21 +893,21 @@ LPC_API lpc_f32 chirp_table[LPC_CHIRP_TABLE_SIZE] = {
      0,   0,   0,   0,  
 };
 
-LPC_API lpc_f32 energy_table[LPC_ENERGY_MASK + 1] = {
+LPC_API const lpc_f32 energy_table[LPC_ENERGY_MASK + 1] = {
        0,   52,   87,  123,
      174,  246,  348,  491,
      694,  981, 1385, 1957,
     2764, 3904, 5514, 7789
 };
 
-LPC_API lpc_u32 pitch_table[LPC_PITCH_MASK + 1] = { 
+LPC_API const lpc_u32 pitch_table[LPC_PITCH_MASK + 1] = { 
     0,  15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,
     30, 31,  32,  33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  44,  46,  48,
     50, 52,  53,  56,  58,  60,  62,  65,  68,  70,  72,  76,  78,  80,  84,  86,
     91, 94,  98, 101, 105, 109, 114, 118, 122, 127, 132, 137, 142, 148, 153, 159,
 };
 
-LPC_API lpc_f32 k1_table[LPC_K1_K2_MASK + 1] = {
+LPC_API const lpc_f32 k1_table[LPC_K1_K2_MASK + 1] = {
     -0.97850, -0.97270, -0.97070, -0.96680,
     -0.96290, -0.95900, -0.95310, -0.94140,
     -0.93360, -0.92580, -0.91600, -0.90620,
@@ -375,7 +919,7 @@ LPC_API lpc_f32 k1_table[LPC_K1_K2_MASK + 1] = {
      0.66013,  0.75054,  0.80416,  0.85350,
 };
 
-LPC_API lpc_f32 k2_table[LPC_K1_K2_MASK + 1] = {
+LPC_API const lpc_f32 k2_table[LPC_K1_K2_MASK + 1] = {
     -0.64000, -0.58999, -0.53500, -0.47507,
     -0.41039, -0.34129, -0.26830, -0.19209,
     -0.11350, -0.03345,  0.04702,  0.12690,
@@ -387,56 +931,128 @@ LPC_API lpc_f32 k2_table[LPC_K1_K2_MASK + 1] = {
      0.90451,  0.91813,  0.92988,  0.98830
 };
 
-LPC_API lpc_f32 k3_table[LPC_K3_K4_K5_K6_K7_MASK + 1] = {
+LPC_API const lpc_f32 k3_table[LPC_K3_K4_K5_K6_K7_MASK + 1] = {
     -0.86000, -0.75467, -0.64933, -0.54400,
     -0.43867, -0.33333, -0.22800, -0.12267,
     -0.01733,  0.08800,  0.19333,  0.29867,
      0.40400,  0.50933,  0.61467,  0.72000
 };
 
-LPC_API lpc_f32 k4_table[LPC_K3_K4_K5_K6_K7_MASK + 1] = {
+LPC_API const lpc_f32 k4_table[LPC_K3_K4_K5_K6_K7_MASK + 1] = {
     -0.64000, -0.53145, -0.42289, -0.31434,
     -0.20579, -0.09723,  0.01132,  0.11987,
      0.22843,  0.33698,  0.44553,  0.55409,
      0.66264,  0.77119,  0.87975,  0.98830
 };
 
-LPC_API lpc_f32 k5_table[LPC_K3_K4_K5_K6_K7_MASK + 1] = {
+LPC_API const lpc_f32 k5_table[LPC_K3_K4_K5_K6_K7_MASK + 1] = {
     -0.64000, -0.54933, -0.45867, -0.36800,
     -0.27733, -0.18667, -0.09600, -0.00533,
      0.08533,  0.17600,  0.26667,  0.35733,
      0.44800,  0.53867,  0.62933,  0.72000
 };
 
-LPC_API lpc_f32 k6_table[LPC_K3_K4_K5_K6_K7_MASK + 1] = {
+LPC_API const lpc_f32 k6_table[LPC_K3_K4_K5_K6_K7_MASK + 1] = {
     -0.50000, -0.41333, -0.32667, -0.24000,
     -0.15333, -0.06667,  0.02000,  0.10667,
      0.19333,  0.28000,  0.36667,  0.45333,
      0.54000,  0.62667,  0.71333,  0.80000
 };
 
-LPC_API lpc_f32 k7_table[LPC_K3_K4_K5_K6_K7_MASK + 1] = {
+LPC_API const lpc_f32 k7_table[LPC_K3_K4_K5_K6_K7_MASK + 1] = {
     -0.60000, -0.50667, -0.41333, -0.32000,
     -0.22667, -0.13333, -0.04000,  0.05333,
      0.14667,  0.24000,  0.33333,  0.42667,
      0.52000,  0.61333,  0.70667,  0.80000
 };
 
-LPC_API lpc_f32 k8_table[LPC_K8_K9_K10_MASK + 1]  = {
+LPC_API const lpc_f32 k8_table[LPC_K8_K9_K10_MASK + 1]  = {
     -0.50000, -0.31429, -0.12857,  0.05714,
      0.24286,  0.42857,  0.61429,  0.80000
 };
 
-LPC_API lpc_f32 k9_table[LPC_K8_K9_K10_MASK + 1]  = {
+LPC_API const lpc_f32 k9_table[LPC_K8_K9_K10_MASK + 1]  = {
     -0.50000, -0.34286, -0.18571, -0.02857,
      0.12857,  0.28571,  0.44286,  0.60000
 };
 
-LPC_API lpc_f32 k10_table[LPC_K8_K9_K10_MASK + 1] = {
+LPC_API const lpc_f32 k10_table[LPC_K8_K9_K10_MASK + 1] = {
     -0.40000, -0.25714, -0.11429,  0.02857,
      0.17143,  0.31429,  0.45714,  0.60000
 };
 
+LPC_API const Lpc_Tables lpc_tms5220_tables = {
+    chirp_table, energy_table, pitch_table,
+    {
+        k1_table, k2_table, k3_table, k4_table, k5_table,
+        k6_table, k7_table, k8_table, k9_table, k10_table
+    },
+    {
+        LPC_K1_K2_MASK + 1,          LPC_K1_K2_MASK + 1,
+        LPC_K3_K4_K5_K6_K7_MASK + 1, LPC_K3_K4_K5_K6_K7_MASK + 1, LPC_K3_K4_K5_K6_K7_MASK + 1,
+        LPC_K3_K4_K5_K6_K7_MASK + 1, LPC_K3_K4_K5_K6_K7_MASK + 1,
+        LPC_K8_K9_K10_MASK + 1,      LPC_K8_K9_K10_MASK + 1,      LPC_K8_K9_K10_MASK + 1
+    }
+};
+
+/*
+// Context
+*/
+
+#define LPC_CONTEXT_ALLOC(context, size) (context)->allocator.alloc((context)->allocator.user, (size), __FILE__, __LINE__)
+#define LPC_CONTEXT_FREE(context, ptr)   (context)->allocator.free((context)->allocator.user, (ptr), __FILE__, __LINE__)
+
+LPC_API void *lpc_default_alloc_internal(void *user, lpc_u64 size, const char *file, lpc_s32 line) {
+    LPC_UNUSED(user);
+    LPC_UNUSED(file);
+    LPC_UNUSED(line);
+
+    return LPC_ALLOC(size);
+}
+
+LPC_API void lpc_default_free_internal(void *user, void *ptr, const char *file, lpc_s32 line) {
+    LPC_UNUSED(user);
+    LPC_UNUSED(file);
+    LPC_UNUSED(line);
+
+    LPC_FREE(ptr);
+}
+
+LPC_API void lpc_context_init(Lpc_Context *context) {
+    assert(context != NULL);
+
+    memset(context, 0, sizeof(Lpc_Context));
+
+    context->allocator.alloc = lpc_default_alloc_internal;
+    context->allocator.free  = lpc_default_free_internal;
+    context->tables          = &lpc_tms5220_tables;
+}
+
+LPC_API void lpc_context_free(Lpc_Context *context) {
+    assert(context != NULL);
+
+    if (context->scratch) {
+        LPC_CONTEXT_FREE(context, context->scratch);
+    }
+
+    context->scratch      = NULL;
+    context->scratch_size = 0;
+}
+
+/* memory for temporary buffers of one call, grows when needed, not zeroed, valid until next call */
+LPC_API void *lpc_scratch_internal(Lpc_Context *context, lpc_u64 size) {
+    if (size > context->scratch_size) {
+        if (context->scratch) {
+            LPC_CONTEXT_FREE(context, context->scratch);
+        }
+
+        context->scratch      = LPC_CONTEXT_ALLOC(context, size);
+        context->scratch_size = context->scratch ? size : 0;
+    }
+
+    return context->scratch;
+}
+
 /*
 // Filtering
 */
@@ -499,10 +1115,6 @@ LPC_API LPC_INLINE lpc_f32 biquad_process(Lpc_Biquad_Filter *filter, lpc_f32 inp
 // Helpers
 */
 
-LPC_API lpc_f32 lpc_lerpf(lpc_f32 a, lpc_f32 b, lpc_f32 t) {
-    return (1.0f - t) * a + b * t;
-}
-
 LPC_API Lpc_Code lpc_code_clamp(Lpc_Code code) {
     Lpc_Code output;
 
@@ -596,14 +1208,51 @@ LPC_API Lpc_Code lpc_convert_from_bitcode_internal(lpc_bitcode bitcode) {
     return output;
 }
 
+LPC_API Lpc_Bitcodes lpc_codes_pack(Lpc_Context *context, Lpc_Codes codes) {
+    Lpc_Bitcodes bitcodes;
+    lpc_u64 i;
+
+    bitcodes.count = codes.count;
+    bitcodes.code  = (lpc_bitcode *)LPC_CONTEXT_ALLOC(context, sizeof(lpc_bitcode) * codes.count);
+
+    if (bitcodes.code == NULL) {
+        bitcodes.count = 0;
+        return bitcodes;
+    }
+
+    for (i = 0; i < codes.count; i++) {
+        bitcodes.code[i] = lpc_convert_to_bitcode_internal(lpc_code_clamp(codes.code[i]));
+    }
+
+    return bitcodes;
+}
+
+LPC_API Lpc_Codes lpc_bitcodes_unpack(Lpc_Context *context, Lpc_Bitcodes bitcodes) {
+    Lpc_Codes codes;
+    lpc_u64 i;
+
+    codes.count = bitcodes.count;
+    codes.code  = (Lpc_Code *)LPC_CONTEXT_ALLOC(context, sizeof(Lpc_Code) * bitcodes.count);
+
+    if (codes.code == NULL) {
+        codes.count = 0;
+        return codes;
+    }
+
+    for (i = 0; i < bitcodes.count; i++) {
+        codes.code[i] = lpc_convert_from_bitcode_internal(bitcodes.code[i]);
+    }
+
+    return codes;
+}
+
 /*
 // Encoding
 */
 
-LPC_API Lpc_Sample_Buffer lpc_buffer_prepare_internal(Lpc_Sample_Buffer buffer) {
+/* mono buffer at LPC_SAMPLE_RATE for samples of buffer, it is filled by lpc_buffer_convert_internal */
+LPC_API Lpc_Sample_Buffer lpc_buffer_prepare_internal(Lpc_Context *context, Lpc_Sample_Buffer buffer) {
     Lpc_Sample_Buffer converted;
-    lpc_u64 i, j, k;
-    lpc_f32 sum;
 
     assert(buffer.samples != NULL);
     assert(buffer.channels <= 2);
@@ -612,11 +1261,19 @@ LPC_API Lpc_Sample_Buffer lpc_buffer_prepare_internal(Lpc_Sample_Buffer buffer)
     converted.sample_rate = LPC_SAMPLE_RATE;
     converted.channels    = 1;
     converted.frame_count = roundf((lpc_f32)buffer.frame_count / ((lpc_f32)buffer.sample_rate / (lpc_f32)LPC_SAMPLE_RATE));
-    converted.samples     = (lpc_f32*)LPC_ALLOC((sizeof(lpc_f32) * converted.frame_count));
+    converted.samples     = (lpc_f32*)LPC_CONTEXT_ALLOC(context, (sizeof(lpc_f32) * converted.frame_count));
 
     assert(converted.samples != NULL); /* @todo, proper recovery if no memory */
 
-    for (i = 0; i < converted.frame_count; i++) {
+    return converted;
+}
+
+/* samples from first to last of converted buffer, every one is taken from the nearest input frame */
+LPC_API void lpc_buffer_convert_internal(Lpc_Sample_Buffer buffer, Lpc_Sample_Buffer converted, lpc_u64 first, lpc_u64 last) {
+    lpc_u64 i, j, k;
+    lpc_f32 sum;
+
+    for (i = first; i < last; i++) {
         j = roundf((lpc_f32)i * ((lpc_f32)buffer.sample_rate / (lpc_f32)LPC_SAMPLE_RATE));
 
         if (j >= buffer.frame_count) {
@@ -645,21 +1302,19 @@ LPC_API Lpc_Sample_Buffer lpc_buffer_prepare_internal(Lpc_Sample_Buffer buffer)
             converted.samples[i] = sum / (lpc_f32)buffer.channels;
         }
     }
-
-    return converted;
 }
 
-LPC_API Lpc_Sample_Buffer lpc_buffer_copy_internal(Lpc_Sample_Buffer buffer) {
+/* buffer of the same format and size, samples are not set */
+LPC_API Lpc_Sample_Buffer lpc_buffer_alloc_internal(Lpc_Context *context, Lpc_Sample_Buffer buffer) {
     Lpc_Sample_Buffer new_buffer;
 
     assert(buffer.channels    == 1);
     assert(buffer.sample_rate == LPC_SAMPLE_RATE);
 
     new_buffer = buffer;
-    new_buffer.samples = (lpc_f32*)LPC_ALLOC((sizeof(lpc_f32) * buffer.frame_count));
+    new_buffer.samples = (lpc_f32*)LPC_CONTEXT_ALLOC(context, (sizeof(lpc_f32) * buffer.frame_count));
     
     assert(new_buffer.samples != NULL); /* @todo, proper recovery */
-    memcpy(new_buffer.samples, buffer.samples, sizeof(lpc_f32) * new_buffer.frame_count);
 
     return new_buffer;
 }
@@ -685,103 +1340,131 @@ LPC_API void lpc_buffer_normalize_internal(Lpc_Sample_Buffer buffer) {
     }
 }
 
-LPC_API void lpc_buffer_filter_internal(Lpc_Sample_Buffer buffer, lpc_f32 low_cut_freq, lpc_f32 high_cut_freq, lpc_f32 q_factor, lpc_b32 amplify) {
-    Lpc_Biquad_Filter filter;
+LPC_API void lpc_buffer_filter_internal(Lpc_Biquad_Filter *filter, lpc_f32 *samples, lpc_u64 count) {
     lpc_u64 i;
 
-    assert(buffer.channels    == 1);
-    assert(buffer.sample_rate == LPC_SAMPLE_RATE);
-
-    filter = biquad_bandpass_design(buffer.sample_rate, low_cut_freq, high_cut_freq, q_factor, amplify);
-
-    for (i = 0; i < buffer.frame_count; i++) {
-        buffer.samples[i] = biquad_process(&filter, buffer.samples[i]);
+    for (i = 0; i < count; i++) {
+        samples[i] = biquad_process(filter, samples[i]);
     }
 }
 
 /* 
 // Pre emphasis
+//
+// Done in two passes over parts of buffer. First one replaces samples and sums energy of
+// the buffer before and after, second one scales samples, so energy stays the same.
+// previous is sample before the part, as it was before the first pass.
 */
 
-LPC_API lpc_f32 lpc_buffer_energy_sqr_sum_internal(Lpc_Sample_Buffer buffer) {
+LPC_API void lpc_pre_emphasis_internal(lpc_f32 *samples, lpc_u64 count, lpc_b32 first_part, lpc_f32 alpha, lpc_f32 *previous, lpc_f32 *pre_energy, lpc_f32 *post_energy) {
     lpc_u64 i;
-    lpc_f32 energy = 0;
-
-    for (i = 0; i < buffer.frame_count; i++) {
-        energy += buffer.samples[i] * buffer.samples[i];
-    }
+    lpc_f32 sample;
 
-    return energy / (buffer.frame_count - 1);
-}
+    for (i = 0; i < count; i++) {
+        sample = samples[i];
+        *pre_energy += sample * sample;
 
-LPC_API void lpc_buffer_pre_emphasis(Lpc_Sample_Buffer buffer, lpc_f32 alpha) {
-    lpc_u64 i;
-    lpc_f32 pre_energy, post_energy, scale;
-    pre_energy = lpc_buffer_energy_sqr_sum_internal(buffer);
+        /* first sample of buffer is kept */
+        if (i > 0 || !first_part) {
+            samples[i] = 1 - *previous * alpha;
+        }
 
-    for (i = buffer.frame_count - 1; i > 0; i--) {
-        buffer.samples[i] = 1 - buffer.samples[i - 1] * alpha;
+        *post_energy += samples[i] * samples[i];
+        *previous     = sample;
     }
+}
 
-    post_energy = lpc_buffer_energy_sqr_sum_internal(buffer);
-    scale = sqrtf(pre_energy / post_energy);
+LPC_API lpc_f32 lpc_pre_emphasis_scale_internal(Lpc_Sample_Buffer buffer, lpc_f32 pre_energy, lpc_f32 post_energy) {
+    pre_energy  = pre_energy  / (buffer.frame_count - 1);
+    post_energy = post_energy / (buffer.frame_count - 1);
 
-    for (i = 0; i < buffer.frame_count; i++) {
-        buffer.samples[i] *= scale;
-    }
+    return sqrtf(pre_energy / post_energy);
 }
 
 /*
 // Segments
 */
 
-LPC_API Lpc_Segments lpc_get_segments_internal(Lpc_Sample_Buffer buffer, lpc_u32 segment_size, lpc_u32 num_segments) {
-    lpc_u64 i;
+LPC_API Lpc_Segments lpc_get_segments_internal(Lpc_Context *context, Lpc_Sample_Buffer buffer, lpc_u32 segment_size, lpc_u32 num_segments) {
+    lpc_u64 j;
     Lpc_Segments segments;
 
-    segments.count = num_segments;
-    segments.data  = (Lpc_Segment *)LPC_ALLOC(sizeof(Lpc_Segment) * num_segments);
+    assert(buffer.frame_count <= num_segments * segment_size);
+
+    memset(&segments, 0, sizeof(Lpc_Segments));
+    segments.count        = num_segments;
+    segments.segment_size = segment_size;
+    segments.sample_count = buffer.frame_count;
 
-    assert(segments.data != NULL); /* @todo, proper recovery from memory allocation errors */
-    assert(buffer.frame_count < num_segments * segment_size);
+    /* floats go first, so every array stays aligned */
+    segments.rms = (lpc_f32 *)LPC_CONTEXT_ALLOC(context, (sizeof(lpc_f32) * 11 + sizeof(lpc_u8) * 13) * num_segments);
+    assert(segments.rms != NULL); /* @todo, proper recovery from memory allocation errors */
 
-    for (i = 0; i < num_segments; i++) {
-        segments.data[i].count   = LPC_MIN(buffer.frame_count - i * segment_size, segment_size);
-        segments.data[i].buffer_offset = i * segment_size;
+    for (j = 0; j < 10; j++) {
+        segments.k[j] = segments.rms + (j + 1) * num_segments;
     }
 
+    segments.energy = (lpc_u8 *)(segments.rms + 11 * num_segments);
+    segments.pitch  = segments.energy + num_segments;
+
+    for (j = 0; j < 10; j++) {
+        segments.table_k[j] = segments.pitch + (j + 1) * num_segments;
+    }
+
+    segments.silent = segments.table_k[9] + num_segments;
+    memset(segments.silent, 0, sizeof(lpc_u8) * num_segments);
+
     return segments;
 }
 
-LPC_API void lpc_pitch_estimate_internal(Lpc_Sample_Buffer buffer, Lpc_Segments segments, lpc_u32 window_size, lpc_f32 low_freq, lpc_f32 high_freq) {
+LPC_API void lpc_segments_free_internal(Lpc_Context *context, Lpc_Segments *segments) {
+    if (segments->rms) {
+        LPC_CONTEXT_FREE(context, segments->rms);
+    }
+
+    memset(segments, 0, sizeof(Lpc_Segments));
+}
+
+LPC_API LPC_INLINE lpc_u32 lpc_segment_offset_internal(Lpc_Segments segments, lpc_u64 i) {
+    return (lpc_u32)(i * segments.segment_size);
+}
+
+LPC_API LPC_INLINE lpc_u32 lpc_segment_size_internal(Lpc_Segments segments, lpc_u64 i) {
+    return LPC_MIN(segments.sample_count - lpc_segment_offset_internal(segments, i), segments.segment_size);
+}
+
+/* pitch of segments from first to last, every segment is searched on it's own */
+LPC_API void lpc_pitch_estimate_internal(Lpc_Context *context, Lpc_Sample_Buffer buffer, Lpc_Segments segments, lpc_u32 first, lpc_u32 last, lpc_u32 window_size, lpc_f32 low_freq, lpc_f32 high_freq) {
     lpc_u64 i, j, k, offset, best_period_i, min_dist_i, segment_size, work_buffer_size;
     lpc_u32 min_period, max_period, best_period, period_count;
     lpc_f32 *work_buffer, *window, *periods, best_period_value;
     lpc_f32 min_dist, dist;
+    const lpc_u32 *pitch_table;
 
     assert(segments.count > 0);
 
+    pitch_table = context->tables->pitch;
+
     min_period  = buffer.sample_rate / high_freq;
     max_period  = buffer.sample_rate / low_freq;
     best_period = min_period;
     
     period_count = max_period - min_period;
-    periods      = (lpc_f32 *)LPC_ALLOC(sizeof(lpc_f32) * period_count);
-
-    assert(periods != NULL); /* @todo, proper recovery from memory allocation errors */
 
     /*
     // we assume that first segment is maximum size, @todo, test for that,
     // as it should be always like that, except the garbage data
     */
     
-    segment_size     = segments.data[0].count;
+    segment_size     = lpc_segment_size_internal(segments, 0);
     work_buffer_size = window_size * segment_size;
-    work_buffer      = (lpc_f32 *)LPC_ALLOC(sizeof(lpc_f32) * work_buffer_size);
-    window           = (lpc_f32 *)LPC_ALLOC(sizeof(lpc_f32) * work_buffer_size);
-    
-    assert(work_buffer != NULL); /* @todo, proper recovery from memory allocation errors */
-    assert(window      != NULL); /* @todo, proper recovery from memory allocation errors */
+
+    /* every buffer is filled before use, so they can live in scratch */
+    periods = (lpc_f32 *)lpc_scratch_internal(context, sizeof(lpc_f32) * (period_count + work_buffer_size * 2));
+    assert(periods != NULL); /* @todo, proper recovery from memory allocation errors */
+
+    work_buffer = periods + period_count;
+    window      = work_buffer + work_buffer_size;
 
     /*
     // @note apparently we need normalized coefficients in here, so we can get more accurate pitch correlation
@@ -793,16 +1476,21 @@ LPC_API void lpc_pitch_estimate_internal(Lpc_Sample_Buffer buffer, Lpc_Segments
         window[i] = 0.54f - 0.46f * cosf(LPC_TAU * ((lpc_f32)i / (lpc_f32)(work_buffer_size - 1)));
     }
 
-    for (i = 0; i < segments.count; i++) {
+    for (i = first; i < last; i++) {
+        if (segments.silent[i]) {
+            segments.pitch[i] = 0;
+            continue;
+        }
+
         offset = 0;
         memset(work_buffer, 0, sizeof(lpc_f32) * work_buffer_size);
-        memcpy(work_buffer, buffer.samples + segments.data[i].buffer_offset, sizeof(lpc_f32) * segments.data[i].count);
-        offset += segments.data[i].count;
+        memcpy(work_buffer, buffer.samples + lpc_segment_offset_internal(segments, i), sizeof(lpc_f32) * lpc_segment_size_internal(segments, i));
+        offset += lpc_segment_size_internal(segments, i);
 
         for (j = 1; j < window_size; j++) {
             if ((i + j) >= segments.count) break;
-            memcpy(work_buffer + offset, buffer.samples + segments.data[i + j].buffer_offset, sizeof(lpc_f32) * segments.data[i + j].count);
-            offset += segments.data[i + j].count;
+            memcpy(work_buffer + offset, buffer.samples + lpc_segment_offset_internal(segments, i + j), sizeof(lpc_f32) * lpc_segment_size_internal(segments, i + j));
+            offset += lpc_segment_size_internal(segments, i + j);
         }
 
         for (j = 0; j < work_buffer_size; j++) {
@@ -837,552 +1525,3319 @@ LPC_API void lpc_pitch_estimate_internal(Lpc_Sample_Buffer buffer, Lpc_Segments
         for (k = 0; k < LPC_PITCH_MASK; k++) {
             dist = fabsf((lpc_f32)pitch_table[k] - best_period);
 
-            if (min_dist > dist) {
-                min_dist = dist;
-                min_dist_i = k;
-            }
-        }
+            if (min_dist > dist) {
+                min_dist = dist;
+                min_dist_i = k;
+            }
+        }
+
+        segments.pitch[i] = min_dist_i;
+    }
+
+}
+
+/*
+// Tracking pitch search
+//
+// Pitch ends up as one of 64 pitch_table values anyway, so instead of testing every lag
+// we find rough lag on decimated signal (around previous pitch if it was confident),
+// then test only pitch_table lags near it and it's octaves with normalized correlation,
+// and then pick the smoothest path through candidates of all segments.
+*/
+
+#define LPC_PITCH_DECIMATION      4
+#define LPC_PITCH_TRACK_RANGE     0.3f  /* search range around previous pitch   */
+#define LPC_PITCH_TRACK_CONFIDENT 0.5f  /* score previous pitch needs to narrow */
+#define LPC_PITCH_JUMP_WEIGHT     0.5f  /* penalty for log of pitch change      */
+
+/* energies is prefix sum of squares of buffer, so normalization costs nothing */
+LPC_API lpc_f32 lpc_pitch_correlation_internal(lpc_f32 *buffer, lpc_f32 *energies, lpc_u64 buffer_size, lpc_u64 size, lpc_u64 lag) {
+    lpc_u64 k;
+    lpc_f32 sum = 0, energy_a, energy_b;
+
+    if ((size + lag) > buffer_size) {
+        size = buffer_size - lag;
+    }
+
+    for (k = 0; k < size; k++) {
+        sum += buffer[k] * buffer[k + lag];
+    }
+
+    energy_a = energies[size];
+    energy_b = energies[size + lag] - energies[lag];
+
+    if (energy_a <= 0 || energy_b <= 0) return 0;
+
+    return sum / sqrtf(energy_a * energy_b);
+}
+
+LPC_API void lpc_pitch_energies_internal(lpc_f32 *buffer, lpc_f32 *energies, lpc_u64 buffer_size) {
+    lpc_u64 k;
+
+    energies[0] = 0;
+
+    for (k = 0; k < buffer_size; k++) {
+        energies[k + 1] = energies[k] + buffer[k] * buffer[k];
+    }
+}
+
+LPC_API void lpc_pitch_candidate_add_internal(Lpc_Pitch_Candidates *candidates, lpc_u32 index, lpc_f32 score) {
+    lpc_u32 i, worst_i;
+
+    for (i = 0; i < candidates->count; i++) {
+        if (candidates->index[i] == index) return;
+    }
+
+    if (candidates->count < LPC_PITCH_CANDIDATES) {
+        candidates->index[candidates->count] = index;
+        candidates->score[candidates->count] = score;
+        candidates->count++;
+        return;
+    }
+
+    worst_i = 0;
+
+    for (i = 1; i < candidates->count; i++) {
+        if (candidates->score[i] < candidates->score[worst_i]) worst_i = i;
+    }
+
+    if (score > candidates->score[worst_i]) {
+        candidates->index[worst_i] = index;
+        candidates->score[worst_i] = score;
+    }
+}
+
+/* tests pitch_table entries that are in [low_lag, high_lag] */
+LPC_API void lpc_pitch_refine_internal(const lpc_u32 *pitch_table, Lpc_Pitch_Candidates *candidates, lpc_f32 *buffer, lpc_f32 *energies, lpc_u64 buffer_size, lpc_u64 size, lpc_f32 low_lag, lpc_f32 high_lag, lpc_u32 min_period, lpc_u32 max_period) {
+    lpc_u32 i;
+    lpc_f32 score;
+
+    for (i = 1; i <= LPC_PITCH_MASK; i++) {
+        if ((lpc_f32)pitch_table[i] < low_lag || (lpc_f32)pitch_table[i] > high_lag) continue;
+        if (pitch_table[i] < min_period || pitch_table[i] > max_period) continue;
+        if (pitch_table[i] >= buffer_size) continue;
+
+        score = lpc_pitch_correlation_internal(buffer, energies, buffer_size, size, pitch_table[i]);
+        lpc_pitch_candidate_add_internal(candidates, i, score);
+    }
+}
+
+/* candidates of segments from first to last, search of segment continues from candidates of the one before it */
+LPC_API void lpc_pitch_candidates_internal(Lpc_Context *context, Lpc_Sample_Buffer buffer, Lpc_Segments segments, Lpc_Pitch_Candidates *candidates, lpc_u32 first, lpc_u32 last, lpc_u32 window_size, lpc_f32 low_freq, lpc_f32 high_freq) {
+    lpc_u64 i, j, k, offset, segment_size, work_buffer_size, decimated_size, best_lag;
+    lpc_u32 min_period, max_period, low, high, previous;
+    lpc_f32 *work_buffer, *window, *decimated, *energies, *decimated_energies;
+    lpc_f32 best_value, value, lag;
+    Lpc_Pitch_Candidates *curr, *prev;
+    const lpc_u32 *pitch_table;
+
+    assert(segments.count > 0);
+
+    pitch_table = context->tables->pitch;
+
+    min_period = buffer.sample_rate / high_freq;
+    max_period = buffer.sample_rate / low_freq;
+
+    segment_size     = lpc_segment_size_internal(segments, 0);
+    work_buffer_size = window_size * segment_size;
+    decimated_size   = work_buffer_size / LPC_PITCH_DECIMATION;
+
+    /* one scratch block is split between buffers */
+    work_buffer = (lpc_f32 *)lpc_scratch_internal(context, sizeof(lpc_f32) * (work_buffer_size * 3 + 1 + decimated_size * 2 + 1));
+    assert(work_buffer != NULL); /* @todo, proper recovery from memory allocation errors */
+
+    window      = work_buffer + work_buffer_size;
+    energies    = window      + work_buffer_size;
+    decimated   = energies    + work_buffer_size + 1;
+    decimated_energies = decimated + decimated_size;
+
+    for (i = 0; i < work_buffer_size; i++) {
+        window[i] = 0.54f - 0.46f * cosf(LPC_TAU * ((lpc_f32)i / (lpc_f32)(work_buffer_size - 1)));
+    }
+
+    prev = first > 0 ? &candidates[first - 1] : NULL;
+
+    for (i = first; i < last; i++) {
+        curr = &candidates[i];
+        curr->count = 0;
+
+        /* silent segment keeps previous pitch, so it doesn't cost a jump, and isn't trusted for narrowing */
+        if (segments.silent[i]) {
+            curr->index[0] = prev != NULL ? prev->index[0] : 1;
+            curr->score[0] = 0;
+            curr->count    = 1;
+
+            prev = curr;
+            continue;
+        }
+
+        offset = 0;
+        memset(work_buffer, 0, sizeof(lpc_f32) * work_buffer_size);
+
+        for (j = 0; j < window_size; j++) {
+            if ((i + j) >= segments.count) break;
+            memcpy(work_buffer + offset, buffer.samples + lpc_segment_offset_internal(segments, i + j), sizeof(lpc_f32) * lpc_segment_size_internal(segments, i + j));
+            offset += lpc_segment_size_internal(segments, i + j);
+        }
+
+        for (j = 0; j < work_buffer_size; j++) {
+            work_buffer[j] *= window[j];
+        }
+
+        for (j = 0; j < decimated_size; j++) {
+            decimated[j] = 0;
+
+            for (k = 0; k < LPC_PITCH_DECIMATION; k++) {
+                decimated[j] += work_buffer[j * LPC_PITCH_DECIMATION + k];
+            }
+        }
+
+        lpc_pitch_energies_internal(work_buffer, energies, work_buffer_size);
+        lpc_pitch_energies_internal(decimated, decimated_energies, decimated_size);
+
+        /* coarse search, narrowed around previous pitch if we trust it */
+        low  = min_period / LPC_PITCH_DECIMATION;
+        high = max_period / LPC_PITCH_DECIMATION;
+
+        if (prev != NULL && prev->count > 0 && prev->score[0] > LPC_PITCH_TRACK_CONFIDENT) {
+            previous = pitch_table[prev->index[0]];
+
+            low  = LPC_MAX(low,  (lpc_u32)(previous * (1.0f - LPC_PITCH_TRACK_RANGE)) / LPC_PITCH_DECIMATION);
+            high = LPC_MIN(high, (lpc_u32)(previous * (1.0f + LPC_PITCH_TRACK_RANGE)) / LPC_PITCH_DECIMATION + 1);
+        }
+
+        if (low < 1) low = 1;
+        if (high >= decimated_size) high = decimated_size - 1;
+
+        best_lag   = low;
+        best_value = -FLT_MAX;
+
+        for (j = low; j <= high; j++) {
+            value = lpc_pitch_correlation_internal(decimated, decimated_energies, decimated_size, segment_size / LPC_PITCH_DECIMATION, j);
+
+            if (value > best_value) {
+                best_value = value;
+                best_lag   = j;
+            }
+        }
+
+        /* fine search on pitch_table lags around coarse lag, it's octaves and previous pitch */
+        lag = (lpc_f32)(best_lag * LPC_PITCH_DECIMATION);
+
+        lpc_pitch_refine_internal(pitch_table, curr, work_buffer, energies, work_buffer_size, segment_size, lag - LPC_PITCH_DECIMATION, lag + LPC_PITCH_DECIMATION, min_period, max_period);
+        lpc_pitch_refine_internal(pitch_table, curr, work_buffer, energies, work_buffer_size, segment_size, lag * 0.5f - 1, lag * 0.5f + 1, min_period, max_period);
+        lpc_pitch_refine_internal(pitch_table, curr, work_buffer, energies, work_buffer_size, segment_size, lag * 2.0f - 2, lag * 2.0f + 2, min_period, max_period);
+
+        if (prev != NULL && prev->count > 0) {
+            lag = (lpc_f32)pitch_table[prev->index[0]];
+            lpc_pitch_refine_internal(pitch_table, curr, work_buffer, energies, work_buffer_size, segment_size, lag - 1, lag + 1, min_period, max_period);
+        }
+
+        if (curr->count == 0) {
+            curr->index[0] = 1;
+            curr->score[0] = 0;
+            curr->count    = 1;
+        }
+
+        /* keep the best candidate first, it's used for narrowing search */
+        for (j = 1; j < curr->count; j++) {
+            if (curr->score[j] > curr->score[0]) {
+                value = curr->score[0]; curr->score[0] = curr->score[j]; curr->score[j] = value;
+                k     = curr->index[0]; curr->index[0] = curr->index[j]; curr->index[j] = (lpc_u32)k;
+            }
+        }
+
+        prev = curr;
+    }
+}
+
+/* smoothing, viterbi over candidates of all segments with penalty for pitch jumps */
+LPC_API void lpc_pitch_smooth_internal(Lpc_Context *context, Lpc_Segments segments, Lpc_Pitch_Candidates *candidates) {
+    lpc_u64 i, j, k;
+    lpc_f32 *costs, *prev_costs, *tmp, value, jump;
+    lpc_u8 *back;
+    Lpc_Pitch_Candidates *curr, *prev;
+    const lpc_u32 *pitch_table;
+
+    assert(segments.count > 0);
+
+    pitch_table = context->tables->pitch;
+
+    costs = (lpc_f32 *)lpc_scratch_internal(context, sizeof(lpc_f32) * LPC_PITCH_CANDIDATES * 2 + sizeof(lpc_u8) * segments.count * LPC_PITCH_CANDIDATES);
+    assert(costs != NULL); /* @todo, proper recovery from memory allocation errors */
+
+    prev_costs = costs + LPC_PITCH_CANDIDATES;
+    back       = (lpc_u8 *)(prev_costs + LPC_PITCH_CANDIDATES);
+
+    memset(back, 0, sizeof(lpc_u8) * segments.count * LPC_PITCH_CANDIDATES);
+
+    for (j = 0; j < candidates[0].count; j++) {
+        prev_costs[j] = -candidates[0].score[j];
+    }
+
+    for (i = 1; i < segments.count; i++) {
+        curr = &candidates[i];
+        prev = &candidates[i - 1];
+
+        for (j = 0; j < curr->count; j++) {
+            costs[j] = FLT_MAX;
+
+            for (k = 0; k < prev->count; k++) {
+                jump  = logf((lpc_f32)pitch_table[curr->index[j]] / (lpc_f32)pitch_table[prev->index[k]]);
+                value = prev_costs[k] + LPC_PITCH_JUMP_WEIGHT * fabsf(jump);
+
+                if (value < costs[j]) {
+                    costs[j] = value;
+                    back[i * LPC_PITCH_CANDIDATES + j] = (lpc_u8)k;
+                }
+            }
+
+            costs[j] -= curr->score[j];
+        }
+
+        tmp = prev_costs; prev_costs = costs; costs = tmp;
+    }
+
+    k = 0;
+
+    for (j = 1; j < candidates[segments.count - 1].count; j++) {
+        if (prev_costs[j] < prev_costs[k]) k = j;
+    }
+
+    for (i = segments.count; i > 0; i--) {
+        segments.pitch[i - 1] = candidates[i - 1].index[k];
+        k = back[(i - 1) * LPC_PITCH_CANDIDATES + k];
+    }
+}
+
+LPC_API const lpc_u64 lpc_bitcode_k_offsets[10] = {
+    LPC_K1_OFFSET, LPC_K2_OFFSET, LPC_K3_OFFSET, LPC_K4_OFFSET, LPC_K5_OFFSET,
+    LPC_K6_OFFSET, LPC_K7_OFFSET, LPC_K8_OFFSET, LPC_K9_OFFSET, LPC_K10_OFFSET
+};
+
+LPC_API const lpc_u64 lpc_bitcode_k_masks[10] = {
+    LPC_K1_K2_MASK,          LPC_K1_K2_MASK,
+    LPC_K3_K4_K5_K6_K7_MASK, LPC_K3_K4_K5_K6_K7_MASK, LPC_K3_K4_K5_K6_K7_MASK,
+    LPC_K3_K4_K5_K6_K7_MASK, LPC_K3_K4_K5_K6_K7_MASK,
+    LPC_K8_K9_K10_MASK,      LPC_K8_K9_K10_MASK,      LPC_K8_K9_K10_MASK
+};
+
+/* packs quantized segment straight into bitcode, fields that chip doesn't read stay zero, like in lpc_code_clamp */
+LPC_API lpc_bitcode lpc_segment_bitcode_internal(Lpc_Segments segments, lpc_u64 i, lpc_b32 repeat) {
+    lpc_bitcode code;
+    lpc_u64 j, count;
+
+    code = (segments.energy[i] & LPC_ENERGY_MASK) << LPC_ENERGY_OFFSET;
+
+    if (segments.energy[i] == LPC_ENERGY_ZERO || segments.energy[i] == LPC_ENERGY_STOP) {
+        return code;
+    }
+
+    code |= (segments.pitch[i] & LPC_PITCH_MASK) << LPC_PITCH_OFFSET;
+
+    if (repeat) {
+        return code | (LPC_REP_MASK << LPC_REP_OFFSET);
+    }
+
+    count = segments.pitch[i] ? 10 : 4;
+
+    for (j = 0; j < count; j++) {
+        code |= (segments.table_k[j][i] & lpc_bitcode_k_masks[j]) << lpc_bitcode_k_offsets[j];
+    }
+
+    return code;
+}
+
+/*
+// Repeat frame keeps K values of the last full frame and only updates energy and pitch,
+// so we can use it when Ks are close enough. Voicing should be the same, because unvoiced
+// frames don't have K5-K10.
+*/
+LPC_API lpc_b32 lpc_segment_can_repeat_internal(const Lpc_Tables *tables, Lpc_Segments segments, lpc_u64 reference, lpc_u64 i, lpc_f32 thresh) {
+    lpc_u64 j, count;
+    lpc_f32 dist;
+
+    if (segments.energy[reference] == LPC_ENERGY_ZERO || segments.energy[reference] == LPC_ENERGY_STOP) return false;
+    if (segments.energy[i]         == LPC_ENERGY_ZERO || segments.energy[i]         == LPC_ENERGY_STOP) return false;
+
+    if ((segments.pitch[reference] == 0) != (segments.pitch[i] == 0)) return false;
+
+    count = segments.pitch[i] ? 10 : 4;
+
+    for (j = 0; j < count; j++) {
+        dist = fabsf(tables->k[j][segments.table_k[j][i]] - tables->k[j][segments.table_k[j][reference]]);
+
+        if (dist > thresh) return false;
+    }
+
+    return true;
+}
+
+/* codes of segments from first to last, reference is the last full frame and is carried to the next call */
+LPC_API void lpc_codes_from_segments_internal(const Lpc_Tables *tables, Lpc_Segments segments, Lpc_Bitcodes codes, lpc_f32 repeat_thresh, lpc_u32 first, lpc_u32 last, lpc_b32 *has_reference, lpc_u32 *reference) {
+    lpc_u32 i;
+    lpc_b32 repeat;
+
+    for (i = first; i < last; i++) {
+        repeat = repeat_thresh >= 0 && *has_reference && lpc_segment_can_repeat_internal(tables, segments, *reference, i, repeat_thresh);
+
+        if (!repeat && segments.energy[i] != LPC_ENERGY_ZERO) {
+            *has_reference = true;
+            *reference     = i;
+        }
+
+        codes.code[i] = lpc_segment_bitcode_internal(segments, i, repeat);
+    }
+}
+
+
+/*
+// Trellis quantization
+//
+// Every frame can be coded as full frame (one of few candidate K sets), repeat of the last
+// full frame, unvoiced frame or zero energy frame. Repeat is what ties frames together, so state
+// of the trellis is the last full frame (frame and candidate), and we run viterbi search
+// with cost = distortion + lambda * bits, keeping only LPC_TRELLIS_BEAM best states per frame.
+*/
+
+#define LPC_TRELLIS_FULL   0
+#define LPC_TRELLIS_REPEAT 1
+#define LPC_TRELLIS_ZERO   2
+
+#define LPC_VOICED_BITS   50
+#define LPC_UNVOICED_BITS 29
+#define LPC_REPEAT_BITS   11
+#define LPC_SILENT_BITS   4
+
+#define LPC_TRELLIS_ENERGY_WEIGHT  0.05f
+#define LPC_TRELLIS_VOICING_WEIGHT 0.5f
+
+LPC_API const lpc_f32 lpc_trellis_k_weights[10] = {
+    4.0f, 3.0f, 2.0f, 2.0f, 1.0f, 1.0f, 1.0f, 0.5f, 0.5f, 0.5f
+};
+
+LPC_API lpc_u32 lpc_quantize_internal(const lpc_f32 *table, lpc_u32 count, lpc_f32 value) {
+    lpc_u32 i, min_dist_i = 0;
+    lpc_f32 dist, min_dist;
+
+    min_dist = fabsf(table[0] - value);
+
+    for (i = 1; i < count; i++) {
+        dist = fabsf(table[i] - value);
+
+        if (dist < min_dist) {
+            min_dist = dist;
+            min_dist_i = i;
+        }
+    }
+
+    return min_dist_i;
+}
+
+LPC_API void lpc_trellis_add_candidate_internal(const Lpc_Tables *tables, Lpc_Trellis_Candidates *candidates, lpc_f32 *k) {
+    lpc_u32 i, j;
+    lpc_u8 quantized[10];
+
+    for (j = 0; j < 10; j++) {
+        quantized[j] = (lpc_u8)lpc_quantize_internal(tables->k[j], tables->k_sizes[j], k[j]);
+    }
+
+    for (i = 0; i < candidates->count; i++) {
+        if (memcmp(candidates->k[i], quantized, sizeof(quantized)) == 0) return;
+    }
+
+    if (candidates->count >= LPC_TRELLIS_CANDIDATES) return;
+
+    for (j = 0; j < 10; j++) {
+        candidates->k[candidates->count][j]     = quantized[j];
+        candidates->value[candidates->count][j] = tables->k[j][quantized[j]];
+    }
+
+    candidates->count++;
+}
+
+/* unvoiced frames don't have K5-K10, decoder sets them to zero */
+LPC_API lpc_f32 lpc_trellis_k_distortion_internal(lpc_f32 *target, lpc_f32 *value, lpc_b32 voiced) {
+    lpc_u32 j;
+    lpc_f32 diff, sum = 0;
+
+    for (j = 0; j < 10; j++) {
+        diff = target[j] - ((voiced || j < 4) ? value[j] : 0.0f);
+        sum += lpc_trellis_k_weights[j] * diff * diff;
+    }
+
+    return sum;
+}
+
+LPC_API lpc_f32 lpc_trellis_energy_distortion_internal(lpc_f32 rms, lpc_f32 quantized) {
+    lpc_f32 diff;
+
+    diff = logf(1.0f + rms) - logf(1.0f + quantized);
+    return LPC_TRELLIS_ENERGY_WEIGHT * diff * diff;
+}
+
+LPC_API void lpc_trellis_push_internal(Lpc_Trellis_Node *nodes, lpc_u32 *count, Lpc_Trellis_Node node) {
+    lpc_u32 i, worst_i;
+
+    /* same reference means same future, keep only cheaper one */
+    for (i = 0; i < *count; i++) {
+        if (nodes[i].has_reference       != node.has_reference)       continue;
+        if (nodes[i].reference_frame     != node.reference_frame)     continue;
+        if (nodes[i].reference_candidate != node.reference_candidate) continue;
+        if (nodes[i].reference_voiced    != node.reference_voiced)    continue;
+
+        if (node.cost < nodes[i].cost) nodes[i] = node;
+        return;
+    }
+
+    if (*count < LPC_TRELLIS_BEAM) {
+        nodes[(*count)++] = node;
+        return;
+    }
+
+    worst_i = 0;
+
+    for (i = 1; i < *count; i++) {
+        if (nodes[i].cost > nodes[worst_i].cost) worst_i = i;
+    }
+
+    if (node.cost < nodes[worst_i].cost) {
+        nodes[worst_i] = node;
+    }
+}
+
+LPC_API lpc_b32 lpc_trellis_init_internal(Lpc_Context *context, Lpc_Trellis *trellis, lpc_u32 count) {
+    memset(trellis, 0, sizeof(Lpc_Trellis));
+
+    trellis->candidates  = (Lpc_Trellis_Candidates *)LPC_CONTEXT_ALLOC(context, sizeof(Lpc_Trellis_Candidates) * count);
+    trellis->nodes       = (Lpc_Trellis_Node *)LPC_CONTEXT_ALLOC(context, sizeof(Lpc_Trellis_Node) * count * LPC_TRELLIS_BEAM);
+    trellis->node_counts = (lpc_u32 *)LPC_CONTEXT_ALLOC(context, sizeof(lpc_u32) * count);
+
+    return trellis->candidates != NULL && trellis->nodes != NULL && trellis->node_counts != NULL;
+}
+
+LPC_API void lpc_trellis_free_internal(Lpc_Context *context, Lpc_Trellis *trellis) {
+    if (trellis->candidates)  LPC_CONTEXT_FREE(context, trellis->candidates);
+    if (trellis->nodes)       LPC_CONTEXT_FREE(context, trellis->nodes);
+    if (trellis->node_counts) LPC_CONTEXT_FREE(context, trellis->node_counts);
+
+    memset(trellis, 0, sizeof(Lpc_Trellis));
+}
+
+/* adds frames from first to last, nodes of earlier frames should be already there.
+ * When last frame is added, back is set to the cheapest node of it. */
+LPC_API void lpc_trellis_forward_internal(const Lpc_Tables *tables, Lpc_Trellis *trellis, Lpc_Segments segments, lpc_f32 lambda, lpc_u32 first, lpc_u32 last) {
+    Lpc_Trellis_Candidates *candidates;
+    Lpc_Trellis_Node *prev_nodes, *curr_nodes, node, start, *from;
+    lpc_u32 *node_counts, prev_count, i, j, c, v, n, best_i;
+    lpc_f32 mean[10], target[10], rms, energy_cost, k_cost, *reference;
+    lpc_u8 energy;
+    lpc_b32 voiced;
+
+    candidates  = trellis->candidates;
+    node_counts = trellis->node_counts;
+
+    /* candidate cache: nearest Ks, and Ks pulled towards next frames, so they can be repeated */
+    for (i = first; i < last; i++) {
+        for (j = 0; j < 10; j++) {
+            target[j] = segments.k[j][i];
+        }
+
+        candidates[i].count = 0;
+        lpc_trellis_add_candidate_internal(tables, &candidates[i], target);
+
+        for (n = 1; n < LPC_TRELLIS_CANDIDATES; n++) {
+            if ((i + n) >= segments.count) break;
+
+            for (j = 0; j < 10; j++) {
+                mean[j] = 0;
+
+                for (c = 0; c <= n; c++) {
+                    mean[j] += segments.k[j][i + c];
+                }
+
+                mean[j] /= (lpc_f32)(n + 1);
+            }
+
+            lpc_trellis_add_candidate_internal(tables, &candidates[i], mean);
+        }
+    }
+
+    memset(&start, 0, sizeof(Lpc_Trellis_Node));
+
+    if (first == 0) {
+        prev_nodes = &start;
+        prev_count = 1;
+    } else {
+        prev_nodes = trellis->nodes + (first - 1) * LPC_TRELLIS_BEAM;
+        prev_count = node_counts[first - 1];
+    }
+
+    for (i = first; i < last; i++) {
+        curr_nodes = trellis->nodes + i * LPC_TRELLIS_BEAM;
+        node_counts[i] = 0;
+
+        energy = segments.energy[i];
+        rms    = segments.rms[i];
+        voiced = segments.pitch[i] != 0;
+
+        for (j = 0; j < 10; j++) {
+            target[j] = segments.k[j][i];
+        }
+
+        if (energy == LPC_ENERGY_ZERO) {
+            energy_cost = 0;
+        } else {
+            energy_cost = lpc_trellis_energy_distortion_internal(rms, tables->energy[energy]);
+        }
+
+        /* best incoming path, full frames don't care about reference */
+        best_i = 0;
+
+        for (n = 1; n < prev_count; n++) {
+            if (prev_nodes[n].cost < prev_nodes[best_i].cost) best_i = n;
+        }
+
+        for (n = 0; n < prev_count; n++) {
+            from = &prev_nodes[n];
+
+            /* zero energy */
+            node = *from;
+            node.back   = n;
+            node.choice = LPC_TRELLIS_ZERO;
+            node.cost  += lpc_trellis_energy_distortion_internal(rms, 0) + lambda * LPC_SILENT_BITS;
+            lpc_trellis_push_internal(curr_nodes, &node_counts[i], node);
+
+            if (energy == LPC_ENERGY_ZERO) continue;
+
+            /* repeat, voicing of the frame should be the same as reference */
+            if (from->has_reference && from->reference_voiced == voiced) {
+                reference = candidates[from->reference_frame].value[from->reference_candidate];
+                k_cost    = lpc_trellis_k_distortion_internal(target, reference, voiced);
+
+                node = *from;
+                node.back   = n;
+                node.choice = LPC_TRELLIS_REPEAT;
+                node.voiced = from->reference_voiced;
+                node.cost  += k_cost + energy_cost + lambda * LPC_REPEAT_BITS;
+                lpc_trellis_push_internal(curr_nodes, &node_counts[i], node);
+            }
+
+            if (n != best_i) continue;
+
+            /* full frames, voiced frame can be also sent as unvoiced */
+            for (c = 0; c < candidates[i].count; c++) {
+                for (v = 0; v <= (lpc_u32)voiced; v++) {
+                    k_cost = lpc_trellis_k_distortion_internal(target, candidates[i].value[c], v);
+
+                    if (v != (lpc_u32)voiced) {
+                        k_cost += LPC_TRELLIS_VOICING_WEIGHT;
+                    }
+
+                    node.cost   = from->cost + k_cost + energy_cost + lambda * (v ? LPC_VOICED_BITS : LPC_UNVOICED_BITS);
+                    node.back   = n;
+                    node.choice = LPC_TRELLIS_FULL;
+                    node.voiced = v;
+
+                    node.has_reference       = true;
+                    node.reference_frame     = i;
+                    node.reference_candidate = c;
+                    node.reference_voiced    = v;
+
+                    lpc_trellis_push_internal(curr_nodes, &node_counts[i], node);
+                }
+            }
+        }
+
+        prev_nodes = curr_nodes;
+        prev_count = node_counts[i];
+    }
+
+    if (last < segments.count || last == first) return;
+
+    /* trace back starts from the cheapest path */
+    best_i = 0;
+
+    for (n = 1; n < prev_count; n++) {
+        if (prev_nodes[n].cost < prev_nodes[best_i].cost) best_i = n;
+    }
+
+    trellis->back = best_i;
+}
+
+/* codes of frames from last - 1 down to first, frames after last should be already traced */
+LPC_API void lpc_trellis_trace_internal(Lpc_Trellis *trellis, Lpc_Segments segments, Lpc_Bitcodes codes, lpc_u32 first, lpc_u32 last) {
+    Lpc_Trellis_Node *from;
+    Lpc_Code code;
+    lpc_u32 i, j;
+
+    for (i = last; i > first; i--) {
+        from = &trellis->nodes[(i - 1) * LPC_TRELLIS_BEAM + trellis->back];
+
+        memset(&code, 0, sizeof(Lpc_Code));
+
+        if (from->choice != LPC_TRELLIS_ZERO) {
+            code.energy = (lpc_u4)segments.energy[i - 1];
+            code.pitch  = from->voiced ? (lpc_u6)segments.pitch[i - 1] : 0;
+            code.repeat = from->choice == LPC_TRELLIS_REPEAT;
+
+            if (!code.repeat) {
+                for (j = 0; j < 10; j++) {
+                    code.k[j] = trellis->candidates[from->reference_frame].k[from->reference_candidate][j];
+                }
+            }
+        }
+
+        codes.code[i - 1] = lpc_convert_to_bitcode_internal(lpc_code_clamp(code));
+        trellis->back = from->back;
+    }
+}
+
+#ifndef LPC_LANES
+#define LPC_LANES 8
+#endif
+
+/* Leroux Guegen algorithm for finding K, for LPC_LANES segments at once. Segments are in lanes
+ * of coeff (autocorrelation, coeff[lag][lane]), loop bounds don't depend on data, so every step
+ * is done for all lanes in lock step and the innermost lane loops are vectorized by compiler.
+ * error is prediction error of the 10th order (d_params[11] of single segment version). */
+LPC_API void lpc_leroux_gueguen_internal(lpc_f32 coeff[11][LPC_LANES], lpc_f32 k_params[11][LPC_LANES], lpc_f32 error[LPC_LANES]) {
+    lpc_f32 y[LPC_LANES], b_params[11][LPC_LANES], d_params[12][LPC_LANES];
+    lpc_u32 i, j, lane;
+
+    memset(k_params, 0, sizeof(lpc_f32) * 11 * LPC_LANES);
+    memset(b_params, 0, sizeof(b_params));
+    memset(d_params, 0, sizeof(d_params));
+
+    for (lane = 0; lane < LPC_LANES; lane++) {
+        k_params[1][lane] = -coeff[1][lane] / coeff[0][lane];
+        d_params[1][lane] =  coeff[1][lane];
+        d_params[2][lane] =  coeff[0][lane] + (k_params[1][lane] * coeff[1][lane]);
+    }
+
+    for (i = 2; i < 11; i++) {
+        for (lane = 0; lane < LPC_LANES; lane++) {
+            y[lane]           = coeff[i][lane];
+            b_params[1][lane] = y[lane];
+        }
+
+        for (j = 1; j < i; j++) {
+            for (lane = 0; lane < LPC_LANES; lane++) {
+                b_params[j + 1][lane] = d_params[j][lane] + (k_params[j][lane] * y[lane]);
+                y[lane]              += k_params[j][lane] * d_params[j][lane];
+                d_params[j][lane]     = b_params[j][lane];
+            }
+        }
+
+        for (lane = 0; lane < LPC_LANES; lane++) {
+            k_params[i][lane]     = -y[lane] / d_params[i][lane];
+            d_params[i + 1][lane] = d_params[i][lane] + (k_params[i][lane] * y[lane]);
+            d_params[i][lane]     = b_params[i][lane];
+        }
+    }
+
+    for (lane = 0; lane < LPC_LANES; lane++) {
+        error[lane] = d_params[11][lane];
+    }
+}
+
+/* mean square of count values, LPC_LANES partial sums so loop is vectorized without fast math */
+LPC_API lpc_f32 lpc_mean_square_internal(const lpc_f32 *samples, lpc_u64 count) {
+    lpc_f32 sums[LPC_LANES], sum;
+    lpc_u64 i, lane, body;
+
+    memset(sums, 0, sizeof(sums));
+
+    body = count - count % LPC_LANES;
+
+    for (i = 0; i < body; i += LPC_LANES) {
+        for (lane = 0; lane < LPC_LANES; lane++) {
+            sums[lane] += samples[i + lane] * samples[i + lane];
+        }
+    }
+
+    sum = 0;
+
+    for (lane = 0; lane < LPC_LANES; lane++) {
+        sum += sums[lane];
+    }
+
+    for (i = body; i < count; i++) {
+        sum += samples[i] * samples[i];
+    }
+
+    return count > 0 ? sum / (lpc_f32)count : 0;
+}
+
+/* levels of segments from first to last of untrimmed buffer, first_loud is the first loud
+ * segment (segment count until one is found) and last_loud is one after the last loud one */
+LPC_API void lpc_buffer_loud_range_internal(Lpc_Sample_Buffer buffer, lpc_u32 segment_size, lpc_f32 thresh, lpc_u32 first, lpc_u32 last, lpc_u32 *first_loud, lpc_u32 *last_loud) {
+    lpc_u64 i, size;
+    lpc_f32 limit;
+
+    assert(buffer.channels == 1);
+
+    limit = thresh * thresh;
+
+    for (i = first; i < last; i++) {
+        size = LPC_MIN(buffer.frame_count - i * segment_size, segment_size);
+        if (lpc_mean_square_internal(buffer.samples + i * segment_size, size) < limit) continue;
+
+        if (*first_loud > i) *first_loud = (lpc_u32)i;
+        *last_loud = (lpc_u32)i + 1;
+    }
+}
+
+/* segments that are silent at both ends are cut off by moving samples pointer, one
+ * segment is kept even if everything is silent. lead_in is count of samples cut from the start. */
+LPC_API Lpc_Sample_Buffer lpc_buffer_trim_silence_internal(Lpc_Sample_Buffer buffer, lpc_u32 segment_size, lpc_u32 first_loud, lpc_u32 last_loud, lpc_u32 *lead_in) {
+    lpc_u64 count, size;
+
+    *lead_in = 0;
+
+    count = (buffer.frame_count + segment_size - 1) / segment_size;
+
+    if (first_loud >= count) {
+        buffer.frame_count = LPC_MIN(buffer.frame_count, segment_size);
+        return buffer;
+    }
+
+    size  = LPC_MIN((lpc_u64)last_loud * segment_size, buffer.frame_count);
+    size -= (lpc_u64)first_loud * segment_size;
+
+    buffer.samples    += (lpc_u64)first_loud * segment_size;
+    buffer.frame_count = (lpc_u32)size;
+    *lead_in           = first_loud * segment_size;
+
+    return buffer;
+}
+
+/* measured before filters, so threshold is level of the input */
+LPC_API void lpc_segments_mark_silent_internal(Lpc_Segments segments, Lpc_Sample_Buffer buffer, lpc_f32 thresh, lpc_u32 first, lpc_u32 last) {
+    lpc_u64 i;
+    lpc_f32 limit;
+
+    limit = thresh * thresh;
+
+    for (i = first; i < last; i++) {
+        segments.silent[i] = lpc_mean_square_internal(buffer.samples + lpc_segment_offset_internal(segments, i), lpc_segment_size_internal(segments, i)) < limit;
+    }
+}
+
+/* reflection coeffs, energy and quantized Ks of segments from first to last, first is multiple of LPC_LANES */
+LPC_API void lpc_analysis_internal(Lpc_Context *context, Lpc_Sample_Buffer buffer, Lpc_Segments segments, Lpc_Encoder_Settings settings, lpc_u32 first, lpc_u32 last) {
+    lpc_u64 size, offset, i, j, k, l;
+    lpc_f32 sum, coeff[11][LPC_LANES], k_params[11][LPC_LANES], error[LPC_LANES];
+    lpc_u32 lane, lanes, segment_size;
+    const Lpc_Tables *tables;
+
+    tables       = context->tables;
+    segment_size = segments.segment_size;
+
+    for (i = first; i < last; i += LPC_LANES) {
+        lanes = last - i < LPC_LANES ? (lpc_u32)(last - i) : LPC_LANES;
+        memset(coeff, 0, sizeof(coeff));
+
+        /* so we need to get the LPC coefficients, and this loop basically does it */
+        for (lane = 0; lane < lanes; lane++) {
+            offset = (i + lane) * segment_size;
+
+            /* gives K of 0 and no NaNs, frame is zero energy anyway */
+            if (segments.silent[i + lane]) {
+                coeff[0][lane] = 1.0f;
+                continue;
+            }
+
+            for (j = 0; j < 11; j++) {
+                size = segment_size - j;
+                sum = 0;
+
+                /* last segment is cut by the end of buffer */
+                if (offset + j + size > buffer.frame_count) {
+                    size = buffer.frame_count > offset + j ? buffer.frame_count - offset - j : 0;
+                }
+
+                for (k = 0; k < size; k++) {
+                    sum += buffer.samples[offset + k] * buffer.samples[offset + k + j];
+                }
+
+                coeff[j][lane] = sum;
+            }
+        }
+
+        /* here we convert the lpc coefficients to K reflection coeffs */
+        lpc_leroux_gueguen_internal(coeff, k_params, error);
+
+        for (lane = 0; lane < lanes; lane++) {
+            l = i + lane;
+
+            if (k_params[1][lane] > settings.unvoiced_thresh || segments.silent[l]) {
+                segments.pitch[l] = 0;
+            }
+
+            if (segments.silent[l]) {
+                segments.energy[l] = LPC_ENERGY_ZERO;
+                segments.rms[l]    = 0;
+            } else { /* setting RMS of signal */
+                lpc_f32 rms;
+
+                rms = sqrtf(error[lane] / segment_size) * (1 << 18);
+
+                if (segments.pitch[l] == 0) {
+                    rms *= settings.unvoiced_rms_multiply;
+                }
+
+                /* last entry is stop frame, it is not an energy */
+                segments.energy[l] = (lpc_u8)lpc_quantize_internal(tables->energy, LPC_ENERGY_MASK, rms);
+                segments.rms[l]    = rms >= 0 ? rms : 0; /* NaN for silent frames */
+            }
+
+            for (j = 0; j < 10; j++) {
+                /* silent frames give 0/0, reflection coeffs outside of (-1, 1) are garbage anyway */
+                if (k_params[j + 1][lane] >= -1.0f && k_params[j + 1][lane] <= 1.0f) {
+                    segments.k[j][l] = k_params[j + 1][lane];
+                } else {
+                    segments.k[j][l] = 0;
+                }
+            }
+
+            /* and then we set the Ks to segments */
+            for (j = 0; j < 10; j++) {
+                segments.table_k[j][l] = (lpc_u8)lpc_quantize_internal(tables->k[j], tables->k_sizes[j], k_params[j + 1][lane]);
+            }
+        }
+    }
+}
+
+/*
+// Incremental encoding
+*/
+
+LPC_API void lpc_encode_begin(Lpc_Context *context, Lpc_Encoder *encoder, Lpc_Sample_Buffer buffer, Lpc_Encoder_Settings settings) {
+    lpc_u32 segment_size;
+
+    assert(context != NULL);
+    assert(encoder != NULL);
+    assert(buffer.sample_rate >= LPC_SAMPLE_RATE);
+
+    memset(encoder, 0, sizeof(Lpc_Encoder));
+
+    segment_size = LPC_SAMPLE_RATE / 1000 * LPC_FRAME_SIZE_MS;
+
+    encoder->settings = settings;
+    encoder->input    = buffer;
+    encoder->stage    = LPC_ENCODE_STAGE_PREPARE;
+
+    /* only allocated here, samples are converted by prepare stage */
+    encoder->buffer  = lpc_buffer_prepare_internal(context, buffer);
+    encoder->samples = encoder->buffer.samples;
+
+    encoder->loud_first = (encoder->buffer.frame_count + segment_size - 1) / segment_size;
+    encoder->loud_last  = 0;
+}
+
+LPC_API LPC_INLINE lpc_u32 lpc_encode_last_internal(lpc_u32 cursor, lpc_u32 count, lpc_u32 max_segments) {
+    return max_segments > 0 && count - cursor > max_segments ? cursor + max_segments : count;
+}
+
+/* end of prepare stage, whole buffer is converted here */
+LPC_API void lpc_encode_prepare_internal(Lpc_Context *context, Lpc_Encoder *encoder) {
+    Lpc_Encoder_Settings settings;
+    lpc_u32 segment_size, num_segments;
+
+    settings     = encoder->settings;
+    segment_size = LPC_SAMPLE_RATE / 1000 * LPC_FRAME_SIZE_MS;
+
+    if (settings.silence_thresh > 0) {
+        encoder->buffer = lpc_buffer_trim_silence_internal(encoder->buffer, segment_size, encoder->loud_first, encoder->loud_last, &encoder->lead_in);
+    }
+
+    encoder->pitch_buffer = lpc_buffer_alloc_internal(context, encoder->buffer);
+
+    num_segments = ceilf((lpc_f32)encoder->buffer.frame_count / (lpc_f32)segment_size);
+
+    encoder->segments = lpc_get_segments_internal(context, encoder->buffer, segment_size, num_segments);
+
+    /* candidates live between steps, so they can't be in scratch */
+    if (settings.pitch_search == LPC_PITCH_SEARCH_TRACKING) {
+        encoder->candidates = (Lpc_Pitch_Candidates *)LPC_CONTEXT_ALLOC(context, sizeof(Lpc_Pitch_Candidates) * num_segments);
+        assert(encoder->candidates != NULL); /* @todo, proper recovery from memory allocation errors */
+    }
+
+    /* filters keep their state between parts of buffer */
+    encoder->filter       = biquad_bandpass_design(LPC_SAMPLE_RATE, settings.processing_low_cut, settings.processing_high_cut, settings.processing_q_factor, true);
+    encoder->pitch_filter = biquad_bandpass_design(LPC_SAMPLE_RATE, settings.pitch_low_cut, settings.pitch_high_cut, settings.pitch_q_factor, false);
+}
+
+/* end of analysis stage, without memory encoder is done and gives no codes */
+LPC_API void lpc_encode_codes_begin_internal(Lpc_Context *context, Lpc_Encoder *encoder) {
+    Lpc_Bitcodes *codes;
+
+    codes = &encoder->codes;
+
+    encoder->stage  = LPC_ENCODE_STAGE_CODES;
+    encoder->cursor = 0;
+
+    codes->count = encoder->segments.count + 1;
+    codes->code  = (lpc_bitcode *)LPC_CONTEXT_ALLOC(context, sizeof(lpc_bitcode) * codes->count);
+
+    if (codes->code != NULL) {
+        codes->code[codes->count - 1] = (lpc_bitcode)LPC_ENERGY_STOP << LPC_ENERGY_OFFSET;
+
+        if (encoder->settings.rd_lambda <= 0) return;
+        if (lpc_trellis_init_internal(context, &encoder->trellis, encoder->segments.count)) return;
+    }
+
+    lpc_bitcodes_free(context, codes);
+    lpc_trellis_free_internal(context, &encoder->trellis);
+
+    encoder->stage = LPC_ENCODE_STAGE_DONE;
+}
+
+LPC_API lpc_b32 lpc_encode_step(Lpc_Context *context, Lpc_Encoder *encoder, lpc_u32 max_segments) {
+    Lpc_Encoder_Settings settings;
+    Lpc_Sample_Buffer buffer;
+    lpc_u32 segment_size, first, last, count;
+    lpc_u64 offset, size, i;
+    lpc_f32 scale;
+
+    assert(context != NULL);
+    assert(encoder != NULL);
+
+    settings     = encoder->settings;
+    buffer       = encoder->buffer;
+    count        = encoder->segments.count;
+    segment_size = LPC_SAMPLE_RATE / 1000 * LPC_FRAME_SIZE_MS;
+
+    switch (encoder->stage) {
+        case LPC_ENCODE_STAGE_PREPARE:
+        {
+            LPC_TRACE_BEGIN("lpc_encode: prepare");
+
+            /* segments of untrimmed buffer */
+            count = (buffer.frame_count + segment_size - 1) / segment_size;
+            last  = lpc_encode_last_internal(encoder->cursor, count, max_segments);
+
+            offset = (lpc_u64)encoder->cursor * segment_size;
+            size   = LPC_MIN((lpc_u64)last * segment_size, buffer.frame_count);
+
+            lpc_buffer_convert_internal(encoder->input, buffer, offset, size);
+
+            if (settings.silence_thresh > 0) {
+                lpc_buffer_loud_range_internal(buffer, segment_size, settings.silence_thresh, encoder->cursor, last, &encoder->loud_first, &encoder->loud_last);
+            }
+
+            encoder->cursor = last;
+
+            if (last == count) {
+                lpc_encode_prepare_internal(context, encoder);
+
+                encoder->stage  = LPC_ENCODE_STAGE_EMPHASIS;
+                encoder->cursor = 0;
+            }
+
+            LPC_TRACE_END();
+        } break;
+
+        case LPC_ENCODE_STAGE_EMPHASIS:
+        case LPC_ENCODE_STAGE_FILTER:
+        {
+            LPC_TRACE_BEGIN("lpc_encode: filter");
+
+            last = lpc_encode_last_internal(encoder->cursor, count, max_segments);
+
+            offset = lpc_segment_offset_internal(encoder->segments, encoder->cursor);
+            size   = LPC_MIN((lpc_u64)last * segment_size, buffer.frame_count);
+            size  -= offset;
+
+            if (encoder->stage == LPC_ENCODE_STAGE_EMPHASIS) {
+                memcpy(encoder->pitch_buffer.samples + offset, buffer.samples + offset, sizeof(lpc_f32) * size);
+
+                if (settings.silence_thresh > 0) {
+                    lpc_segments_mark_silent_internal(encoder->segments, buffer, settings.silence_thresh, encoder->cursor, last);
+                }
+
+                lpc_buffer_filter_internal(&encoder->pitch_filter, encoder->pitch_buffer.samples + offset, size);
+
+                if (settings.do_pre_emphasis) {
+                    lpc_pre_emphasis_internal(buffer.samples + offset, size, encoder->cursor == 0, settings.pre_emphasis_alpha, &encoder->previous, &encoder->pre_energy, &encoder->post_energy);
+                }
+            } else {
+                if (settings.do_pre_emphasis) {
+                    scale = lpc_pre_emphasis_scale_internal(buffer, encoder->pre_energy, encoder->post_energy);
+
+                    for (i = offset; i < offset + size; i++) {
+                        buffer.samples[i] *= scale;
+                    }
+                }
+
+                lpc_buffer_filter_internal(&encoder->filter, buffer.samples + offset, size);
+            }
+
+            encoder->cursor = last;
+
+            if (last == count) {
+                encoder->stage  = encoder->stage == LPC_ENCODE_STAGE_EMPHASIS ? LPC_ENCODE_STAGE_FILTER : LPC_ENCODE_STAGE_PITCH;
+                encoder->cursor = 0;
+            }
+
+            LPC_TRACE_END();
+        } break;
+
+        case LPC_ENCODE_STAGE_PITCH:
+        {
+            LPC_TRACE_BEGIN("lpc_encode: pitch");
+
+            last = lpc_encode_last_internal(encoder->cursor, count, max_segments);
+
+            if (settings.pitch_search == LPC_PITCH_SEARCH_TRACKING) {
+                lpc_pitch_candidates_internal(context, encoder->pitch_buffer, encoder->segments, encoder->candidates, encoder->cursor, last, settings.window_size_in_segments, settings.pitch_low_cut, settings.pitch_high_cut);
+
+                if (last == count) {
+                    lpc_pitch_smooth_internal(context, encoder->segments, encoder->candidates);
+                }
+            } else {
+                lpc_pitch_estimate_internal(context, encoder->pitch_buffer, encoder->segments, encoder->cursor, last, settings.window_size_in_segments, settings.pitch_low_cut, settings.pitch_high_cut);
+            }
+
+            encoder->cursor = last;
+
+            if (last == count) {
+                encoder->stage  = LPC_ENCODE_STAGE_ANALYSIS;
+                encoder->cursor = 0;
+            }
+
+            LPC_TRACE_END();
+        } break;
+
+        case LPC_ENCODE_STAGE_ANALYSIS:
+        {
+            LPC_TRACE_BEGIN("lpc_encode: analysis");
+
+            /* whole batches of lanes, so steps don't change the result */
+            max_segments = (max_segments + LPC_LANES - 1) / LPC_LANES * LPC_LANES;
+
+            last = lpc_encode_last_internal(encoder->cursor, count, max_segments);
+
+            lpc_analysis_internal(context, buffer, encoder->segments, settings, encoder->cursor, last);
+
+            encoder->cursor = last;
+
+            if (last == count) {
+                lpc_encode_codes_begin_internal(context, encoder);
+            }
+
+            LPC_TRACE_END();
+        } break;
+
+        case LPC_ENCODE_STAGE_CODES:
+        {
+            LPC_TRACE_BEGIN("lpc_encode: codes");
+
+            last = lpc_encode_last_internal(encoder->cursor, count, max_segments);
+
+            if (settings.rd_lambda > 0) {
+                lpc_trellis_forward_internal(context->tables, &encoder->trellis, encoder->segments, settings.rd_lambda, encoder->cursor, last);
+            } else {
+                lpc_codes_from_segments_internal(context->tables, encoder->segments, encoder->codes, settings.repeat_thresh, encoder->cursor, last, &encoder->has_reference, &encoder->reference);
+            }
+
+            encoder->cursor = last;
+
+            /* trace goes back from the end, so cursor stays there */
+            if (last == count) {
+                encoder->stage = settings.rd_lambda > 0 ? LPC_ENCODE_STAGE_TRACE : LPC_ENCODE_STAGE_DONE;
+            }
+
+            LPC_TRACE_END();
+        } break;
+
+        case LPC_ENCODE_STAGE_TRACE:
+        {
+            LPC_TRACE_BEGIN("lpc_encode: trace");
+
+            first = max_segments > 0 && encoder->cursor > max_segments ? encoder->cursor - max_segments : 0;
+
+            lpc_trellis_trace_internal(&encoder->trellis, encoder->segments, encoder->codes, first, encoder->cursor);
+
+            encoder->cursor = first;
+
+            if (first == 0) {
+                lpc_trellis_free_internal(context, &encoder->trellis);
+                encoder->stage = LPC_ENCODE_STAGE_DONE;
+            }
+
+            LPC_TRACE_END();
+        } break;
+    }
+
+    return encoder->stage == LPC_ENCODE_STAGE_DONE;
+}
+
+LPC_API Lpc_Bitcodes lpc_encode_end(Lpc_Context *context, Lpc_Encoder *encoder, lpc_u32 *lead_in) {
+    Lpc_Bitcodes codes;
+
+    assert(context != NULL);
+    assert(encoder != NULL);
+
+    codes = encoder->codes;
+
+    if (lead_in != NULL) {
+        *lead_in = encoder->lead_in;
+    }
+
+    /* cancelled before codes are done, nothing to give back */
+    if (encoder->stage != LPC_ENCODE_STAGE_DONE) {
+        lpc_bitcodes_free(context, &codes);
+    }
+
+    if (encoder->samples)              LPC_CONTEXT_FREE(context, encoder->samples);
+    if (encoder->pitch_buffer.samples) LPC_CONTEXT_FREE(context, encoder->pitch_buffer.samples);
+    if (encoder->candidates)           LPC_CONTEXT_FREE(context, encoder->candidates);
+
+    lpc_segments_free_internal(context, &encoder->segments);
+    lpc_trellis_free_internal(context, &encoder->trellis);
+
+    memset(encoder, 0, sizeof(Lpc_Encoder));
+
+    return codes;
+}
+
+LPC_API Lpc_Bitcodes lpc_encode_bitcodes(Lpc_Context *context, Lpc_Sample_Buffer buffer, Lpc_Encoder_Settings settings) {
+    Lpc_Encoder encoder;
+    Lpc_Bitcodes codes;
+
+    LPC_TRACE_BEGIN("lpc_encode");
+
+    lpc_encode_begin(context, &encoder, buffer, settings);
+    while (!lpc_encode_step(context, &encoder, 0));
+    codes = lpc_encode_end(context, &encoder, NULL);
+
+    LPC_TRACE_END();
+
+    return codes;
+}
+
+LPC_API Lpc_Codes lpc_encode(Lpc_Context *context, Lpc_Sample_Buffer buffer, Lpc_Encoder_Settings settings) {
+    Lpc_Bitcodes bitcodes;
+    Lpc_Codes codes;
+
+    bitcodes = lpc_encode_bitcodes(context, buffer, settings);
+    codes    = lpc_bitcodes_unpack(context, bitcodes);
+    lpc_bitcodes_free(context, &bitcodes);
+
+    return codes;
+}
+
+/*
+// Splitting
+*/
+
+LPC_API Lpc_Split lpc_split(Lpc_Context *context, Lpc_Sample_Buffer buffer, Lpc_Split_Settings settings) {
+    Lpc_Split split;
+    lpc_f32 *energy, peak, silence_level, speech_level;
+    lpc_u8 *speech;
+    lpc_u32 window, window_count, min_gap, min_phrase, padding;
+    lpc_u32 i, start, end, gap, previous_end, first, last, next;
+    lpc_u64 offset, size;
+
+    assert(context != NULL);
+    assert(buffer.channels > 0);
+    assert(settings.window_ms > 0);
+
+    memset(&split, 0, sizeof(Lpc_Split));
+
+    window = buffer.sample_rate * settings.window_ms / 1000;
+    if (window == 0) window = 1;
+
+    window_count = (buffer.frame_count + window - 1) / window;
+
+    if (window_count == 0) return split;
+
+    LPC_TRACE_BEGIN("lpc_split");
+
+    energy = (lpc_f32*)LPC_CONTEXT_ALLOC(context, sizeof(lpc_f32) * window_count);
+    speech = (lpc_u8*)LPC_CONTEXT_ALLOC(context, sizeof(lpc_u8) * window_count);
+
+    /* most phrases there can be, every one needs speech and a gap after it */
+    split.ranges = (Lpc_Split_Range*)LPC_CONTEXT_ALLOC(context, sizeof(Lpc_Split_Range) * (window_count / 2 + 1));
+
+    assert(energy != NULL && speech != NULL && split.ranges != NULL); /* @todo, proper recovery from memory allocation errors */
+
+    /* envelope, channels are interleaved, so window is just longer */
+    peak = 0;
+
+    for (i = 0; i < window_count; i++) {
+        offset = (lpc_u64)i * window * buffer.channels;
+        size   = (lpc_u64)window * buffer.channels;
+
+        if (offset + size > (lpc_u64)buffer.frame_count * buffer.channels) {
+            size = (lpc_u64)buffer.frame_count * buffer.channels - offset;
+        }
+
+        energy[i] = lpc_mean_square_internal(buffer.samples + offset, size);
+
+        if (energy[i] > peak) peak = energy[i];
+    }
+
+    /* energy is power, so dB are over 10 */
+    silence_level = peak * powf(10.0f, settings.silence_db / 10.0f);
+    speech_level  = peak * powf(10.0f, settings.speech_db  / 10.0f);
+
+    speech[0] = peak > 0 && energy[0] > speech_level;
+
+    for (i = 1; i < window_count; i++) {
+        if (speech[i - 1]) {
+            speech[i] = energy[i] >= silence_level;
+        } else {
+            speech[i] = energy[i] > speech_level;
+        }
+    }
+
+    min_gap    = (settings.min_gap_ms + settings.window_ms - 1) / settings.window_ms;
+    min_phrase = (settings.min_phrase_ms + settings.window_ms - 1) / settings.window_ms;
+    padding    = settings.padding_ms * buffer.sample_rate / 1000;
+
+    i = 0;
+
+    while (i < window_count) {
+        if (!speech[i]) {
+            i++;
+            continue;
+        }
+
+        /* phrase goes on until gap of min_gap silent windows or the end */
+        start = i;
+        end   = i;
+
+        while (i < window_count) {
+            if (speech[i]) {
+                end = ++i;
+                continue;
+            }
+
+            for (gap = 0; i + gap < window_count && !speech[i + gap]; gap++);
+
+            if (gap >= min_gap || i + gap == window_count) break;
+
+            i += gap;
+        }
+
+        if (end - start < min_phrase) continue;
+
+        last = end * window;
+        if (last > buffer.frame_count) last = buffer.frame_count;
+
+        split.ranges[split.count].first = start * window;
+        split.ranges[split.count].count = last - start * window;
+        split.count++;
+    }
+
+    /* padding takes at most half of the gap on each side, so phrases never overlap */
+    previous_end = 0;
+
+    for (i = 0; i < split.count; i++) {
+        first = split.ranges[i].first;
+        last  = first + split.ranges[i].count;
+        next  = i + 1 < split.count ? split.ranges[i + 1].first : buffer.frame_count;
+
+        gap   = i > 0 ? (first - previous_end) / 2 : first;
+        first = first - (gap < padding ? gap : padding);
+
+        gap   = i + 1 < split.count ? (next - last) / 2 : next - last;
+        last  = last + (gap < padding ? gap : padding);
+
+        previous_end = split.ranges[i].first + split.ranges[i].count;
+
+        split.ranges[i].first = first;
+        split.ranges[i].count = last - first;
+    }
+
+    LPC_CONTEXT_FREE(context, energy);
+    LPC_CONTEXT_FREE(context, speech);
+
+    LPC_TRACE_END();
+
+    return split;
+}
+
+LPC_API void lpc_split_free(Lpc_Context *context, Lpc_Split *split) {
+    assert(split != NULL);
+
+    if (split->ranges) {
+        LPC_CONTEXT_FREE(context, split->ranges);
+    }
+
+    memset(split, 0, sizeof(Lpc_Split));
+}
+
+LPC_API Lpc_Sample_Buffer lpc_split_range_buffer(Lpc_Sample_Buffer buffer, Lpc_Split_Range range) {
+    assert((lpc_u64)range.first + range.count <= buffer.frame_count);
+
+    buffer.samples     = buffer.samples + (lpc_u64)range.first * buffer.channels;
+    buffer.frame_count = range.count;
+
+    return buffer;
+}
+
+/*
+// Decoding
+*/
+
+LPC_API void lpc_decoder_init(Lpc_Context *context, Lpc_Decoder *decoder) {
+    assert(context != NULL);
+    assert(decoder != NULL);
+
+    memset(decoder, 0, sizeof(Lpc_Decoder));
+    decoder->tables = context->tables;
+    decoder->noise  = 1;
+}
+
+/* sets new target of interpolation, stop frame should be handled by caller */
+LPC_API void lpc_synth_apply_code_internal(const Lpc_Tables *tables, Lpc_Synth *target, Lpc_Code code) {
+    if (code.energy == LPC_ENERGY_ZERO) {
+        target->energy = 0;
+        return;
+    }
+
+    target->energy = tables->energy[code.energy];
+    target->pitch  = tables->pitch[code.pitch];
+
+    if (code.repeat) {
+        return;
+    }
+
+    target->k[0] = tables->k[0][code.k1];
+    target->k[1] = tables->k[1][code.k2];
+    target->k[2] = tables->k[2][code.k3];
+    target->k[3] = tables->k[3][code.k4];
+
+    if (target->pitch) {
+        target->k[4] = tables->k[4][code.k5];
+        target->k[5] = tables->k[5][code.k6];
+        target->k[6] = tables->k[6][code.k7];
+        target->k[7] = tables->k[7][code.k8];
+        target->k[8] = tables->k[8][code.k9];
+        target->k[9] = tables->k[9][code.k10];
+    } else {
+        target->k[4] = 0;
+        target->k[5] = 0;
+        target->k[6] = 0;
+        target->k[7] = 0;
+        target->k[8] = 0;
+        target->k[9] = 0;
+    }
+}
+
+/*
+// Synthesis kernel. Everything that depends only on the frame is done once: interpolation
+// steps and ranges of silent, unvoiced and voiced samples. Excitation of the frame is
+// generated run by run without per sample branches, then lattice filter runs over it
+// with Ks and filter state in locals. Pitch is interpolated in integers, so phase and
+// noise don't depend on float rounding and lpc_excitation_advance_internal can skip
+// frames without rendering them.
+*/
+
+#define LPC_SYNTH_STEPS (LPC_SAMPLES - 1)
+
+LPC_API LPC_INLINE lpc_u32 lpc_noise_next_internal(lpc_u32 bits) {
+    return (bits >> 1) ^ ((0u - (bits & 1)) & 0xBD00);
+}
+
+LPC_API void lpc_excitation_noise_internal(lpc_f32 *excitation, lpc_u32 from, lpc_u32 to, lpc_f32 energy, lpc_f32 energy_step, lpc_u32 *noise) {
+    static const lpc_f32 signs[2] = { -1.0f, 1.0f };
+    lpc_u32 i, bits;
+
+    bits = *noise;
+
+    for (i = from; i < to; i++) {
+        bits = lpc_noise_next_internal(bits);
+        excitation[i] = signs[bits & 1] * (energy + energy_step * (lpc_f32)i);
+    }
+
+    *noise = bits;
+}
+
+/* samples [first, end) have energy, [voiced_first, voiced_end) of them are voiced and the rest is noise */
+LPC_API void lpc_excitation_ranges_internal(Lpc_Synth previous, Lpc_Synth target, lpc_u32 *first, lpc_u32 *end, lpc_u32 *voiced_first, lpc_u32 *voiced_end) {
+    lpc_u32 from, to, voiced_from, voiced_to;
+
+    /* interpolated energy is zero only at the ends that are zero */
+    from = previous.energy == 0 ? 1 : 0;
+    to   = target.energy   == 0 ? LPC_SAMPLES - 1 : LPC_SAMPLES;
+
+    if (previous.energy == 0 && target.energy == 0) {
+        from = to = 0;
+    }
+
+    /* interpolated pitch is monotonic, so voiced samples are one run */
+    if (previous.pitch == 0 && target.pitch == 0) {
+        voiced_from = voiced_to = from;
+    } else if (previous.pitch == 0) {
+        voiced_from = (LPC_SYNTH_STEPS + target.pitch - 1) / target.pitch;
+        voiced_to   = LPC_SAMPLES;
+    } else if (target.pitch == 0) {
+        voiced_from = 0;
+        voiced_to   = LPC_SAMPLES - (LPC_SYNTH_STEPS + previous.pitch - 1) / previous.pitch;
+    } else {
+        voiced_from = 0;
+        voiced_to   = LPC_SAMPLES;
+    }
+
+    voiced_from = LPC_MIN(LPC_MAX(voiced_from, from), to);
+    voiced_to   = LPC_MIN(LPC_MAX(voiced_to, voiced_from), to);
+
+    *first        = from;
+    *end          = to;
+    *voiced_first = voiced_from;
+    *voiced_end   = voiced_to;
+}
+
+/* excitation of one frame, interpolated from previous to target, phase and noise continue between frames */
+LPC_API void lpc_excitation_internal(const lpc_f32 *chirp_table, Lpc_Synth previous, Lpc_Synth target, lpc_u32 *phase_counter, lpc_u32 *noise, lpc_f32 *excitation) {
+    lpc_f32 chirp[LPC_CHIRP_TABLE_SIZE + 1];
+    lpc_f32 energy, energy_step;
+    lpc_u32 i, first, end, voiced_first, voiced_end;
+    lpc_u32 phase, pitch, pitch_sum, pitch_step;
+
+    lpc_excitation_ranges_internal(previous, target, &first, &end, &voiced_first, &voiced_end);
+
+    energy      = previous.energy;
+    energy_step = (target.energy - previous.energy) / (lpc_f32)LPC_SYNTH_STEPS;
+
+    for (i = 0; i < first; i++) {
+        excitation[i] = 0;
+    }
+
+    lpc_excitation_noise_internal(excitation, first, voiced_first, energy, energy_step, noise);
+
+    if (voiced_first < voiced_end) {
+        /* chirp with zero after it, samples of the period past the chirp read that zero */
+        memcpy(chirp, chirp_table, sizeof(lpc_f32) * LPC_CHIRP_TABLE_SIZE);
+        chirp[LPC_CHIRP_TABLE_SIZE] = 0;
+
+        phase      = *phase_counter;
+        pitch_sum  = previous.pitch * (LPC_SYNTH_STEPS - voiced_first) + target.pitch * voiced_first;
+        pitch_step = target.pitch - previous.pitch; /* wraps around when pitch goes down, sum stays right */
+
+        for (i = voiced_first; i < voiced_end; i++) {
+            pitch = pitch_sum / LPC_SYNTH_STEPS;
+            phase = phase < pitch ? phase + 1 : 0;
+
+            excitation[i] = chirp[phase < LPC_CHIRP_TABLE_SIZE ? phase : LPC_CHIRP_TABLE_SIZE] * (energy + energy_step * (lpc_f32)i);
+
+            pitch_sum += pitch_step;
+        }
+
+        *phase_counter = phase;
+    }
+
+    lpc_excitation_noise_internal(excitation, voiced_end, end, energy, energy_step, noise);
+
+    for (i = end; i < LPC_SAMPLES; i++) {
+        excitation[i] = 0;
+    }
+}
+
+LPC_API lpc_b32 lpc_decoder_render_frame(Lpc_Decoder *decoder, Lpc_Code code, lpc_f32 *samples) {
+    lpc_u64 i;
+    lpc_f32 excitation[LPC_SAMPLES];
+    lpc_f32 step;
+    lpc_f32 k0, k1, k2, k3, k4, k5, k6, k7, k8, k9;
+    lpc_f32 d0, d1, d2, d3, d4, d5, d6, d7, d8, d9;
+    lpc_f32 f0, f1, f2, f3, f4, f5, f6, f7, f8, f9;
+    lpc_f32 b0, b1, b2, b3, b4, b5, b6, b7, b8, b9;
+    Lpc_Synth *previous, *target;
+
+    assert(decoder != NULL);
+    assert(samples != NULL);
+
+    code = lpc_code_clamp(code);
+
+    if (code.energy == LPC_ENERGY_STOP) {
+        return false;
+    }
+
+    lpc_synth_apply_code_internal(decoder->tables, &decoder->target, code);
+
+    decoder->previous = decoder->current;
+
+    previous = &decoder->previous;
+    target   = &decoder->target;
+
+    lpc_excitation_internal(decoder->tables->chirp, *previous, *target, &decoder->phase_counter, &decoder->noise, excitation);
+
+    step = 1.0f / (lpc_f32)LPC_SYNTH_STEPS;
+
+    k0 = previous->k[0]; d0 = (target->k[0] - k0) * step;
+    k1 = previous->k[1]; d1 = (target->k[1] - k1) * step;
+    k2 = previous->k[2]; d2 = (target->k[2] - k2) * step;
+    k3 = previous->k[3]; d3 = (target->k[3] - k3) * step;
+    k4 = previous->k[4]; d4 = (target->k[4] - k4) * step;
+    k5 = previous->k[5]; d5 = (target->k[5] - k5) * step;
+    k6 = previous->k[6]; d6 = (target->k[6] - k6) * step;
+    k7 = previous->k[7]; d7 = (target->k[7] - k7) * step;
+    k8 = previous->k[8]; d8 = (target->k[8] - k8) * step;
+    k9 = previous->k[9]; d9 = (target->k[9] - k9) * step;
+
+    b0 = decoder->backward[0]; b1 = decoder->backward[1];
+    b2 = decoder->backward[2]; b3 = decoder->backward[3];
+    b4 = decoder->backward[4]; b5 = decoder->backward[5];
+    b6 = decoder->backward[6]; b7 = decoder->backward[7];
+    b8 = decoder->backward[8]; b9 = decoder->backward[9];
+
+    f0 = f1 = f2 = f3 = f4 = f5 = f6 = f7 = f8 = f9 = 0;
+
+    for (i = 0; i < LPC_SAMPLES; i++) {
+        f9 = excitation[i] - k9 * b9;
+        f8 = f9 - k8 * b8;
+        f7 = f8 - k7 * b7;
+        f6 = f7 - k6 * b6;
+        f5 = f6 - k5 * b5;
+        f4 = f5 - k4 * b4;
+        f3 = f4 - k3 * b3;
+        f2 = f3 - k2 * b2;
+        f1 = f2 - k1 * b1;
+        f0 = f1 - k0 * b0;
+
+        b9 = b8 + k8 * f8;
+        b8 = b7 + k7 * f7;
+        b7 = b6 + k6 * f6;
+        b6 = b5 + k5 * f5;
+        b5 = b4 + k4 * f4;
+        b4 = b3 + k3 * f3;
+        b3 = b2 + k2 * f2;
+        b2 = b1 + k1 * f1;
+        b1 = b0 + k0 * f0;
+        b0 = f0;
+
+        samples[i] = f0;
+
+        k0 += d0; k1 += d1; k2 += d2; k3 += d3; k4 += d4;
+        k5 += d5; k6 += d6; k7 += d7; k8 += d8; k9 += d9;
+    }
+
+    decoder->forward[0]  = f0; decoder->forward[1]  = f1;
+    decoder->forward[2]  = f2; decoder->forward[3]  = f3;
+    decoder->forward[4]  = f4; decoder->forward[5]  = f5;
+    decoder->forward[6]  = f6; decoder->forward[7]  = f7;
+    decoder->forward[8]  = f8; decoder->forward[9]  = f9;
+
+    decoder->backward[0] = b0; decoder->backward[1] = b1;
+    decoder->backward[2] = b2; decoder->backward[3] = b3;
+    decoder->backward[4] = b4; decoder->backward[5] = b5;
+    decoder->backward[6] = b6; decoder->backward[7] = b7;
+    decoder->backward[8] = b8; decoder->backward[9] = b9;
+
+    /* interpolation ends exactly at target */
+    decoder->current = *target;
+
+    return true;
+}
+
+LPC_API Lpc_Sample_Buffer lpc_decode(Lpc_Context *context, Lpc_Codes codes) {
+    lpc_u64 i = 0, sample_counter = 0, code_index = 0;
+    lpc_f32 max = FLT_MIN, min = FLT_MAX;
+    Lpc_Sample_Buffer buffer;
+    Lpc_Decoder decoder;
+
+    lpc_decoder_init(context, &decoder);
+
+    buffer.sample_rate = LPC_SAMPLE_RATE;
+    buffer.channels    = 1;
+    buffer.frame_count = codes.count * LPC_SAMPLES;
+    buffer.samples     = (lpc_f32*)LPC_CONTEXT_ALLOC(context, sizeof(lpc_f32) * buffer.frame_count);
+
+    if (buffer.samples == NULL) {
+        memset(&buffer, 0, sizeof(Lpc_Sample_Buffer));
+        return buffer;
+    }
+
+    LPC_TRACE_BEGIN("lpc_decode");
+
+    while (code_index < codes.count) {
+        assert((sample_counter + LPC_SAMPLES) <= buffer.frame_count);
+
+        if (!lpc_decoder_render_frame(&decoder, codes.code[code_index++], buffer.samples + sample_counter)) {
+            break;
+        }
+
+        sample_counter += LPC_SAMPLES;
+    }
+
+    buffer.frame_count = sample_counter;
+
+    for (i = 0; i < buffer.frame_count; i++) {
+        if (buffer.samples[i] > max) max = buffer.samples[i];
+        if (buffer.samples[i] < min) min = buffer.samples[i];
+    }
+
+    for (i = 0; i < buffer.frame_count; i++) {
+        buffer.samples[i] = buffer.samples[i] / (max - min);
+    }
+
+    LPC_TRACE_END();
+
+    return buffer;
+}
+
+/*
+// Resampling
+*/
+
+LPC_API lpc_u32 lpc_gcd_internal(lpc_u32 a, lpc_u32 b) {
+    lpc_u32 t;
+
+    while (b != 0) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+LPC_API lpc_b32 lpc_resampler_init(Lpc_Context *context, Lpc_Resampler *resampler, lpc_u32 rate) {
+    lpc_u32 gcd, p, j;
+    lpc_f32 *taps, x, sum, window, cutoff;
+
+    assert(context != NULL);
+    assert(resampler != NULL);
+
+    memset(resampler, 0, sizeof(Lpc_Resampler));
+
+    if (rate < LPC_SAMPLE_RATE) return false;
+
+    gcd = lpc_gcd_internal(rate, LPC_SAMPLE_RATE);
+
+    resampler->rate = rate;
+    resampler->up   = rate / gcd;
+    resampler->down = LPC_SAMPLE_RATE / gcd;
+
+    if (resampler->up > LPC_RESAMPLE_MAX_PHASES) return false;
+
+    resampler->filter = (lpc_f32*)LPC_CONTEXT_ALLOC(context, sizeof(lpc_f32) * LPC_RESAMPLE_TAPS * resampler->up);
+
+    if (resampler->filter == NULL) return false;
+
+    /* cut a bit below 4 kHz, chip has nothing above it anyway */
+    cutoff = 0.9f;
+
+    /*
+    // windowed sinc, tap j of phase p takes input sample that is LPC_RESAMPLE_TAPS / 2 - 1 - j + p / up
+    // away from the output, every phase is normalized so constant signal stays the same
+    */
+    for (p = 0; p < resampler->up; p++) {
+        taps = resampler->filter + p * LPC_RESAMPLE_TAPS;
+        sum  = 0;
+
+        for (j = 0; j < LPC_RESAMPLE_TAPS; j++) {
+            x      = (lpc_f32)(LPC_RESAMPLE_TAPS / 2 - 1) - (lpc_f32)j + (lpc_f32)p / (lpc_f32)resampler->up;
+            window = 0.42f + 0.5f * cosf(LPC_TAU * x / LPC_RESAMPLE_TAPS) + 0.08f * cosf(2.0f * LPC_TAU * x / LPC_RESAMPLE_TAPS);
+
+            taps[j]  = x == 0 ? 1.0f : sinf(LPC_PI * cutoff * x) / (LPC_PI * cutoff * x);
+            taps[j] *= window;
+            sum     += taps[j];
+        }
+
+        for (j = 0; j < LPC_RESAMPLE_TAPS; j++) {
+            taps[j] /= sum;
+        }
+    }
+
+    return true;
+}
+
+LPC_API void lpc_resampler_free(Lpc_Context *context, Lpc_Resampler *resampler) {
+    assert(resampler != NULL);
+
+    if (resampler->filter) {
+        LPC_CONTEXT_FREE(context, resampler->filter);
+    }
+
+    memset(resampler, 0, sizeof(Lpc_Resampler));
+}
+
+LPC_API lpc_u32 lpc_resampler_max_output(const Lpc_Resampler *resampler, lpc_u32 count) {
+    assert(resampler != NULL);
+
+    return (lpc_u32)(((lpc_u64)count * resampler->up + resampler->down - 1) / resampler->down);
+}
+
+/* writes to output or to pcm (multiplied by gain), input goes in chunks of LPC_SAMPLES behind history */
+LPC_API lpc_u32 lpc_resample_internal(const Lpc_Resampler *resampler, Lpc_Resampler_State *state, const lpc_f32 *input, lpc_u32 count, lpc_f32 *output, lpc_s16 *pcm, lpc_f32 gain) {
+    lpc_f32 block[LPC_RESAMPLE_TAPS - 1 + LPC_SAMPLES];
+    const lpc_f32 *taps, *window;
+    lpc_u32 i, j, n, size, phase, written;
+    lpc_f32 sum;
+
+    assert(resampler != NULL && resampler->filter != NULL);
+    assert(state != NULL);
+    assert(state->phase < resampler->up);
+
+    phase   = state->phase;
+    written = 0;
+
+    for (i = 0; i < count; i += size) {
+        size = count - i < LPC_SAMPLES ? count - i : LPC_SAMPLES;
+
+        memcpy(block, state->history, sizeof(state->history));
+        memcpy(block + LPC_RESAMPLE_TAPS - 1, input + i, sizeof(lpc_f32) * size);
+
+        for (n = 0; n < size; n++) {
+            window = block + n;
+
+            /* outputs between this input sample and the next */
+            for (; phase < resampler->up; phase += resampler->down) {
+                taps = resampler->filter + phase * LPC_RESAMPLE_TAPS;
+                sum  = 0;
+
+                for (j = 0; j < LPC_RESAMPLE_TAPS; j++) {
+                    sum += taps[j] * window[j];
+                }
+
+                if (pcm != NULL) {
+                    sum *= gain * 32767.0f;
+
+                    if (sum >  32767.0f) sum =  32767.0f;
+                    if (sum < -32768.0f) sum = -32768.0f;
+
+                    pcm[written++] = (lpc_s16)sum;
+                } else {
+                    output[written++] = sum;
+                }
+            }
+
+            phase -= resampler->up;
+        }
+
+        memcpy(state->history, block + size, sizeof(state->history));
+    }
+
+    state->phase = phase;
+
+    return written;
+}
+
+LPC_API lpc_u32 lpc_resample(const Lpc_Resampler *resampler, Lpc_Resampler_State *state, const lpc_f32 *input, lpc_u32 count, lpc_f32 *output) {
+    assert(output != NULL);
+
+    return lpc_resample_internal(resampler, state, input, count, output, NULL, 1.0f);
+}
+
+LPC_API lpc_u32 lpc_decoder_render_frame_resampled(Lpc_Decoder *decoder, const Lpc_Resampler *resampler, Lpc_Resampler_State *state, Lpc_Code code, lpc_f32 *samples) {
+    lpc_f32 frame[LPC_SAMPLES];
+
+    if (!lpc_decoder_render_frame(decoder, code, frame)) return 0;
+
+    return lpc_resample(resampler, state, frame, LPC_SAMPLES, samples);
+}
+
+LPC_API lpc_u32 lpc_decoder_render_frame_s16(Lpc_Decoder *decoder, const Lpc_Resampler *resampler, Lpc_Resampler_State *state, Lpc_Code code, lpc_f32 gain, lpc_s16 *samples) {
+    lpc_f32 frame[LPC_SAMPLES];
+
+    assert(samples != NULL);
+
+    if (!lpc_decoder_render_frame(decoder, code, frame)) return 0;
+
+    return lpc_resample_internal(resampler, state, frame, LPC_SAMPLES, NULL, samples, gain);
+}
+
+LPC_API Lpc_Sample_Buffer lpc_decode_resampled(Lpc_Context *context, Lpc_Codes codes, const Lpc_Resampler *resampler) {
+    lpc_u64 i, sample_counter = 0, code_index = 0, capacity;
+    lpc_f32 max = FLT_MIN, min = FLT_MAX;
+    Lpc_Resampler_State state;
+    Lpc_Sample_Buffer buffer;
+    Lpc_Decoder decoder;
+    lpc_u32 written;
+
+    assert(resampler != NULL);
+
+    lpc_decoder_init(context, &decoder);
+    memset(&state, 0, sizeof(Lpc_Resampler_State));
+
+    capacity = lpc_resampler_max_output(resampler, codes.count * LPC_SAMPLES);
+
+    buffer.sample_rate = resampler->rate;
+    buffer.channels    = 1;
+    buffer.frame_count = (lpc_u32)capacity;
+    buffer.samples     = (lpc_f32*)LPC_CONTEXT_ALLOC(context, sizeof(lpc_f32) * capacity);
+
+    if (buffer.samples == NULL) {
+        memset(&buffer, 0, sizeof(Lpc_Sample_Buffer));
+        return buffer;
+    }
+
+    LPC_TRACE_BEGIN("lpc_decode_resampled");
+
+    while (code_index < codes.count) {
+        written = lpc_decoder_render_frame_resampled(&decoder, resampler, &state, codes.code[code_index++], buffer.samples + sample_counter);
+
+        if (written == 0) break;
+
+        sample_counter += written;
+        assert(sample_counter <= capacity);
+    }
+
+    buffer.frame_count = (lpc_u32)sample_counter;
+
+    for (i = 0; i < buffer.frame_count; i++) {
+        if (buffer.samples[i] > max) max = buffer.samples[i];
+        if (buffer.samples[i] < min) min = buffer.samples[i];
+    }
+
+    for (i = 0; i < buffer.frame_count; i++) {
+        buffer.samples[i] = buffer.samples[i] / (max - min);
+    }
+
+    LPC_TRACE_END();
+
+    return buffer;
+}
+
+
+/* lowest bit of frame in the stream, bits above it are sent starting from LPC_START_BIT */
+LPC_API lpc_u64 lpc_bitcode_stop_bit_internal(lpc_bitcode code) {
+    lpc_u8 energy, pitch;
+
+    energy = (code >> LPC_ENERGY_OFFSET) & LPC_ENERGY_MASK;
+    pitch  = (code >> LPC_PITCH_OFFSET)  & LPC_PITCH_MASK;
+
+    if (energy == LPC_ENERGY_ZERO || energy == LPC_ENERGY_STOP) return LPC_SIGNAL_BIT;
+    if (code & (1LL << LPC_REPEAT_BIT))                          return LPC_REPEAT_STOP_BIT;
+    if (pitch == 0)                                              return LPC_UNVOICED_STOP_BIT;
+
+    return 0;
+}
+
+LPC_API lpc_u64 lpc_reverse_bits_internal(lpc_u64 x) {
+    x = ((x >> 1)  & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    x = ((x >> 2)  & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4)  & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    x = ((x >> 8)  & 0x00FF00FF00FF00FFULL) | ((x & 0x00FF00FF00FF00FFULL) << 8);
+    x = ((x >> 16) & 0x0000FFFF0000FFFFULL) | ((x & 0x0000FFFF0000FFFFULL) << 16);
+    return (x >> 32) | (x << 32);
+}
+
+LPC_API Lpc_Bitcode_Info lpc_tms5220_decode_bits_internal(lpc_u1 *bits, lpc_u64 bits_count) {
+    Lpc_Bitcode_Info info;
+    lpc_s64 i = LPC_START_BIT;
+    lpc_u8 energy, pitch;
+
+    memset(&info, 0, sizeof(Lpc_Bitcode_Info));
+
+    while (true) {
+        if (info.bits_count >= bits_count) {
+            info.not_enough_bits = true;
+            break;
+        }
+
+        info.code |= (lpc_u64)bits[info.bits_count++] << i;
+
+        if (i == 0) break;
+
+        if (i == LPC_ENERGY_OFFSET) {
+            energy = (info.code >> LPC_ENERGY_OFFSET) & LPC_ENERGY_MASK;
+            if (energy == LPC_ENERGY_ZERO || energy == LPC_ENERGY_STOP) {
+                break;
+            }
+        }
+
+        if (i == LPC_PITCH_OFFSET && (info.code & (1LL << LPC_REPEAT_BIT))) {
+            break;
+        }
+
+        if (i <= LPC_PITCH_OFFSET) {
+            pitch  = (info.code >> LPC_PITCH_OFFSET) & LPC_PITCH_MASK;
+            if (pitch == 0 && i == LPC_K4_OFFSET) {
+                break;
+            }
+        }
+
+        i--;
+    }
+
+    return info;
+}
+
+LPC_API void lpc_tms5220_unsquash_bits_internal(lpc_u1 *cont, lpc_u64 cont_count, lpc_u8 *from, lpc_u64 from_count) {
+    lpc_u64 i, j, k = 0;
+    lpc_u1 bit;
+
+    LPC_UNUSED(cont_count);
+
+    assert(cont_count == (from_count * 8));
+    
+    for (i = 0; i < from_count; i++) {
+        for (j = 0; j < 8; j++) {
+            bit = (from[i] >> j) & 1;
+
+            assert(k < cont_count);
+            cont[k++] = bit;
+        }
+    }
+}
+
+/*
+// Stream sends frame from the highest bit, and fills bytes from the lowest one, so
+// frame is reversed and appended to 64 bit accumulator as a whole, whole bytes are flushed.
+// Frame is at most 50 bits and less than 8 bits stay in accumulator, so it never overflows.
+*/
+LPC_API Lpc_TMS5220_Buffer lpc_tms5220_encode_bitcodes(Lpc_Context *context, Lpc_Bitcodes bitcodes) {
+    Lpc_TMS5220_Buffer buff;
+    lpc_u64 i, bits_count, stop_bit, size, accumulator, used, j;
+
+    LPC_TRACE_BEGIN("lpc_tms5220_encode");
+
+    bits_count = 0;
+
+    for (i = 0; i < bitcodes.count; i++) {
+        bits_count += LPC_START_BIT + 1 - lpc_bitcode_stop_bit_internal(bitcodes.code[i]);
+    }
+
+    /* 
+    // pad last byte with zeroes, cutting it would also cut stop frame
+    // and chip will read whatever lies after phrase in rom
+    */
+    buff.count = (lpc_u32)((bits_count + 7) / 8);
+
+    buff.bytes = (lpc_u8*)LPC_CONTEXT_ALLOC(context, sizeof(lpc_u8) * buff.count);
+    assert(buff.bytes != NULL); /* @todo, proper recovery from memory allocation errors */
+
+    accumulator = 0;
+    used        = 0;
+    j           = 0;
+
+    for (i = 0; i < bitcodes.count; i++) {
+        stop_bit = lpc_bitcode_stop_bit_internal(bitcodes.code[i]);
+        size     = LPC_START_BIT + 1 - stop_bit;
+
+        accumulator |= (lpc_reverse_bits_internal(bitcodes.code[i] >> stop_bit) >> (64 - size)) << used;
+        used        += size;
+
+        while (used >= 8) {
+            buff.bytes[j++] = (lpc_u8)accumulator;
+            accumulator >>= 8;
+            used         -= 8;
+        }
+    }
+
+    if (used > 0) {
+        buff.bytes[j++] = (lpc_u8)accumulator;
+    }
+
+    assert(j == buff.count);
+
+    LPC_TRACE_END();
+
+    return buff;
+}
+
+LPC_API Lpc_TMS5220_Buffer lpc_tms5220_encode(Lpc_Context *context, Lpc_Codes codes) {
+    Lpc_TMS5220_Buffer buff;
+    Lpc_Bitcodes bitcodes;
+
+    bitcodes = lpc_codes_pack(context, codes);
+    buff     = lpc_tms5220_encode_bitcodes(context, bitcodes);
+    lpc_bitcodes_free(context, &bitcodes);
+
+    return buff;
+}
+
+LPC_API Lpc_Codes lpc_tms5220_decode(Lpc_Context *context, Lpc_TMS5220_Buffer buffer) {
+    Lpc_List codes;
+    Lpc_Code code;
+    Lpc_Bitcode_Info info;
+    lpc_u1 *bits = NULL;
+    lpc_u64 i = 0;
+
+    codes = lpc_list_create(context, buffer.count * (LPC_BIT_FRAME_SIZE / 8), sizeof(Lpc_Code));
+    bits  = (lpc_u1*)LPC_CONTEXT_ALLOC(context, buffer.count * 8);
+
+    assert(bits != NULL); /* @todo, proper recovery from memory allocation errors */
+
+    lpc_tms5220_unsquash_bits_internal(bits, buffer.count * 8, (lpc_u8*)buffer.bytes, buffer.count);
+
+    while (i < (buffer.count * 8)) {
+        info = lpc_tms5220_decode_bits_internal(bits + i, (buffer.count * 8) - i);
+        code = lpc_convert_from_bitcode_internal(info.code);
+        lpc_list_append(&codes, &code);
+        i += info.bits_count;
+    }
+
+    LPC_CONTEXT_FREE(context, bits);
+
+    return CLITERAL(Lpc_Codes) { (lpc_u32)codes.count, (Lpc_Code *)codes.data };
+}
+
+/*
+// Seeking
+*/
+
+/*
+// Same as lpc_tms5220_decode_bits_internal, but reads straight from packed bytes.
+// Loads 64 bits around the frame at once, stream goes from lowest bit of the byte,
+// and code has first bit of the frame at LPC_START_BIT, so it's bit reversed.
+*/
+LPC_API Lpc_Bitcode_Info lpc_tms5220_read_frame_internal(lpc_u8 *bytes, lpc_u64 bits_count, lpc_u64 bit_offset) {
+    Lpc_Bitcode_Info info;
+    lpc_u64 window = 0, byte, bytes_count, i;
+    lpc_u8 energy, pitch;
+
+    memset(&info, 0, sizeof(Lpc_Bitcode_Info));
+
+    if (bit_offset >= bits_count) {
+        info.not_enough_bits = true;
+        return info;
+    }
+
+    byte        = bit_offset / 8;
+    bytes_count = (bits_count + 7) / 8;
+
+    for (i = 0; i < 8 && (byte + i) < bytes_count; i++) {
+        window |= (lpc_u64)bytes[byte + i] << (i * 8);
+    }
+
+    window    = lpc_reverse_bits_internal(window >> (bit_offset % 8));
+    info.code = window >> (63 - LPC_START_BIT);
+
+    energy = (info.code >> LPC_ENERGY_OFFSET) & LPC_ENERGY_MASK;
+    pitch  = (info.code >> LPC_PITCH_OFFSET)  & LPC_PITCH_MASK;
+
+    if (energy == LPC_ENERGY_ZERO || energy == LPC_ENERGY_STOP) {
+        info.bits_count = LPC_START_BIT - LPC_ENERGY_OFFSET + 1;
+    } else if (info.code & (1LL << LPC_REPEAT_BIT)) {
+        info.bits_count = LPC_START_BIT - LPC_PITCH_OFFSET + 1;
+    } else if (pitch == 0) {
+        info.bits_count = LPC_START_BIT - LPC_K4_OFFSET + 1;
+    } else {
+        info.bits_count = LPC_START_BIT + 1;
+    }
+
+    if (bit_offset + info.bits_count > bits_count) {
+        info.bits_count      = (lpc_u32)(bits_count - bit_offset);
+        info.not_enough_bits = true;
+    }
+
+    /* drop bits of the next frame */
+    info.code &= ~((1ULL << (LPC_START_BIT + 1 - info.bits_count)) - 1);
+
+    return info;
+}
+
+/* phase and noise after the frame, same steps as lpc_excitation_internal without the samples, so chirp isn't needed */
+LPC_API void lpc_excitation_advance_internal(Lpc_Synth previous, Lpc_Synth target, lpc_u32 *phase_counter, lpc_u32 *noise) {
+    lpc_u32 i, first, end, voiced_first, voiced_end;
+    lpc_u32 phase, pitch, pitch_sum, pitch_step, bits;
+
+    lpc_excitation_ranges_internal(previous, target, &first, &end, &voiced_first, &voiced_end);
+
+    bits = *noise;
+
+    for (i = 0; i < (voiced_first - first) + (end - voiced_end); i++) {
+        bits = lpc_noise_next_internal(bits);
+    }
+
+    *noise = bits;
+
+    if (voiced_first < voiced_end) {
+        phase      = *phase_counter;
+        pitch_sum  = previous.pitch * (LPC_SYNTH_STEPS - voiced_first) + target.pitch * voiced_first;
+        pitch_step = target.pitch - previous.pitch;
+
+        for (i = voiced_first; i < voiced_end; i++) {
+            pitch = pitch_sum / LPC_SYNTH_STEPS;
+            phase = phase < pitch ? phase + 1 : 0;
+
+            pitch_sum += pitch_step;
+        }
+
+        *phase_counter = phase;
+    }
+}
+
+LPC_API lpc_u32 lpc_tms5220_frame_from_ms(lpc_u32 ms) {
+    return ms / LPC_FRAME_SIZE_MS;
+}
+
+LPC_API Lpc_TMS5220_Index lpc_tms5220_index_build(Lpc_Context *context, Lpc_TMS5220_Buffer buffer, lpc_u32 interval) {
+    Lpc_TMS5220_Index index;
+    Lpc_List entries;
+    Lpc_TMS5220_Index_Entry entry;
+    Lpc_Bitcode_Info info;
+    Lpc_Synth previous;
+    Lpc_Code code;
+    lpc_u64 bit_offset = 0, bits_count;
+
+    memset(&index, 0, sizeof(Lpc_TMS5220_Index));
+    memset(&entry, 0, sizeof(Lpc_TMS5220_Index_Entry));
+    entry.noise = 1;
+
+    assert(interval > 0);
+
+    index.interval = interval;
+    bits_count     = (lpc_u64)buffer.count * 8;
+    entries        = lpc_list_create(context, buffer.count * 8 / LPC_BIT_FRAME_SIZE / interval + 2, sizeof(Lpc_TMS5220_Index_Entry));
+
+    if (entries.data == NULL) return index;
+
+    while (bit_offset < bits_count) {
+        if ((index.frame_count % interval) == 0) {
+            entry.bit_offset = (lpc_u32)bit_offset;
+            lpc_list_append(&entries, &entry);
+        }
+
+        info = lpc_tms5220_read_frame_internal(buffer.bytes, bits_count, bit_offset);
+        if (info.not_enough_bits) break;
+
+        code = lpc_convert_from_bitcode_internal(info.code);
+        if (code.energy == LPC_ENERGY_STOP) break;
+
+        previous = entry.target;
+        lpc_synth_apply_code_internal(context->tables, &entry.target, code);
+        lpc_excitation_advance_internal(previous, entry.target, &entry.phase_counter, &entry.noise);
+
+        bit_offset += info.bits_count;
+        index.frame_count++;
+    }
+
+    index.count   = (lpc_u32)entries.count;
+    index.entries = (Lpc_TMS5220_Index_Entry *)entries.data;
+
+    return index;
+}
+
+LPC_API void lpc_tms5220_index_free(Lpc_Context *context, Lpc_TMS5220_Index *index) {
+    assert(index != NULL);
+
+    if (index->entries) {
+        LPC_CONTEXT_FREE(context, index->entries);
+    }
+
+    memset(index, 0, sizeof(Lpc_TMS5220_Index));
+}
+
+LPC_API Lpc_Codes lpc_tms5220_decode_from(Lpc_Context *context, Lpc_TMS5220_Buffer buffer, Lpc_TMS5220_Index index, lpc_u32 frame, lpc_u32 max_frames, Lpc_Decoder *decoder) {
+    Lpc_Codes codes;
+    Lpc_Code code;
+    Lpc_Synth target, previous;
+    Lpc_Bitcode_Info info;
+    lpc_u64 bit_offset, bits_count;
+    lpc_u32 current_frame, phase_counter, noise;
+
+    memset(&codes, 0, sizeof(Lpc_Codes));
+
+    if (index.count == 0 || frame >= index.frame_count || max_frames == 0) {
+        return codes;
+    }
+
+    codes.code = (Lpc_Code *)LPC_CONTEXT_ALLOC(context, sizeof(Lpc_Code) * max_frames);
+    if (codes.code == NULL) return codes;
+
+    bits_count    = (lpc_u64)buffer.count * 8;
+    current_frame = (frame / index.interval) * index.interval;
+    bit_offset    = index.entries[frame / index.interval].bit_offset;
+    target        = index.entries[frame / index.interval].target;
+    phase_counter = index.entries[frame / index.interval].phase_counter;
+    noise         = index.entries[frame / index.interval].noise;
+
+    while (bit_offset < bits_count && codes.count < max_frames) {
+        info = lpc_tms5220_read_frame_internal(buffer.bytes, bits_count, bit_offset);
+        if (info.not_enough_bits) break;
+
+        code = lpc_convert_from_bitcode_internal(info.code);
+        bit_offset += info.bits_count;
+
+        if (current_frame < frame) {
+            if (code.energy == LPC_ENERGY_STOP) break;
+
+            previous = target;
+            lpc_synth_apply_code_internal(context->tables, &target, code);
+            lpc_excitation_advance_internal(previous, target, &phase_counter, &noise);
+            current_frame++;
+            continue;
+        }
+
+        codes.code[codes.count++] = code;
+
+        if (code.energy == LPC_ENERGY_STOP) break;
+    }
+
+    if (decoder != NULL) {
+        lpc_decoder_init(context, decoder);
+        decoder->target        = target;
+        decoder->current       = target;
+        decoder->phase_counter = phase_counter;
+        decoder->noise         = noise;
+    }
+
+    return codes;
+}
+
+/*
+// Streaming
+*/
+
+/* size of the frame that starts with these bits, 0 if there is not enough of them to tell */
+LPC_API lpc_u32 lpc_tms5220_frame_size_internal(lpc_bitcode code, lpc_u32 bits_count) {
+    lpc_u8 energy, pitch;
+
+    if (bits_count < LPC_START_BIT - LPC_ENERGY_OFFSET + 1) return 0;
+
+    energy = (code >> LPC_ENERGY_OFFSET) & LPC_ENERGY_MASK;
+
+    if (energy == LPC_ENERGY_ZERO || energy == LPC_ENERGY_STOP) {
+        return LPC_START_BIT - LPC_ENERGY_OFFSET + 1;
+    }
+
+    if (bits_count < LPC_START_BIT - LPC_REP_OFFSET + 1) return 0;
+
+    if (code & (1LL << LPC_REPEAT_BIT)) {
+        return LPC_START_BIT - LPC_PITCH_OFFSET + 1;
+    }
+
+    if (bits_count < LPC_START_BIT - LPC_PITCH_OFFSET + 1) return 0;
+
+    pitch = (code >> LPC_PITCH_OFFSET) & LPC_PITCH_MASK;
+
+    if (pitch == 0) {
+        return LPC_START_BIT - LPC_K4_OFFSET + 1;
+    }
+
+    return LPC_START_BIT + 1;
+}
+
+LPC_API void lpc_tms5220_parser_init(Lpc_TMS5220_Parser *parser) {
+    assert(parser != NULL);
+
+    memset(parser, 0, sizeof(Lpc_TMS5220_Parser));
+}
+
+/* writes one frame if all of its bits are there */
+LPC_API lpc_b32 lpc_tms5220_parser_take_internal(Lpc_TMS5220_Parser *parser, Lpc_Code *code) {
+    lpc_bitcode bitcode;
+    lpc_u32 size;
+
+    bitcode = lpc_reverse_bits_internal(parser->bits) >> (63 - LPC_START_BIT);
+    size    = lpc_tms5220_frame_size_internal(bitcode, parser->bits_count);
+
+    if (size == 0 || size > parser->bits_count) return false;
+
+    /* drop bits of the next frame */
+    bitcode &= ~((1ULL << (LPC_START_BIT + 1 - size)) - 1);
+    *code    = lpc_convert_from_bitcode_internal(bitcode);
+
+    parser->bits      >>= size;
+    parser->bits_count -= size;
+    parser->frame_count++;
+
+    if (code->energy == LPC_ENERGY_STOP) {
+        parser->stopped    = true;
+        parser->bits       = 0;
+        parser->bits_count = 0;
+    }
+
+    return true;
+}
+
+/*
+// @note: frames are taken before every byte is added, so at most 49 bits are
+// waiting when byte comes in, and they always fit in 64 bits.
+*/
+LPC_API lpc_u32 lpc_tms5220_parser_push(Lpc_TMS5220_Parser *parser, const lpc_u8 *bytes, lpc_u32 count, lpc_u32 *consumed, Lpc_Code *codes, lpc_u32 max_codes) {
+    lpc_u32 written = 0, i = 0;
+
+    assert(parser != NULL);
+    assert(bytes != NULL || count == 0);
+    assert(codes != NULL || max_codes == 0);
+
+    while (!parser->stopped && written < max_codes) {
+        if (lpc_tms5220_parser_take_internal(parser, &codes[written])) {
+            written++;
+            continue;
+        }
+
+        if (i >= count) break;
+
+        assert(parser->bits_count <= 64 - 8);
+
+        parser->bits       |= (lpc_u64)bytes[i++] << parser->bits_count;
+        parser->bits_count += 8;
+    }
+
+    if (consumed != NULL) {
+        *consumed = i;
+    }
+
+    return written;
+}
+
+/*
+// FIFO simulation
+*/
+
+#define LPC_FIFO_MAX_RATE 1000000
+
+/* time of the host write, writes of one refill are 1 / rate apart */
+LPC_API lpc_u64 lpc_fifo_write_time_internal(lpc_u64 start, lpc_u64 index, lpc_u32 rate) {
+    return start + (index * 1000000) / rate;
+}
+
+/* returns count of underruns, they are appended to list if it's not NULL */
+LPC_API lpc_u32 lpc_fifo_run_internal(const lpc_u8 *sizes, lpc_u32 frame_count, lpc_u32 bytes_count, Lpc_Fifo_Settings settings, Lpc_List *underruns, Lpc_Fifo_Report *report) {
+    Lpc_Fifo_Underrun underrun;
+    lpc_u64 written, consumed, available, refill_start, refill_index, frame_time, write_time, speech_start, stall;
+    lpc_u32 i, underrun_count, interrupt_count, min_fifo_bits, start_bytes;
+    lpc_b32 refilling;
+
+    written         = 0;
+    consumed        = 0;
+    write_time      = 0;
+    underrun_count  = 0;
+    interrupt_count = 0;
+    min_fifo_bits   = settings.fifo_size * 8;
+
+    /* host starts to fill fifo right after speak command, chip starts when it is more than half full */
+    refilling    = true;
+    refill_start = 0;
+    refill_index = 0;
+    start_bytes  = LPC_MIN(settings.fifo_size / 2 + 1, bytes_count);
+    speech_start = 0;
+
+    while (written < start_bytes) {
+        speech_start = lpc_fifo_write_time_internal(refill_start, refill_index++, settings.host_bytes_per_second);
+        written++;
+    }
+
+    stall = 0;
+
+    for (i = 0; i < frame_count; i++) {
+        frame_time = speech_start + (lpc_u64)i * LPC_FRAME_SIZE_MS * 1000 + stall;
+
+        while (refilling && written < bytes_count && lpc_fifo_write_time_internal(refill_start, refill_index, settings.host_bytes_per_second) <= frame_time) {
+            written++;
+            refill_index++;
+
+            if (written - consumed / 8 >= settings.fifo_size) refilling = false;
+        }
+
+        if (written == bytes_count) refilling = false;
+
+        available = written * 8 - consumed;
+
+        /* after the last write fifo just drains, it's not a headroom */
+        if (written < bytes_count) {
+            min_fifo_bits = LPC_MIN(min_fifo_bits, (lpc_u32)available);
+        }
+
+        if (available < sizes[i]) {
+            if (written == bytes_count) break; /* stream ends in the middle of frame */
+
+            underrun_count++;
+
+            if (underruns != NULL) {
+                underrun.frame        = i;
+                underrun.time_us      = (lpc_u32)frame_time;
+                underrun.missing_bits = (lpc_u32)(sizes[i] - available);
+                lpc_list_append(underruns, &underrun);
+            }
+
+            /* fifo can't be full here, so buffer low is already there */
+            if (!refilling) {
+                refilling    = true;
+                refill_start = frame_time + settings.latency_us;
+                refill_index = 0;
+                interrupt_count++;
+            }
+
+            /* every write until frame_time is done, so the rest of them are later */
+            while (written * 8 - consumed < sizes[i]) {
+                write_time = lpc_fifo_write_time_internal(refill_start, refill_index++, settings.host_bytes_per_second);
+                written++;
+            }
+
+            stall     += write_time - frame_time;
+            frame_time = write_time;
+        }
+
+        consumed += sizes[i];
+
+        if (!refilling && written < bytes_count && (written - consumed / 8) <= settings.fifo_size / 2) {
+            refilling    = true;
+            refill_start = frame_time + settings.latency_us;
+            refill_index = 0;
+            interrupt_count++;
+        }
+    }
+
+    if (report != NULL) {
+        report->interrupt_count = interrupt_count;
+        report->min_fifo_bits   = min_fifo_bits;
+    }
+
+    return underrun_count;
+}
+
+LPC_API Lpc_Fifo_Report lpc_tms5220_fifo_simulate(Lpc_Context *context, Lpc_TMS5220_Buffer buffer, Lpc_Fifo_Settings settings) {
+    Lpc_Fifo_Report report;
+    Lpc_Bitcode_Info info;
+    Lpc_List sizes, underruns;
+    lpc_u64 bit_offset, bits_count, window_bits, total_bits;
+    lpc_u32 i, run, low, high, middle, energy;
+    lpc_u8 size;
+
+    assert(context != NULL);
+    assert(settings.fifo_size >= 8);
+    assert(settings.window_frames > 0);
+    assert(settings.host_bytes_per_second > 0);
+
+    memset(&report, 0, sizeof(Lpc_Fifo_Report));
+
+    sizes = lpc_list_create(context, buffer.count * 8 / LPC_BIT_FRAME_SIZE + 1, sizeof(lpc_u8));
+    if (sizes.data == NULL) return report;
+
+    bit_offset = 0;
+    bits_count = (lpc_u64)buffer.count * 8;
+
+    while (bit_offset < bits_count) {
+        info = lpc_tms5220_read_frame_internal(buffer.bytes, bits_count, bit_offset);
+        if (info.not_enough_bits) break;
+
+        size = (lpc_u8)info.bits_count;
+        lpc_list_append(&sizes, &size);
+        bit_offset += info.bits_count;
+
+        energy = (lpc_u32)((info.code >> LPC_ENERGY_OFFSET) & LPC_ENERGY_MASK);
+        if (energy == LPC_ENERGY_STOP) break;
+    }
+
+    report.frame_count = (lpc_u32)sizes.count;
+
+    if (report.frame_count == 0) {
+        lpc_list_destroy(&sizes);
+        return report;
+    }
+
+    { /* rate envelope and bursts of full frames */
+        const lpc_u8 *frame_sizes = (const lpc_u8 *)sizes.data;
+
+        window_bits = 0;
+        total_bits  = 0;
+        run         = 0;
+
+        for (i = 0; i < report.frame_count; i++) {
+            total_bits  += frame_sizes[i];
+            window_bits += frame_sizes[i];
+
+            if (i >= settings.window_frames) {
+                window_bits -= frame_sizes[i - settings.window_frames];
+            }
+
+            if ((lpc_f32)window_bits > report.peak_bytes_per_second) {
+                report.peak_bytes_per_second = (lpc_f32)window_bits;
+                report.peak_frame = i + 1 > settings.window_frames ? i + 1 - settings.window_frames : 0;
+            }
+
+            run = frame_sizes[i] == LPC_BIT_FRAME_SIZE ? run + 1 : 0;
+
+            if (run > report.burst_frames) {
+                report.burst_frames = run;
+                report.burst_frame  = i + 1 - run;
+            }
+        }
+
+        run = LPC_MIN(settings.window_frames, report.frame_count);
+
+        report.peak_bytes_per_second   /= 8.0f * (lpc_f32)run * LPC_FRAME_SIZE_MS / 1000.0f;
+        report.average_bytes_per_second = (lpc_f32)total_bits / (8.0f * (lpc_f32)report.frame_count * LPC_FRAME_SIZE_MS / 1000.0f);
+    }
+
+    underruns = lpc_list_create(context, 16, sizeof(Lpc_Fifo_Underrun));
+
+    report.underrun_count = lpc_fifo_run_internal((const lpc_u8 *)sizes.data, report.frame_count, buffer.count, settings, &underruns, &report);
+    report.underruns      = (Lpc_Fifo_Underrun *)underruns.data;
+
+    { /* more writes per second never make fifo emptier, so lowest good rate is found with binary search */
+        Lpc_Fifo_Settings search = settings;
+
+        low  = 1;
+        high = LPC_FIFO_MAX_RATE;
+
+        search.host_bytes_per_second = high;
+
+        if (lpc_fifo_run_internal((const lpc_u8 *)sizes.data, report.frame_count, buffer.count, search, NULL, NULL) == 0) {
+            while (low < high) {
+                middle = low + (high - low) / 2;
+                search.host_bytes_per_second = middle;
+
+                if (lpc_fifo_run_internal((const lpc_u8 *)sizes.data, report.frame_count, buffer.count, search, NULL, NULL) == 0) {
+                    high = middle;
+                } else {
+                    low = middle + 1;
+                }
+            }
+
+            report.required_bytes_per_second = low;
+        }
+    }
+
+    lpc_list_destroy(&sizes);
+
+    return report;
+}
+
+LPC_API void lpc_fifo_report_free(Lpc_Context *context, Lpc_Fifo_Report *report) {
+    assert(report != NULL);
+
+    if (report->underruns) {
+        LPC_CONTEXT_FREE(context, report->underruns);
+    }
+
+    memset(report, 0, sizeof(Lpc_Fifo_Report));
+}
+
+/*
+// Phrase bank
+*/
+
+#define LPC_BANK_ALIGN(x) (((x) + 7) & ~(lpc_u64)7)
+
+typedef struct {
+    Lpc_Bank_Entry entry;
+    const char    *name;
+    lpc_s64        phrase; /* index of new phrase, -1 for entry that is already in bank */
+} Lpc_Bank_Item;
+
+LPC_API lpc_u64 lpc_bank_hash(const char *name) {
+    lpc_u64 hash = 0xcbf29ce484222325ULL;
+
+    while (*name) {
+        hash ^= (lpc_u8)*name++;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+LPC_API lpc_b32 lpc_bank_open(Lpc_Bank *bank, const void *bytes, lpc_u64 size) {
+    const Lpc_Bank_Header *header;
+
+    assert(bank != NULL);
+
+    memset(bank, 0, sizeof(Lpc_Bank));
+
+    if (bytes == NULL || size < sizeof(Lpc_Bank_Header)) return false;
+
+    header = (const Lpc_Bank_Header *)bytes;
+
+    if (header->magic != LPC_BANK_MAGIC || header->version != LPC_BANK_VERSION) return false;
+    if ((header->index_offset % 8) != 0 || header->index_offset > size) return false;
+    if ((size - header->index_offset) / sizeof(Lpc_Bank_Entry) < header->entry_count) return false;
+
+    bank->bytes   = (const lpc_u8 *)bytes;
+    bank->size    = size;
+    bank->header  = header;
+    bank->entries = (const Lpc_Bank_Entry *)(bank->bytes + header->index_offset);
+
+    return true;
+}
+
+LPC_API const char *lpc_bank_name(Lpc_Bank bank, lpc_u32 entry) {
+    const Lpc_Bank_Entry *e;
+
+    if (entry >= bank.header->entry_count) return "";
+
+    e = &bank.entries[entry];
+
+    if ((lpc_u64)e->name_offset + e->name_size >= bank.size) return "";
+    if (bank.bytes[e->name_offset + e->name_size] != 0)     return "";
+
+    return (const char *)bank.bytes + e->name_offset;
+}
+
+LPC_API lpc_s64 lpc_bank_find(Lpc_Bank bank, const char *name) {
+    lpc_u64 hash, low, high, middle;
+
+    hash = lpc_bank_hash(name);
+    low  = 0;
+    high = bank.header->entry_count;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+
+        if (bank.entries[middle].name_hash < hash) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    for (; low < bank.header->entry_count && bank.entries[low].name_hash == hash; low++) {
+        if (strcmp(lpc_bank_name(bank, (lpc_u32)low), name) == 0) return (lpc_s64)low;
+    }
+
+    return -1;
+}
+
+LPC_API Lpc_TMS5220_Buffer lpc_bank_stream(Lpc_Bank bank, lpc_u32 entry) {
+    Lpc_TMS5220_Buffer buffer;
+    const Lpc_Bank_Entry *e;
+
+    memset(&buffer, 0, sizeof(Lpc_TMS5220_Buffer));
+
+    if (entry >= bank.header->entry_count) return buffer;
+
+    e = &bank.entries[entry];
 
-        segments.data[i].table_pitch = min_dist_i;
-    }
+    if ((lpc_u64)e->stream_offset + e->stream_size > bank.size) return buffer;
 
-    LPC_FREE(work_buffer);
-    LPC_FREE(periods);
+    buffer.count = e->stream_size;
+    buffer.bytes = (lpc_u8 *)bank.bytes + e->stream_offset;
+
+    return buffer;
 }
 
-LPC_API Lpc_Codes lpc_get_codes_from_segments_internal(Lpc_Segments segments) {
+LPC_API Lpc_Codes lpc_bank_codes(Lpc_Bank bank, lpc_u32 entry) {
     Lpc_Codes codes;
-    Lpc_Code code;
-    lpc_u64 i, j;
-
-    codes.count = segments.count + 1;
-    codes.code  = (Lpc_Code *)LPC_ALLOC(sizeof(Lpc_Code) * codes.count);
+    const Lpc_Bank_Entry *e;
 
-    if (codes.code == NULL) {
-        codes.count = 0;
-        return codes;
-    }
+    memset(&codes, 0, sizeof(Lpc_Codes));
 
-    for (i = 0; i < segments.count; i++) {
-        code.energy = (lpc_u4)segments.data[i].table_energy;
-        code.repeat = 0; /* python wizard doesnt support it, but we can @todo */
-        code.pitch  = (lpc_u6)segments.data[i].table_pitch;
+    if (entry >= bank.header->entry_count) return codes;
+    if (bank.header->code_size != sizeof(Lpc_Code)) return codes;
 
-        for (j = 0; j < 10; j++) {
-            code.k[j] = segments.data[i].table_k[j];
-        }
+    e = &bank.entries[entry];
 
-        codes.code[i] = lpc_code_clamp(code);
-    }
+    if (e->codes_offset == 0) return codes;
+    if ((lpc_u64)e->codes_offset + (lpc_u64)e->code_count * sizeof(Lpc_Code) > bank.size) return codes;
 
-    code.energy = LPC_ENERGY_STOP;
-    codes.code[codes.count - 1] = lpc_code_clamp(code);
+    codes.count = e->code_count;
+    codes.code  = (Lpc_Code *)(bank.bytes + e->codes_offset);
 
     return codes;
 }
 
+LPC_API lpc_s32 lpc_bank_item_compare_internal(const Lpc_Bank_Item *a, const Lpc_Bank_Item *b) {
+    if (a->entry.name_hash != b->entry.name_hash) return a->entry.name_hash < b->entry.name_hash ? -1 : 1;
 
-LPC_API Lpc_Codes lpc_encode(Lpc_Sample_Buffer buffer, Lpc_Encoder_Settings settings) {
-    Lpc_Sample_Buffer pitch_buffer;
-    Lpc_Codes codes;
-    lpc_u64 size, i, j, k, l;
-    Lpc_Segments segments;
-    lpc_f32 sum, k_params[11], coeff[11];
+    return strcmp(a->name, b->name);
+}
 
-    assert(buffer.sample_rate >= LPC_SAMPLE_RATE);
-    buffer       = lpc_buffer_prepare_internal(buffer);
-    pitch_buffer = lpc_buffer_copy_internal(buffer);
+/* shell sort, index is rebuilt only on update, and stdlib may be not included */
+LPC_API void lpc_bank_items_sort_internal(Lpc_Bank_Item *items, lpc_u64 count) {
+    Lpc_Bank_Item item;
+    lpc_u64 gap, i, j;
 
-    lpc_u32 segment_size = buffer.sample_rate / 1000 * LPC_FRAME_SIZE_MS;
-    lpc_u32 num_segments = ceilf((lpc_f32)buffer.frame_count / (lpc_f32)segment_size);
+    for (gap = count / 2; gap > 0; gap /= 2) {
+        for (i = gap; i < count; i++) {
+            item = items[i];
 
-    segments = lpc_get_segments_internal(buffer, segment_size, num_segments);
+            for (j = i; j >= gap && lpc_bank_item_compare_internal(&items[j - gap], &item) > 0; j -= gap) {
+                items[j] = items[j - gap];
+            }
 
-    if (settings.do_pre_emphasis) {
-        lpc_buffer_pre_emphasis(buffer, settings.pre_emphasis_alpha);
+            items[j] = item;
+        }
     }
+}
 
-    lpc_buffer_filter_internal(buffer, settings.processing_low_cut, settings.processing_high_cut, settings.processing_q_factor, true);
-    lpc_buffer_filter_internal(pitch_buffer, settings.pitch_low_cut, settings.pitch_high_cut, settings.pitch_q_factor, false);
-    lpc_pitch_estimate_internal(pitch_buffer, segments, settings.window_size_in_segments, settings.pitch_low_cut, settings.pitch_high_cut);
+LPC_API Lpc_Bank_Update lpc_bank_update(Lpc_Context *context, const Lpc_Bank *bank, const Lpc_Bank_Phrase *phrases, lpc_u32 phrase_count) {
+    Lpc_Bank_Update update;
+    Lpc_Bank_Item *items, *item;
+    lpc_u64 i, j, count, new_count, old_count, size, offset, start;
+    lpc_b32 replaced;
 
-    for (i = 0; i < num_segments; i++) {
-        memset(coeff, 0, sizeof(coeff));
+    assert(context != NULL);
+    assert(phrases != NULL || phrase_count == 0);
 
-        /* so we need to get the LPC coefficients, and this loop basically does it */
-        for (j = 0; j < 11; j++) {
-            size = segment_size - j;
-            sum = 0;
+    memset(&update, 0, sizeof(Lpc_Bank_Update));
 
-            for (k = 0; k < size; k++) {
-                l = k + i * segment_size;
+    old_count = bank != NULL ? bank->header->entry_count : 0;
+    items     = (Lpc_Bank_Item *)LPC_CONTEXT_ALLOC(context, sizeof(Lpc_Bank_Item) * (old_count + phrase_count + 1));
 
-                if ((l + j) >= buffer.frame_count) continue;
+    if (items == NULL) return update;
 
-                sum += buffer.samples[l] * buffer.samples[l + j];
-            }
+    if (bank != NULL) {
+        update.header = *bank->header;
+        update.offset = LPC_BANK_ALIGN(bank->header->file_size);
+        update.header.dead_bytes += (lpc_u64)old_count * sizeof(Lpc_Bank_Entry);
+    } else {
+        update.header.magic   = LPC_BANK_MAGIC;
+        update.header.version = LPC_BANK_VERSION;
+        update.offset         = 0;
+    }
+
+    update.header.code_size = sizeof(Lpc_Code);
+
+    /* new phrases, when name repeats, the last one wins */
+    count = 0;
 
-            coeff[j] = sum;
+    for (i = 0; i < phrase_count; i++) {
+        replaced = false;
+
+        for (j = i + 1; j < phrase_count && !replaced; j++) {
+            replaced = strcmp(phrases[i].name, phrases[j].name) == 0;
         }
 
-        /* here we convert the lpc coefficients to K reflection coeffs */
+        if (replaced) continue;
 
-        { /* Leroux Guegen algorithm for finding K */
-            lpc_f32 y, b_params[11], d_params[12];
+        item = &items[count++];
+        memset(item, 0, sizeof(Lpc_Bank_Item));
+        item->name            = phrases[i].name;
+        item->phrase          = (lpc_s64)i;
+        item->entry.name_hash = lpc_bank_hash(phrases[i].name);
+    }
 
-            memset(k_params, 0, sizeof(k_params));
-            memset(b_params, 0, sizeof(b_params));
-            memset(d_params, 0, sizeof(d_params));
+    /* old entries that are not replaced keep their data */
+    new_count = count;
 
-            k_params[1] = -coeff[1] / coeff[0];
-            d_params[1] =  coeff[1];
-            d_params[2] =  coeff[0] + (k_params[1] * coeff[1]);
+    for (i = 0; i < old_count; i++) {
+        const Lpc_Bank_Entry *old = &bank->entries[i];
 
-            for (j = 2; j < 11; j++) {
-                y = coeff[j];
-                b_params[1] = y;
+        replaced = false;
 
-                for (k = 1; k < j; k++) {
-                    b_params[k + 1] = d_params[k] + (k_params[k] * y);
-                    y += k_params[k] * d_params[k];
-                    d_params[k] = b_params[k];
-                }
+        for (j = 0; j < new_count && !replaced; j++) {
+            replaced = old->name_hash == items[j].entry.name_hash && strcmp(lpc_bank_name(*bank, (lpc_u32)i), items[j].name) == 0;
+        }
 
-                k_params[j] = -y / d_params[j];
-                d_params[j + 1] = d_params[j] + (k_params[j] * y);
-                d_params[j] = b_params[j];
+        if (replaced) {
+            if (old->codes_offset) {
+                update.header.dead_bytes += old->codes_offset + (lpc_u64)old->code_count * bank->header->code_size - old->name_offset;
+            } else {
+                update.header.dead_bytes += old->stream_offset + old->stream_size - old->name_offset;
             }
 
+            continue;
+        }
 
-            if (k_params[1] > settings.unvoiced_thresh) {
-                segments.data[i].table_pitch = 0;
-            }
+        item = &items[count++];
+        item->entry  = bank->entries[i];
+        item->name   = lpc_bank_name(*bank, (lpc_u32)i);
+        item->phrase = -1;
+    }
 
-            { /* setting RMS of signal */
-                lpc_f32 rms, dist, min_dist;
-                lpc_u64 min_dist_i;
+    /* layout of appended data, offsets are from the start of the file */
+    start  = update.offset;
+    offset = bank != NULL ? start : LPC_BANK_ALIGN(sizeof(Lpc_Bank_Header));
 
-                rms = sqrtf(d_params[11] / segment_size) * (1 << 18);
+    for (i = 0; i < count; i++) {
+        const Lpc_Bank_Phrase *phrase;
 
-                if (segments.data[i].table_pitch == 0) {
-                    rms *= settings.unvoiced_rms_multiply;
-                }
+        item = &items[i];
+        if (item->phrase < 0) continue;
 
-                min_dist = fabsf(energy_table[0] - rms);
-                min_dist_i = 0;
+        phrase = &phrases[item->phrase];
 
-                for (j = 1; j < LPC_ENERGY_MASK; j++) {
-                    dist = fabsf(energy_table[j]  - rms);
+        item->entry.name_offset   = (lpc_u32)offset;
+        item->entry.name_size     = (lpc_u32)strlen(phrase->name);
+        offset = LPC_BANK_ALIGN(offset + item->entry.name_size + 1);
 
-                    if (dist < min_dist) {
-                        min_dist = dist;
-                        min_dist_i = j;
-                    }
-                }
+        item->entry.stream_offset = (lpc_u32)offset;
+        item->entry.stream_size   = phrase->stream.count;
+        offset = LPC_BANK_ALIGN(offset + phrase->stream.count);
 
-                segments.data[i].table_energy = min_dist_i;
-            }
+        if (phrase->codes.count > 0) {
+            item->entry.codes_offset = (lpc_u32)offset;
+            item->entry.code_count   = phrase->codes.count;
+            offset = LPC_BANK_ALIGN(offset + (lpc_u64)phrase->codes.count * sizeof(Lpc_Code));
         }
+    }
 
-        {
-            /* and then we set the Ks to segments */
-            lpc_f32 dist, min_dist;
-            lpc_u64 min_dist_i;
-            lpc_f32 *k_table = NULL;
-
-            /*
-            // K1 K2
-            */
-            for (j = 0; j < 2; j++) {
-                switch (j) {
-                    case 0:  k_table = k1_table; break;
-                    case 1:  k_table = k2_table; break;
-                    default: assert(false);      break;
-                }
+    lpc_bank_items_sort_internal(items, count);
 
-                min_dist   = fabsf(k_table[0] - k_params[j + 1]); 
-                min_dist_i = 0;
+    update.header.entry_count  = (lpc_u32)count;
+    update.header.index_offset = offset;
+    update.header.file_size    = offset + count * sizeof(Lpc_Bank_Entry);
 
-                for (k = 1; k <= LPC_K1_K2_MASK; k++) {
-                    dist = fabsf(k_table[k] - k_params[j + 1]);
+    assert(update.header.file_size <= 0xffffffffULL); /* offsets in entries are 32 bit */
 
-                    if (dist < min_dist) {
-                        min_dist = dist;
-                        min_dist_i = k;
-                    }
-                }
+    size         = update.header.file_size - start;
+    update.bytes = (lpc_u8 *)LPC_CONTEXT_ALLOC(context, size);
 
-                segments.data[i].table_k[j] = min_dist_i;
-            }
+    if (update.bytes == NULL) {
+        LPC_CONTEXT_FREE(context, items);
+        memset(&update, 0, sizeof(Lpc_Bank_Update));
+        return update;
+    }
 
-            /*
-            // K3-K7
-            */
-            for (j = 2; j < 7; j++) {
-                switch (j) {
-                    case 2:  k_table = k3_table; break;
-                    case 3:  k_table = k4_table; break;
-                    case 4:  k_table = k5_table; break;
-                    case 5:  k_table = k6_table; break;
-                    case 6:  k_table = k7_table; break;
-                    default: assert(false);      break;
-                }
+    update.count = (lpc_u32)size;
+    memset(update.bytes, 0, size);
 
+    for (i = 0; i < count; i++) {
+        const Lpc_Bank_Phrase *phrase;
 
-                min_dist   = fabsf(k_table[0] - k_params[j + 1]);
-                min_dist_i = 0;
+        item = &items[i];
+        memcpy(update.bytes + update.header.index_offset - start + i * sizeof(Lpc_Bank_Entry), &item->entry, sizeof(Lpc_Bank_Entry));
 
-                for (k = 1; k <= LPC_K3_K4_K5_K6_K7_MASK; k++) {
-                    dist = fabsf(k_table[k] - k_params[j + 1]);
+        if (item->phrase < 0) continue;
 
-                    if (dist < min_dist) {
-                        min_dist = dist;
-                        min_dist_i = k;
-                    }
-                }
+        phrase = &phrases[item->phrase];
 
-                segments.data[i].table_k[j] = min_dist_i;
-            }
+        memcpy(update.bytes + item->entry.name_offset - start, phrase->name, item->entry.name_size);
 
-            for (j = 7; j < 10; j++) {
-                switch (j) {
-                    case 7:  k_table = k8_table;  break;
-                    case 8:  k_table = k9_table;  break;
-                    case 9:  k_table = k10_table; break;
-                    default: assert(false);       break;
-                }
+        if (phrase->stream.count > 0) {
+            memcpy(update.bytes + item->entry.stream_offset - start, phrase->stream.bytes, phrase->stream.count);
+        }
+
+        if (item->entry.codes_offset) {
+            memcpy(update.bytes + item->entry.codes_offset - start, phrase->codes.code, sizeof(Lpc_Code) * phrase->codes.count);
+        }
+    }
 
-                min_dist   = fabsf(k_table[0] - k_params[j + 1]); 
-                min_dist_i = 0;
+    if (bank == NULL) {
+        memcpy(update.bytes, &update.header, sizeof(Lpc_Bank_Header));
+    }
 
-                for (k = 1; k <= LPC_K8_K9_K10_MASK; k++) {
-                    dist = fabsf(k_table[k] - k_params[j + 1]);
+    LPC_CONTEXT_FREE(context, items);
 
-                    if (dist < min_dist) {
-                        min_dist = dist;
-                        min_dist_i = k;
-                    }
-                }
+    return update;
+}
 
-                segments.data[i].table_k[j] = min_dist_i;
-            }
+LPC_API void lpc_bank_update_free(Lpc_Context *context, Lpc_Bank_Update *update) {
+    assert(update != NULL);
+
+    if (update->bytes) {
+        LPC_CONTEXT_FREE(context, update->bytes);
+    }
+
+    memset(update, 0, sizeof(Lpc_Bank_Update));
+}
+
+/*
+// ROM packing
+*/
+
+#define LPC_ROM_MAX_OVERLAP 64
+
+LPC_API lpc_s64 lpc_bytes_find_internal(lpc_u8 *haystack, lpc_u64 haystack_count, lpc_u8 *needle, lpc_u64 needle_count) {
+    lpc_u64 i;
+
+    if (needle_count == 0 || needle_count > haystack_count) {
+        return -1;
+    }
+
+    for (i = 0; i <= (haystack_count - needle_count); i++) {
+        if (haystack[i] != needle[0]) continue;
+
+        if (memcmp(haystack + i, needle, needle_count) == 0) {
+            return (lpc_s64)i;
         }
     }
 
-    codes = lpc_get_codes_from_segments_internal(segments);
+    return -1;
+}
+
+/* longest tail of a that is equal to the head of b */
+LPC_API lpc_u32 lpc_bytes_overlap_internal(lpc_u8 *a, lpc_u32 a_count, lpc_u8 *b, lpc_u32 b_count) {
+    lpc_u32 k, max;
 
-    LPC_FREE(buffer.samples);
-    LPC_FREE(pitch_buffer.samples);
-    LPC_FREE(segments.data);
+    max = LPC_MIN(a_count, b_count);
+    max = LPC_MIN(max, LPC_ROM_MAX_OVERLAP);
 
-    return codes;
+    for (k = max; k > 0; k--) {
+        if (memcmp(a + a_count - k, b, k) == 0) {
+            return k;
+        }
+    }
+
+    return 0;
 }
 
 /*
-// Decoding
+// @note: tms5220 reads phrase from it's start address until it finds stop frame,
+// there is no way to jump somewhere else. So the only way to share bytes between phrases
+// is to lay them out so they overlap:
+//
+//  - identical phrases get the same address,
+//  - phrase that is found inside of other phrase points into it (shared tails, like silence + stop),
+//  - phrase tail that is equal to head of other phrase is placed on top of each other.
+//
+// The last one is classic greedy shortest common superstring. @bonmas
 */
+LPC_API Lpc_TMS5220_Rom lpc_tms5220_rom_build(Lpc_Context *context, Lpc_TMS5220_Buffer *phrases, lpc_u32 phrase_count, lpc_u32 rom_size) {
+    Lpc_TMS5220_Rom rom;
+    lpc_u32 *parent, *parent_offset, *next, *prev, *order;
+    lpc_u8  *overlaps;
+    lpc_u32 i, j, k, best, best_i, best_j, offset, tmp;
+    lpc_s64 found;
 
-Lpc_Sample_Buffer lpc_decode(Lpc_Codes codes) {
-    lpc_u64 i = 0, j = 0, sample_counter = 0, phase_counter = 0, code_index = 0;
-    lpc_f32 in, t, max = FLT_MIN, min = FLT_MAX;
-    Lpc_Synth previous, target, current;
-    Lpc_Sample_Buffer buffer;
-    Lpc_Code curr_code;
-    lpc_f32 forward[10], backward[10];
-    lpc_u32 noise = 1;
-    lpc_b32 repeat;
-
-    memset(forward,   0, sizeof(forward));
-    memset(backward,  0, sizeof(backward));
-    memset(&previous, 0, sizeof(Lpc_Synth));
-    memset(&target,   0, sizeof(Lpc_Synth));
-    memset(&current,  0, sizeof(Lpc_Synth));
+    memset(&rom, 0, sizeof(Lpc_TMS5220_Rom));
 
-    buffer.sample_rate = LPC_SAMPLE_RATE;
-    buffer.channels    = 1;
-    buffer.frame_count = codes.count * LPC_SAMPLES;
-    buffer.samples     = (lpc_f32*)LPC_ALLOC(sizeof(lpc_f32) * buffer.frame_count);
+    if (phrase_count == 0) {
+        return rom;
+    }
 
-    if (buffer.samples == NULL) {
-        memset(&buffer, 0, sizeof(Lpc_Sample_Buffer));
-        return buffer;
+    assert(phrases != NULL);
+
+    rom.phrase_count = phrase_count;
+    rom.offsets      = (lpc_u32 *)LPC_CONTEXT_ALLOC(context, sizeof(lpc_u32) * phrase_count);
+
+    parent        = (lpc_u32 *)LPC_CONTEXT_ALLOC(context, sizeof(lpc_u32) * phrase_count);
+    parent_offset = (lpc_u32 *)LPC_CONTEXT_ALLOC(context, sizeof(lpc_u32) * phrase_count);
+    next          = (lpc_u32 *)LPC_CONTEXT_ALLOC(context, sizeof(lpc_u32) * phrase_count);
+    prev          = (lpc_u32 *)LPC_CONTEXT_ALLOC(context, sizeof(lpc_u32) * phrase_count);
+    order         = (lpc_u32 *)LPC_CONTEXT_ALLOC(context, sizeof(lpc_u32) * phrase_count);
+    overlaps      = (lpc_u8  *)LPC_CONTEXT_ALLOC(context, sizeof(lpc_u8)  * phrase_count * phrase_count);
+
+    assert(rom.offsets   != NULL); /* @todo, proper recovery from memory allocation errors */
+    assert(parent        != NULL);
+    assert(parent_offset != NULL);
+    assert(next          != NULL);
+    assert(prev          != NULL);
+    assert(order         != NULL);
+    assert(overlaps      != NULL);
+
+    /* longest phrases first, so shorter ones can be found inside of them */
+    for (i = 0; i < phrase_count; i++) {
+        order[i] = i;
     }
 
-    while (true) {
-        if (code_index >= codes.count) {
-            break;
+    for (i = 1; i < phrase_count; i++) {
+        tmp = order[i];
+
+        for (j = i; j > 0 && phrases[order[j - 1]].count < phrases[tmp].count; j--) {
+            order[j] = order[j - 1];
         }
 
-        curr_code = lpc_code_clamp(codes.code[code_index++]);
+        order[j] = tmp;
+    }
 
-        if (curr_code.energy == LPC_ENERGY_STOP) {
-            break;
-        } else if (curr_code.energy == LPC_ENERGY_ZERO) {
-            target.energy = 0;
-        } else {
-            target.energy = energy_table[curr_code.energy];
-            repeat = curr_code.repeat;
-            target.pitch  = pitch_table[curr_code.pitch];
-
-            if (!repeat) {
-                target.k[0] = k1_table[curr_code.k1];
-                target.k[1] = k2_table[curr_code.k2];
-                target.k[2] = k3_table[curr_code.k3];
-                target.k[3] = k4_table[curr_code.k4];
-
-                if (target.pitch) {
-                    target.k[4] = k5_table[curr_code.k5];
-                    target.k[5] = k6_table[curr_code.k6];
-                    target.k[6] = k7_table[curr_code.k7];
-                    target.k[7] = k8_table[curr_code.k8];
-                    target.k[8] = k9_table[curr_code.k9];
-                    target.k[9] = k10_table[curr_code.k10];
-                } else {
-                    target.k[4] = 0;
-                    target.k[5] = 0;
-                    target.k[6] = 0;
-                    target.k[7] = 0;
-                    target.k[8] = 0;
-                    target.k[9] = 0;
-                }
+    for (i = 0; i < phrase_count; i++) {
+        k = order[i];
+
+        parent[k]        = k;
+        parent_offset[k] = 0;
+        next[k]          = phrase_count;
+        prev[k]          = phrase_count;
+
+        for (j = 0; j < i; j++) {
+            if (parent[order[j]] != order[j]) continue;
+
+            found = lpc_bytes_find_internal(phrases[order[j]].bytes, phrases[order[j]].count, phrases[k].bytes, phrases[k].count);
+
+            if (found >= 0) {
+                parent[k]        = order[j];
+                parent_offset[k] = (lpc_u32)found;
+                break;
             }
         }
+    }
 
-        if (code_index == 0) {
-            previous = current = target;
-        } else {
-            previous = current;
+    for (i = 0; i < phrase_count; i++) {
+        for (j = 0; j < phrase_count; j++) {
+            if (i == j || parent[i] != i || parent[j] != j) {
+                overlaps[i * phrase_count + j] = 0;
+                continue;
+            }
+
+            overlaps[i * phrase_count + j] = (lpc_u8)lpc_bytes_overlap_internal(phrases[i].bytes, phrases[i].count, phrases[j].bytes, phrases[j].count);
         }
+    }
 
-        for (i = 0; i < LPC_SAMPLES; i++) {
-            t = ((lpc_f32)i / (lpc_f32)(LPC_SAMPLES - 1));
+    /* greedy merge of the phrases that are left */
+    while (true) {
+        best = 0;
+        best_i = best_j = phrase_count;
 
-            current.energy = lpc_lerpf(previous.energy, target.energy, t);
-            current.pitch  = (lpc_u32)lpc_lerpf((lpc_f32)previous.pitch, (lpc_f32)target.pitch, t);
+        for (i = 0; i < phrase_count; i++) {
+            if (parent[i] != i || next[i] != phrase_count) continue;
 
-            for (j = 0; j < 10; j++) {
-                current.k[j] = lpc_lerpf(previous.k[j], target.k[j], t);
-            }
+            for (j = 0; j < phrase_count; j++) {
+                if (prev[j] != phrase_count) continue;
+                if (overlaps[i * phrase_count + j] <= best) continue;
 
-            if (current.energy == 0) {
-                in = 0;
-            } else if (current.pitch > 0) {
-                if (phase_counter < current.pitch) {
-                    phase_counter++;
-                } else {
-                    phase_counter = 0;
-                }
+                /* don't close the chain into a loop */
+                for (k = i; prev[k] != phrase_count; k = prev[k]);
+                if (k == j) continue;
 
-                if (phase_counter < LPC_CHIRP_TABLE_SIZE) {
-                    in = chirp_table[phase_counter] * current.energy;
-                } else {
-                    in = 0;
-                }
-            } else {
-                noise = (noise >> 1) ^ (noise & 1 ? 0xBD00 : 0);
-                in = noise & 1 ? (lpc_f32)(current.energy) : -((lpc_f32)current.energy);
+                best   = overlaps[i * phrase_count + j];
+                best_i = i;
+                best_j = j;
             }
-
-            forward[9] = in         - current.k[9] * backward[9];
-            forward[8] = forward[9] - current.k[8] * backward[8];
-            forward[7] = forward[8] - current.k[7] * backward[7];
-            forward[6] = forward[7] - current.k[6] * backward[6];
-            forward[5] = forward[6] - current.k[5] * backward[5];
-            forward[4] = forward[5] - current.k[4] * backward[4];
-            forward[3] = forward[4] - current.k[3] * backward[3];
-            forward[2] = forward[3] - current.k[2] * backward[2];
-            forward[1] = forward[2] - current.k[1] * backward[1];
-            forward[0] = forward[1] - current.k[0] * backward[0];
-
-            backward[9] = backward[8] + current.k[8] * forward[8];
-            backward[8] = backward[7] + current.k[7] * forward[7];
-            backward[7] = backward[6] + current.k[6] * forward[6];
-            backward[6] = backward[5] + current.k[5] * forward[5];
-            backward[5] = backward[4] + current.k[4] * forward[4];
-            backward[4] = backward[3] + current.k[3] * forward[3];
-            backward[3] = backward[2] + current.k[2] * forward[2];
-            backward[2] = backward[1] + current.k[1] * forward[1];
-            backward[1] = backward[0] + current.k[0] * forward[0];
-            backward[0] = forward[0];
-
-            assert(sample_counter < buffer.frame_count);
-            buffer.samples[sample_counter++] = forward[0];
         }
-    }
 
-    buffer.frame_count = sample_counter;
+        if (best == 0) break;
 
-    for (i = 0; i < buffer.frame_count; i++) {
-        if (buffer.samples[i] > max) max = buffer.samples[i];
-        if (buffer.samples[i] < min) min = buffer.samples[i];
+        next[best_i] = best_j;
+        prev[best_j] = best_i;
     }
 
-    for (i = 0; i < buffer.frame_count; i++) {
-        buffer.samples[i] = buffer.samples[i] / (max - min);
-    }
+    /* lay out chains */
+    offset = 0;
 
-    return buffer;
-}
+    for (i = 0; i < phrase_count; i++) {
+        if (parent[i] != i || prev[i] != phrase_count) continue;
 
+        for (k = i; k != phrase_count; k = next[k]) {
+            if (k != i) offset -= overlaps[prev[k] * phrase_count + k];
 
-LPC_API void lpc_tms5220_encode_bits_internal(Lpc_List *bits, lpc_u64 code) {
-    lpc_s64 stop_at = 0, i = LPC_START_BIT;
-    lpc_u8 energy, pitch;
-    lpc_u1 curr = 0;
+            rom.offsets[k] = offset;
+            offset += phrases[k].count;
+        }
+    }
 
-    energy = (code >> LPC_ENERGY_OFFSET) & LPC_ENERGY_MASK;
-    pitch  = (code >> LPC_PITCH_OFFSET)  & LPC_PITCH_MASK;
+    rom.used = offset;
 
-    if (stop_at == 0 && (energy == LPC_ENERGY_ZERO || energy == LPC_ENERGY_STOP)) {
-        stop_at = LPC_SIGNAL_BIT;
+    for (i = 0; i < phrase_count; i++) {
+        if (parent[i] != i) {
+            rom.offsets[i] = rom.offsets[parent[i]] + parent_offset[i];
+        }
     }
 
-    if (stop_at == 0 && pitch == 0) {
-        stop_at = LPC_UNVOICED_STOP_BIT;
+    if (rom.used <= rom_size) {
+        rom.count = rom_size;
+        rom.bytes = (lpc_u8 *)LPC_CONTEXT_ALLOC(context, sizeof(lpc_u8) * rom_size);
+        assert(rom.bytes != NULL); /* @todo, proper recovery from memory allocation errors */
+
+        for (i = 0; i < phrase_count; i++) {
+            if (parent[i] != i) continue;
+
+            memcpy(rom.bytes + rom.offsets[i], phrases[i].bytes, phrases[i].count);
+        }
     }
 
-    if (stop_at == 0 && code & (1LL << LPC_REPEAT_BIT)) {
-        stop_at = LPC_REPEAT_STOP_BIT;
+    LPC_CONTEXT_FREE(context, parent);
+    LPC_CONTEXT_FREE(context, parent_offset);
+    LPC_CONTEXT_FREE(context, next);
+    LPC_CONTEXT_FREE(context, prev);
+    LPC_CONTEXT_FREE(context, order);
+    LPC_CONTEXT_FREE(context, overlaps);
+
+    return rom;
+}
+
+LPC_API void lpc_tms5220_rom_free(Lpc_Context *context, Lpc_TMS5220_Rom *rom) {
+    assert(rom != NULL);
+
+    if (rom->bytes) {
+        LPC_CONTEXT_FREE(context, rom->bytes);
     }
 
-    while (i >= stop_at) {
-        curr = ((code & (1LL << i)) >> i);
-        lpc_list_append(bits, &curr);
-        i--;
+    if (rom->offsets) {
+        LPC_CONTEXT_FREE(context, rom->offsets);
     }
+
+    memset(rom, 0, sizeof(Lpc_TMS5220_Rom));
 }
 
-LPC_API Lpc_Bitcode_Info lpc_tms5220_decode_bits_internal(lpc_u1 *bits, lpc_u64 bits_count) {
+/*
+// ROM scanning
+*/
+
+/*
+// @note: random bits decode into frames too, and every 16th frame or so is a stop frame,
+// so almost every offset gives some run. Real speech changes slowly: energy goes up and down
+// by one or two steps and pitch stays around the same index, random frames jump all over
+// the tables. Runs that start inside a real phrase end at it's stop frame too, when they land
+// on frame boundary, and they often look more like speech than the whole phrase, because the
+// onset is the jumpy part. So when candidates end at the same bit the earliest one is kept,
+// and later one only takes it's place when everything before it is silent frames (zero
+// padding decodes into them too). @bonmas
+*/
+
+LPC_API lpc_b32 lpc_scan_jump_internal(lpc_u32 a, lpc_u32 b, lpc_u32 max_jump) {
+    return (a > b ? a - b : b - a) > max_jump;
+}
+
+LPC_API lpc_b32 lpc_tms5220_scan_offset(Lpc_TMS5220_Buffer buffer, lpc_u32 offset, Lpc_Scan_Settings settings, Lpc_TMS5220_Phrase *phrase) {
     Lpc_Bitcode_Info info;
-    lpc_s64 i = LPC_START_BIT;
-    lpc_u8 energy, pitch;
+    Lpc_Code code, last, last_full;
+    lpc_u64 bit_offset, bits_count;
+    lpc_u32 frame_count = 0, silent_count = 0;
+    lpc_u32 change_count = 0, jump_count = 0;
+    lpc_b32 has_full = false;
 
-    memset(&info, 0, sizeof(Lpc_Bitcode_Info));
+    assert(phrase != NULL);
+
+    memset(&last, 0, sizeof(Lpc_Code));
+    memset(&last_full, 0, sizeof(Lpc_Code));
+
+    bits_count = (lpc_u64)buffer.count * 8;
+    bit_offset = (lpc_u64)offset * 8;
 
     while (true) {
-        if (info.bits_count >= bits_count) {
-            info.not_enough_bits = true;
-            break;
-        }
+        if (frame_count >= settings.max_frames) return false;
 
-        info.code |= (lpc_u64)bits[info.bits_count++] << i;
+        info = lpc_tms5220_read_frame_internal(buffer.bytes, bits_count, bit_offset);
+        if (info.not_enough_bits) return false;
 
-        if (i == 0) break;
+        code        = lpc_convert_from_bitcode_internal(info.code);
+        bit_offset += info.bits_count;
 
-        if (i == LPC_ENERGY_OFFSET) {
-            energy = (info.code >> LPC_ENERGY_OFFSET) & LPC_ENERGY_MASK;
-            if (energy == LPC_ENERGY_ZERO || energy == LPC_ENERGY_STOP) {
-                break;
+        if (code.energy == LPC_ENERGY_STOP) break;
+
+        /* repeat needs Ks from the frame before, phrase can't start with it */
+        if (frame_count == 0 && code.repeat) return false;
+
+        if (code.energy == LPC_ENERGY_ZERO) {
+            silent_count++;
+            last = code;
+            frame_count++;
+            continue;
+        }
+
+        if (frame_count > 0 && last.energy != LPC_ENERGY_ZERO) {
+            jump_count += lpc_scan_jump_internal(code.energy, last.energy, settings.max_energy_jump);
+            change_count++;
+
+            if (code.pitch > 0 && last.pitch > 0) {
+                jump_count += lpc_scan_jump_internal(code.pitch, last.pitch, settings.max_pitch_jump);
+                change_count++;
             }
         }
 
-        if (i <= LPC_PITCH_OFFSET) {
-            pitch  = (info.code >> LPC_PITCH_OFFSET) & LPC_PITCH_MASK;
-            if (pitch == 0 && i == LPC_K4_OFFSET) {
-                break;
+        if (!code.repeat) {
+            if (has_full) {
+                jump_count += lpc_scan_jump_internal(code.k1, last_full.k1, settings.max_k_jump);
+                jump_count += lpc_scan_jump_internal(code.k2, last_full.k2, settings.max_k_jump);
+                change_count += 2;
             }
+
+            last_full = code;
+            has_full  = true;
         }
 
-        i--;
+        last = code;
+        frame_count++;
     }
 
-    return info;
+    if (frame_count < settings.min_frames) return false;
+    if ((lpc_f32)silent_count > (lpc_f32)frame_count * settings.max_silent_ratio) return false;
+    if ((lpc_f32)jump_count   > (lpc_f32)change_count * settings.max_jump_ratio)  return false;
+
+    /* mostly silent runs don't tell much, random bits can pass with few changes */
+    if (change_count < settings.min_frames) return false;
+
+    phrase->offset       = offset;
+    phrase->bits_count   = (lpc_u32)(bit_offset - (lpc_u64)offset * 8);
+    phrase->frame_count  = frame_count;
+    phrase->silent_count = silent_count;
+    phrase->score        = change_count > 0 ? (lpc_f32)jump_count / (lpc_f32)change_count : 0.0f;
+
+    return true;
 }
 
-LPC_API void lpc_tms5220_squash_bits_internal(lpc_u8 *bytes, lpc_u64 bytes_count, lpc_u1 *bits, lpc_u64 bits_count) {
-    lpc_u64 i, j = 0;
-    
-    LPC_UNUSED(bytes_count);
+LPC_API Lpc_TMS5220_Scan lpc_tms5220_scan(Lpc_Context *context, Lpc_TMS5220_Buffer buffer, lpc_u32 first, lpc_u32 last, Lpc_Scan_Settings settings) {
+    Lpc_TMS5220_Scan scan;
+    Lpc_TMS5220_Phrase phrase;
+    Lpc_List phrases;
+    lpc_u32 offset;
 
-    assert((bytes_count * 8) == bits_count);
+    memset(&scan, 0, sizeof(Lpc_TMS5220_Scan));
 
-    for (i = 0; i < bits_count; i++) {
-        if ((i % 8) == 0) {
-            j++;
-        }
+    if (last > buffer.count) last = buffer.count;
+    if (first >= last) return scan;
+
+    phrases = lpc_list_create(context, 64, sizeof(Lpc_TMS5220_Phrase));
+    if (phrases.data == NULL) return scan;
 
-        bytes[j - 1] |= bits[i] <<  (i % 8);
+    for (offset = first; offset < last; offset++) {
+        if (lpc_tms5220_scan_offset(buffer, offset, settings, &phrase)) {
+            lpc_list_append(&phrases, &phrase);
+        }
     }
+
+    scan.count   = (lpc_u32)phrases.count;
+    scan.phrases = (Lpc_TMS5220_Phrase *)phrases.data;
+
+    return scan;
 }
 
-LPC_API void lpc_tms5220_unsquash_bits_internal(lpc_u1 *cont, lpc_u64 cont_count, lpc_u8 *from, lpc_u64 from_count) {
-    lpc_u64 i, j, k = 0;
-    lpc_u1 bit;
+/* true if frames from start up to offset are silent and offset is on frame boundary */
+LPC_API lpc_b32 lpc_scan_silent_until_internal(Lpc_TMS5220_Buffer buffer, lpc_u64 bit_offset, lpc_u64 end) {
+    Lpc_Bitcode_Info info;
+    lpc_u64 bits_count;
 
-    LPC_UNUSED(cont_count);
+    bits_count = (lpc_u64)buffer.count * 8;
 
-    assert(cont_count == (from_count * 8));
-    
-    for (i = 0; i < from_count; i++) {
-        for (j = 0; j < 8; j++) {
-            bit = (from[i] >> j) & 1;
+    while (bit_offset < end) {
+        info = lpc_tms5220_read_frame_internal(buffer.bytes, bits_count, bit_offset);
+        if (info.not_enough_bits) return false;
 
-            assert(k < cont_count);
-            cont[k++] = bit;
-        }
+        if (lpc_convert_from_bitcode_internal(info.code).energy != LPC_ENERGY_ZERO) return false;
+
+        bit_offset += info.bits_count;
     }
+
+    return bit_offset == end;
 }
 
-LPC_API Lpc_TMS5220_Buffer lpc_tms5220_encode(Lpc_Codes codes) {
-    Lpc_TMS5220_Buffer buff;
-    Lpc_List bits;
-    lpc_u64 i;
+LPC_API Lpc_TMS5220_Scan lpc_tms5220_scan_merge(Lpc_Context *context, Lpc_TMS5220_Buffer buffer, Lpc_TMS5220_Scan *scans, lpc_u32 scan_count) {
+    Lpc_TMS5220_Scan result;
+    Lpc_TMS5220_Phrase *phrase, *accepted;
+    lpc_u64 total = 0, end, accepted_end;
+    lpc_u32 i, j;
 
-    bits = lpc_list_create(codes.count * LPC_BIT_FRAME_SIZE, sizeof(lpc_u1));
+    memset(&result, 0, sizeof(Lpc_TMS5220_Scan));
 
-    for (i = 0; i < codes.count; i++) {
-        lpc_tms5220_encode_bits_internal(&bits, lpc_convert_to_bitcode_internal(lpc_code_clamp(codes.code[i])));
+    for (i = 0; i < scan_count; i++) {
+        total += scans[i].count;
     }
 
-    buff.count = bits.count / 8;
+    if (total == 0) return result;
 
-    if (bits.count != (buff.count * 8)) {
-        /* we need to shift last bits on amount of bits */
-        i = bits.count - buff.count * 8;
-        bits.count -= i;
-    }
+    result.phrases = (Lpc_TMS5220_Phrase *)LPC_CONTEXT_ALLOC(context, sizeof(Lpc_TMS5220_Phrase) * total);
+    assert(result.phrases != NULL); /* @todo, proper recovery from memory allocation errors */
 
-    buff.bytes = (lpc_u8*)LPC_ALLOC(sizeof(lpc_u8) * buff.count);
-    assert(buff.bytes != NULL); /* @todo, proper recovery from memory allocation errors */
-    
-    lpc_tms5220_squash_bits_internal(buff.bytes, buff.count, (lpc_u1*) bits.data, bits.count);
-    lpc_list_destroy(&bits);
+    for (i = 0; i < scan_count; i++) {
+        for (j = 0; j < scans[i].count; j++) {
+            phrase = &scans[i].phrases[j];
+            end    = (lpc_u64)phrase->offset * 8 + phrase->bits_count;
 
-    return buff;
-}
+            if (result.count == 0) {
+                result.phrases[result.count++] = *phrase;
+                continue;
+            }
 
-LPC_API Lpc_Codes lpc_tms5220_decode(Lpc_TMS5220_Buffer buffer) {
-    Lpc_List codes;
-    Lpc_Code code;
-    Lpc_Bitcode_Info info;
-    lpc_u1 *bits = NULL;
-    lpc_u64 i = 0;
+            accepted     = &result.phrases[result.count - 1];
+            accepted_end = (lpc_u64)accepted->offset * 8 + accepted->bits_count;
 
-    codes = lpc_list_create(buffer.count * (LPC_BIT_FRAME_SIZE / 8), sizeof(Lpc_Code));
-    bits  = (lpc_u1*)LPC_ALLOC(buffer.count * 8);
+            if ((lpc_u64)phrase->offset * 8 >= accepted_end) {
+                result.phrases[result.count++] = *phrase;
+            } else if (end == accepted_end) {
+                /* same stop frame, only silence or zero padding in front is dropped */
+                if (lpc_scan_silent_until_internal(buffer, (lpc_u64)accepted->offset * 8, (lpc_u64)phrase->offset * 8)) {
+                    *accepted = *phrase;
+                }
+            }
+        }
+    }
 
-    assert(bits != NULL); /* @todo, proper recovery from memory allocation errors */
+    return result;
+}
 
-    lpc_tms5220_unsquash_bits_internal(bits, buffer.count * 8, (lpc_u8*)buffer.bytes, buffer.count);
+LPC_API void lpc_tms5220_scan_free(Lpc_Context *context, Lpc_TMS5220_Scan *scan) {
+    assert(scan != NULL);
 
-    while (i < (buffer.count * 8)) {
-        info = lpc_tms5220_decode_bits_internal(bits + i, (buffer.count * 8) - i);
-        code = lpc_convert_from_bitcode_internal(info.code);
-        lpc_list_append(&codes, &code);
-        i += info.bits_count;
+    if (scan->phrases) {
+        LPC_CONTEXT_FREE(context, scan->phrases);
     }
 
-    LPC_FREE(bits);
+    memset(scan, 0, sizeof(Lpc_TMS5220_Scan));
+}
+
+LPC_API Lpc_TMS5220_Buffer lpc_tms5220_phrase_buffer(Lpc_TMS5220_Buffer dump, Lpc_TMS5220_Phrase phrase) {
+    Lpc_TMS5220_Buffer buffer;
 
-    return CLITERAL(Lpc_Codes) { (lpc_u32)codes.count, (Lpc_Code *)codes.data };
+    assert(phrase.offset < dump.count);
+
+    buffer.bytes = dump.bytes + phrase.offset;
+    buffer.count = (phrase.bits_count + 7) / 8;
+
+    if (buffer.count > dump.count - phrase.offset) {
+        buffer.count = dump.count - phrase.offset;
+    }
+
+    return buffer;
 }
 
-LPC_API Lpc_List lpc_list_create(lpc_u64 init_size, lpc_u64 element_size) {
+LPC_API Lpc_List lpc_list_create(Lpc_Context *context, lpc_u64 init_size, lpc_u64 element_size) {
     Lpc_List list;
 
     memset(&list, 0, sizeof(Lpc_List));
 
-    list.data = LPC_ALLOC(init_size * element_size);
+    list.context = context;
+    list.data    = LPC_CONTEXT_ALLOC(context, init_size * element_size);
     if (list.data == NULL) return list;
 
     list.capacity = init_size; 
@@ -1394,7 +4849,7 @@ LPC_API Lpc_List lpc_list_create(lpc_u64 init_size, lpc_u64 element_size) {
 LPC_API void lpc_list_destroy(Lpc_List *list) {
     assert(list->data != NULL);
 
-    LPC_FREE(list->data);
+    LPC_CONTEXT_FREE(list->context, list->data);
 
     memset(list, 0, sizeof(Lpc_List));
 }
@@ -1416,11 +4871,11 @@ LPC_API lpc_b32 lpc_list_append(Lpc_List *list, void *data) {
     if ((list->count + 1) >= list->capacity) {
         size = list->capacity * 2;
 
-        p = LPC_ALLOC(list->element_size * size);
+        p = LPC_CONTEXT_ALLOC(list->context, list->element_size * size);
         if (p == NULL) return false;
 
         memcpy(p, list->data, list->element_size * list->capacity);
-        LPC_FREE(list->data);
+        LPC_CONTEXT_FREE(list->context, list->data);
 
         list->capacity = size;
         list->data = p;
@@ -1435,31 +4890,41 @@ LPC_API lpc_b32 lpc_list_append(Lpc_List *list, void *data) {
 }
 
 
-LPC_API void lpc_codes_free(Lpc_Codes *codes) {
+LPC_API void lpc_codes_free(Lpc_Context *context, Lpc_Codes *codes) {
     assert(codes != NULL);
 
     if (codes->code) {
-        LPC_FREE(codes->code);
+        LPC_CONTEXT_FREE(context, codes->code);
     }
 
     memset(codes, 0, sizeof(Lpc_Codes));
 }
 
-LPC_API void lpc_buffer_free(Lpc_Sample_Buffer *buffer) {
+LPC_API void lpc_bitcodes_free(Lpc_Context *context, Lpc_Bitcodes *bitcodes) {
+    assert(bitcodes != NULL);
+
+    if (bitcodes->code) {
+        LPC_CONTEXT_FREE(context, bitcodes->code);
+    }
+
+    memset(bitcodes, 0, sizeof(Lpc_Bitcodes));
+}
+
+LPC_API void lpc_buffer_free(Lpc_Context *context, Lpc_Sample_Buffer *buffer) {
     assert(buffer != NULL);
 
     if (buffer->samples) {
-        LPC_FREE(buffer->samples);
+        LPC_CONTEXT_FREE(context, buffer->samples);
     }
 
     memset(buffer, 0, sizeof(Lpc_Sample_Buffer));
 }
 
-LPC_API void lpc_tms5220_buffer_free(Lpc_TMS5220_Buffer *buffer) {
+LPC_API void lpc_tms5220_buffer_free(Lpc_Context *context, Lpc_TMS5220_Buffer *buffer) {
     assert(buffer != NULL);
 
     if (buffer->bytes) {
-        LPC_FREE(buffer->bytes);
+        LPC_CONTEXT_FREE(context, buffer->bytes);
     }
 
     memset(buffer, 0, sizeof(Lpc_TMS5220_Buffer));
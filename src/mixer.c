@@ -0,0 +1,696 @@
+// Mixer of LPC phrases for playback at runtime: fixed number of voices, each with it's own
+// decoder, gain and pan, mixed into a stereo float AudioStream. Rate of the stream is given to
+// mixer_init and should be the rate of the device (MIXER_SAMPLE_RATE by default), then raylib
+// passes the stream as it is. Frames are synthesized straight at that rate, there is no 8 kHz
+// copy of the phrase that is converted later.
+//
+// Phrases are rendered on the first play and kept in int16 PCM cache at the rate of the mixer
+// under the memory budget, least recently used ones are evicted. Voice that plays phrase without
+// cache renders it frame by frame into a new cache entry as it goes, so no callback renders a
+// whole phrase and cost of the callback is at most one synthesized frame per voice per 25 ms
+// plus the mix.
+// With MIXER_VOICE_COUNT voices that's bounded no matter how many sounds are requested:
+// when every voice is busy the oldest one is taken.
+//
+// Phrases of a mapped Lpc_Bank are played in place with mixer_bank_play, their codes are not
+// copied, so the bank stays mapped until mixer_bank_remove.
+//
+// Everything that allocates or frees runs on the calling thread under the lock,
+// audio thread only renders and mixes.
+
+#define MIXER_VOICE_COUNT   16
+#define MIXER_SAMPLE_RATE   48000 // rate of most devices, used when no rate is given
+#define MIXER_MAX_RATE      96000
+#define MIXER_BLOCK_MS      32
+#define MIXER_CACHE_BUDGET  MB(32) // about 5 minutes of speech at 48 kHz
+#define MIXER_VOICE_OUTPUT  (LPC_SAMPLES * MIXER_MAX_RATE / LPC_SAMPLE_RATE + 1) // one frame at MIXER_MAX_RATE
+
+typedef struct {
+    b32       used;
+    Lpc_Codes codes;       // without stop frame
+    f32       scale;       // same normalization as lpc_decode
+    b32       borrowed;    // codes point into memory of the caller, they are not freed
+    const void *key;       // bank entry the phrase was added for, NULL otherwise
+
+    s16      *pcm;         // cache entry at rate of the mixer, scaled, NULL when it's not cached
+    u32       pcm_count;   // samples rendered into it
+    u32       pcm_frames;  // frames of the phrase rendered into it
+    b32       complete;
+    b32       filling;     // voice renders into it right now
+    u32       readers;     // voices that read from it, entry can't be evicted
+    u64       last_used;
+} Mixer_Phrase;
+
+typedef struct {
+    b32 active;
+    u32 generation;        // stale voice handles don't touch the next sound
+    u64 serial;            // order of start, oldest voice is taken first
+    u32 phrase;
+
+    f32 left, right;
+    u32 position;          // next sample of the cache entry
+    u32 frame;             // next frame of the phrase to render
+    b32 reading;           // reads from cache of the phrase
+    b32 filling;           // renders into cache of the phrase
+
+    Lpc_Decoder         decoder;
+    Lpc_Resampler_State resampler;
+
+    f32 output[MIXER_VOICE_OUTPUT]; // frame rendered without cache, at rate of the mixer
+    u32 output_count;
+    u32 output_read;
+} Mixer_Voice;
+
+typedef struct {
+    Allocator    allocator;
+    Lpc_Context *context;
+    mtx_t        lock;
+
+    u32           phrase_count;
+    Mixer_Phrase *phrases;
+
+    u64 cache_budget;
+    u64 cache_used;
+    u64 tick;
+
+    Mixer_Voice   voices[MIXER_VOICE_COUNT];
+    Lpc_Resampler resampler; // from LPC_SAMPLE_RATE to rate of the stream, filter is NULL if it failed
+
+    AudioStream stream;
+    b32         streaming;
+} Mixer;
+
+// raylib's callback has no user data, so only one mixer can own the stream
+Mixer *mixer_stream_owner;
+
+// sample_rate is rate of the stream, 0 for MIXER_SAMPLE_RATE
+void mixer_init(Mixer *mixer, Allocator allocator, Lpc_Context *context, u64 cache_budget, u32 sample_rate) {
+    memset(mixer, 0, sizeof(Mixer));
+
+    mixer->allocator    = allocator;
+    mixer->context      = context;
+    mixer->cache_budget = cache_budget;
+
+    if (sample_rate == 0) sample_rate = MIXER_SAMPLE_RATE;
+
+    if (!lpc_resampler_init(context, &mixer->resampler, sample_rate)) {
+        ERRLOG("Mixer: failed to make resampler for %u Hz.", sample_rate);
+    } else if (lpc_resampler_max_output(&mixer->resampler, LPC_SAMPLES) > MIXER_VOICE_OUTPUT) {
+        ERRLOG("Mixer: %u Hz is above %u Hz, frame doesn't fit into voice output.", sample_rate, MIXER_MAX_RATE);
+        lpc_resampler_free(context, &mixer->resampler);
+    }
+
+    mtx_init(&mixer->lock, mtx_plain);
+}
+
+/// Cache
+
+// upper bound, count of samples from the resampler depends on where it is between input samples
+u64 mixer_phrase_bytes(Mixer *mixer, Mixer_Phrase *phrase) {
+    return (u64)lpc_resampler_max_output(&mixer->resampler, phrase->codes.count * LPC_SAMPLES) * sizeof(s16);
+}
+
+void mixer_cache_drop(Mixer *mixer, Mixer_Phrase *phrase) {
+    if (phrase->pcm == NULL) return;
+
+    assert(phrase->readers == 0);
+
+    mem_free(mixer->allocator, phrase->pcm);
+    mixer->cache_used -= mixer_phrase_bytes(mixer, phrase);
+
+    phrase->pcm        = NULL;
+    phrase->pcm_count  = 0;
+    phrase->pcm_frames = 0;
+    phrase->complete   = false;
+    phrase->filling    = false;
+}
+
+// evicts least recently used entries until size fits, false if it can't fit
+b32 mixer_cache_reserve(Mixer *mixer, u64 size) {
+    Mixer_Phrase *phrase, *oldest;
+    u32 i;
+
+    if (size > mixer->cache_budget) return false;
+
+    while (mixer->cache_used + size > mixer->cache_budget) {
+        oldest = NULL;
+
+        for (i = 0; i < mixer->phrase_count; i++) {
+            phrase = &mixer->phrases[i];
+
+            if (phrase->pcm == NULL || phrase->readers > 0) continue;
+            if (oldest == NULL || phrase->last_used < oldest->last_used) oldest = phrase;
+        }
+
+        if (oldest == NULL) return false;
+
+        mixer_cache_drop(mixer, oldest);
+    }
+
+    return true;
+}
+
+// empty entry that will be filled by a voice
+b32 mixer_cache_create(Mixer *mixer, Mixer_Phrase *phrase) {
+    u64 size;
+
+    if (mixer->resampler.filter == NULL) return false;
+
+    size = mixer_phrase_bytes(mixer, phrase);
+
+    if (!mixer_cache_reserve(mixer, size)) return false;
+
+    phrase->pcm        = (s16*)mem_alloc(mixer->allocator, size);
+    phrase->pcm_count  = 0;
+    phrase->pcm_frames = 0;
+    phrase->complete   = false;
+    phrase->filling    = false;
+
+    mixer->cache_used += size;
+
+    return true;
+}
+
+/// Phrases
+
+// count of codes before stop frame
+u32 mixer_codes_length(Lpc_Codes codes) {
+    u32 count;
+
+    for (count = 0; count < codes.count; count++) {
+        if (lpc_code_clamp(codes.code[count]).energy == LPC_ENERGY_STOP) break;
+    }
+
+    return count;
+}
+
+// puts phrase into a free slot, returns phrase id
+u32 mixer_phrase_insert(Mixer *mixer, Mixer_Phrase *phrase) {
+    u32 index;
+
+    mtx_lock(&mixer->lock);
+
+    for (index = 0; index < mixer->phrase_count; index++) {
+        if (!mixer->phrases[index].used) break;
+    }
+
+    if (index == mixer->phrase_count) {
+        mixer->phrases = (Mixer_Phrase*)mem_realloc(mixer->allocator, mixer->phrases, sizeof(Mixer_Phrase) * (mixer->phrase_count + 1));
+        mixer->phrase_count++;
+    }
+
+    phrase->last_used      = mixer->tick++;
+    mixer->phrases[index]  = *phrase;
+
+    mtx_unlock(&mixer->lock);
+
+    return index + 1;
+}
+
+// same normalization as lpc_decode, frames are rendered at LPC_SAMPLE_RATE and thrown away
+f32 mixer_codes_scale(Lpc_Context *context, Lpc_Codes codes) {
+    Lpc_Decoder decoder;
+    f32 block[LPC_SAMPLES], min = 0, max = 0;
+    u32 i, j;
+
+    lpc_decoder_init(context, &decoder);
+
+    for (i = 0; i < codes.count; i++) {
+        lpc_decoder_render_frame(&decoder, codes.code[i], block);
+
+        for (j = 0; j < LPC_SAMPLES; j++) {
+            if (block[j] > max) max = block[j];
+            if (block[j] < min) min = block[j];
+        }
+    }
+
+    return max > min ? 1.0f / (max - min) : 1.0f;
+}
+
+// codes are copied and rendered into cache when it fits, returns phrase id, 0 on failure
+u32 mixer_phrase_add(Mixer *mixer, Lpc_Codes codes) {
+    Mixer_Phrase phrase;
+    Lpc_Decoder decoder;
+    Lpc_Resampler_State resampler;
+    b32 cached;
+    u32 i, count;
+
+    count = mixer_codes_length(codes);
+
+    if (count == 0) return 0;
+
+    memset(&phrase, 0, sizeof(Mixer_Phrase));
+    phrase.used        = true;
+    phrase.codes.count = count;
+    phrase.codes.code  = (Lpc_Code*)mem_alloc(mixer->allocator, sizeof(Lpc_Code) * count);
+    memcpy(phrase.codes.code, codes.code, sizeof(Lpc_Code) * count);
+
+    phrase.scale = mixer_codes_scale(mixer->context, phrase.codes);
+
+    mtx_lock(&mixer->lock);
+    cached = mixer_cache_create(mixer, &phrase);
+    mtx_unlock(&mixer->lock);
+
+    // phrase isn't in the list yet, so nobody else sees the entry
+    if (cached) {
+        lpc_decoder_init(mixer->context, &decoder);
+        memset(&resampler, 0, sizeof(Lpc_Resampler_State));
+
+        for (i = 0; i < count; i++) {
+            phrase.pcm_count += lpc_decoder_render_frame_s16(&decoder, &mixer->resampler, &resampler, phrase.codes.code[i], phrase.scale, phrase.pcm + phrase.pcm_count);
+        }
+
+        phrase.pcm_frames = count;
+        phrase.complete   = true;
+    }
+
+    return mixer_phrase_insert(mixer, &phrase);
+}
+
+// codes are not copied and must stay valid until the phrase is removed, nothing is cached here,
+// first voice that plays the phrase renders it. returns phrase id, 0 on failure
+u32 mixer_phrase_add_ref(Mixer *mixer, Lpc_Codes codes) {
+    Mixer_Phrase phrase;
+    u32 count;
+
+    count = mixer_codes_length(codes);
+
+    if (count == 0) return 0;
+
+    memset(&phrase, 0, sizeof(Mixer_Phrase));
+    phrase.used        = true;
+    phrase.borrowed    = true;
+    phrase.codes.count = count;
+    phrase.codes.code  = codes.code;
+    phrase.scale       = mixer_codes_scale(mixer->context, phrase.codes);
+
+    return mixer_phrase_insert(mixer, &phrase);
+}
+
+Mixer_Phrase *mixer_phrase_get(Mixer *mixer, u32 id) {
+    if (id == 0 || id > mixer->phrase_count) return NULL;
+    if (!mixer->phrases[id - 1].used)        return NULL;
+
+    return &mixer->phrases[id - 1];
+}
+
+/// Voices
+
+// caller holds the lock
+void mixer_voice_release(Mixer *mixer, Mixer_Voice *voice) {
+    Mixer_Phrase *phrase;
+
+    if (!voice->active) return;
+
+    phrase = &mixer->phrases[voice->phrase];
+
+    if (voice->reading) phrase->readers--;
+
+    // unfinished entry can't be continued without decoder state of this voice
+    if (voice->filling && !phrase->complete) {
+        mixer_cache_drop(mixer, phrase);
+    }
+
+    voice->active  = false;
+    voice->reading = false;
+    voice->filling = false;
+}
+
+// caller holds the lock, voice can be released only on calling thread
+void mixer_voice_finish(Mixer *mixer, Mixer_Voice *voice) {
+    Mixer_Phrase *phrase = &mixer->phrases[voice->phrase];
+
+    if (voice->filling) {
+        phrase->complete = true;
+        phrase->filling  = false;
+    }
+
+    if (voice->reading) phrase->readers--;
+
+    voice->active  = false;
+    voice->reading = false;
+    voice->filling = false;
+}
+
+void mixer_voice_pan(Mixer_Voice *voice, f32 gain, f32 pan) {
+    f32 angle;
+
+    // constant power, pan from -1 (left) to 1 (right)
+    pan   = Clamp(pan, -1.0f, 1.0f);
+    angle = (pan + 1.0f) * PI / 4.0f;
+
+    voice->left  = gain * cosf(angle);
+    voice->right = gain * sinf(angle);
+}
+
+Mixer_Voice *mixer_voice_get(Mixer *mixer, u32 handle) {
+    Mixer_Voice *voice;
+    u32 index = handle & 0xff;
+
+    if (handle == 0 || index >= MIXER_VOICE_COUNT) return NULL;
+
+    voice = &mixer->voices[index];
+
+    if (!voice->active || voice->generation != (handle >> 8)) return NULL;
+
+    return voice;
+}
+
+// returns voice handle, 0 if phrase doesn't exist
+u32 mixer_play(Mixer *mixer, u32 id, f32 gain, f32 pan) {
+    Mixer_Phrase *phrase;
+    Mixer_Voice *voice = NULL;
+    u32 i;
+
+    mtx_lock(&mixer->lock);
+
+    phrase = mixer_phrase_get(mixer, id);
+
+    if (phrase == NULL || mixer->resampler.filter == NULL) {
+        mtx_unlock(&mixer->lock);
+        return 0;
+    }
+
+    for (i = 0; i < MIXER_VOICE_COUNT; i++) {
+        if (!mixer->voices[i].active) {
+            voice = &mixer->voices[i];
+            break;
+        }
+
+        if (voice == NULL || mixer->voices[i].serial < voice->serial) {
+            voice = &mixer->voices[i];
+        }
+    }
+
+    mixer_voice_release(mixer, voice);
+
+    voice->active   = true;
+    voice->generation++;
+    voice->serial   = mixer->tick++;
+    voice->phrase   = id - 1;
+    voice->position = 0;
+    voice->frame    = 0;
+
+    voice->output_count = 0;
+    voice->output_read  = 0;
+    memset(&voice->resampler, 0, sizeof(Lpc_Resampler_State));
+
+    mixer_voice_pan(voice, gain, pan);
+    lpc_decoder_init(mixer->context, &voice->decoder);
+
+    phrase->last_used = voice->serial;
+
+    if (phrase->pcm == NULL) {
+        mixer_cache_create(mixer, phrase);
+    }
+
+    if (phrase->complete) {
+        voice->reading = true;
+    } else if (phrase->pcm != NULL && !phrase->filling) {
+        voice->reading = true;
+        voice->filling = true;
+        phrase->filling = true;
+    }
+
+    if (voice->reading) phrase->readers++;
+
+    mtx_unlock(&mixer->lock);
+
+    return (voice->generation << 8) | (u32)(voice - mixer->voices);
+}
+
+void mixer_voice_set(Mixer *mixer, u32 handle, f32 gain, f32 pan) {
+    Mixer_Voice *voice;
+
+    mtx_lock(&mixer->lock);
+
+    voice = mixer_voice_get(mixer, handle);
+    if (voice) mixer_voice_pan(voice, gain, pan);
+
+    mtx_unlock(&mixer->lock);
+}
+
+void mixer_voice_stop(Mixer *mixer, u32 handle) {
+    Mixer_Voice *voice;
+
+    mtx_lock(&mixer->lock);
+
+    voice = mixer_voice_get(mixer, handle);
+    if (voice) mixer_voice_release(mixer, voice);
+
+    mtx_unlock(&mixer->lock);
+}
+
+b32 mixer_voice_playing(Mixer *mixer, u32 handle) {
+    b32 result;
+
+    mtx_lock(&mixer->lock);
+    result = mixer_voice_get(mixer, handle) != NULL;
+    mtx_unlock(&mixer->lock);
+
+    return result;
+}
+
+void mixer_phrase_remove(Mixer *mixer, u32 id) {
+    Mixer_Phrase *phrase;
+    u32 i;
+
+    mtx_lock(&mixer->lock);
+
+    phrase = mixer_phrase_get(mixer, id);
+
+    if (phrase != NULL) {
+        for (i = 0; i < MIXER_VOICE_COUNT; i++) {
+            if (mixer->voices[i].active && mixer->voices[i].phrase == id - 1) {
+                mixer_voice_release(mixer, &mixer->voices[i]);
+            }
+        }
+
+        mixer_cache_drop(mixer, phrase);
+        if (!phrase->borrowed) mem_free(mixer->allocator, phrase->codes.code);
+        memset(phrase, 0, sizeof(Mixer_Phrase));
+    }
+
+    mtx_unlock(&mixer->lock);
+}
+
+/// Banks
+
+// phrase of the bank is added on the first play and used in place from then on,
+// bank without stored codes has the stream decoded into a copy. returns voice handle, 0 if there's no such phrase
+u32 mixer_bank_play(Mixer *mixer, Lpc_Bank bank, const char *name, f32 gain, f32 pan) {
+    const Lpc_Bank_Entry *key;
+    Lpc_TMS5220_Buffer stream;
+    Lpc_Codes codes;
+    s64 entry;
+    u32 i, id;
+
+    entry = lpc_bank_find(bank, name);
+
+    if (entry < 0) return 0;
+
+    key = &bank.entries[entry];
+    id  = 0;
+
+    for (i = 0; i < mixer->phrase_count; i++) {
+        if (mixer->phrases[i].used && mixer->phrases[i].key == key) {
+            id = i + 1;
+            break;
+        }
+    }
+
+    if (id == 0) {
+        codes = lpc_bank_codes(bank, (u32)entry);
+
+        if (codes.count > 0) {
+            id = mixer_phrase_add_ref(mixer, codes);
+        } else {
+            stream = lpc_bank_stream(bank, (u32)entry);
+            if (stream.count == 0) return 0;
+
+            codes = lpc_tms5220_decode(mixer->context, stream);
+            id    = mixer_phrase_add(mixer, codes);
+            lpc_codes_free(mixer->context, &codes);
+        }
+
+        if (id == 0) return 0;
+
+        mixer->phrases[id - 1].key = key;
+    }
+
+    return mixer_play(mixer, id, gain, pan);
+}
+
+// phrases that point into the bank are removed, after that it can be unmapped
+void mixer_bank_remove(Mixer *mixer, Lpc_Bank bank) {
+    const u8 *key;
+    u32 i;
+
+    for (i = 0; i < mixer->phrase_count; i++) {
+        key = (const u8*)mixer->phrases[i].key;
+
+        if (mixer->phrases[i].used && key >= bank.bytes && key < bank.bytes + bank.size) {
+            mixer_phrase_remove(mixer, i + 1);
+        }
+    }
+}
+
+/// Rendering
+
+// adds samples of the voice from cache, filling voice renders the next frame into it when it's all mixed.
+// returns count of mixed frames, 0 when the voice is done
+u32 mixer_voice_mix_cached(Mixer *mixer, Mixer_Voice *voice, f32 *output, u32 frames) {
+    Mixer_Phrase *phrase = &mixer->phrases[voice->phrase];
+    const s16 *source;
+    f32 left, right;
+    u32 i, count;
+
+    if (voice->position == phrase->pcm_count && voice->filling && voice->frame < phrase->codes.count) {
+        phrase->pcm_count += lpc_decoder_render_frame_s16(&voice->decoder, &mixer->resampler, &voice->resampler,
+                                                          phrase->codes.code[voice->frame], phrase->scale, phrase->pcm + phrase->pcm_count);
+        phrase->pcm_frames = ++voice->frame;
+    }
+
+    source = phrase->pcm + voice->position;
+    count  = MIN(phrase->pcm_count - voice->position, frames);
+    left   = voice->left  / 32767.0f;
+    right  = voice->right / 32767.0f;
+
+    for (i = 0; i < count; i++) {
+        output[i * 2 + 0] += source[i] * left;
+        output[i * 2 + 1] += source[i] * right;
+    }
+
+    voice->position += count;
+
+    return count;
+}
+
+// same for voice without cache, frame is rendered into output of the voice
+u32 mixer_voice_mix_rendered(Mixer *mixer, Mixer_Voice *voice, f32 *output, u32 frames) {
+    Mixer_Phrase *phrase = &mixer->phrases[voice->phrase];
+    const f32 *source;
+    u32 i, count;
+
+    if (voice->output_read == voice->output_count && voice->frame < phrase->codes.count) {
+        voice->output_count = lpc_decoder_render_frame_resampled(&voice->decoder, &mixer->resampler, &voice->resampler,
+                                                                 phrase->codes.code[voice->frame++], voice->output);
+        voice->output_read  = 0;
+
+        for (i = 0; i < voice->output_count; i++) voice->output[i] *= phrase->scale;
+    }
+
+    source = voice->output + voice->output_read;
+    count  = MIN(voice->output_count - voice->output_read, frames);
+
+    for (i = 0; i < count; i++) {
+        output[i * 2 + 0] += source[i] * voice->left;
+        output[i * 2 + 1] += source[i] * voice->right;
+    }
+
+    voice->output_read += count;
+
+    return count;
+}
+
+// adds voices into stereo interleaved output, frames are stereo pairs
+void mixer_render(Mixer *mixer, f32 *output, u32 frames) {
+    Mixer_Voice *voice;
+    u32 i, v, done, count;
+
+    memset(output, 0, sizeof(f32) * 2 * frames);
+
+    mtx_lock(&mixer->lock);
+
+    for (v = 0; v < MIXER_VOICE_COUNT; v++) {
+        voice = &mixer->voices[v];
+        done  = 0;
+
+        while (voice->active && done < frames) {
+            if (voice->reading) {
+                count = mixer_voice_mix_cached(mixer, voice, output + done * 2, frames - done);
+            } else {
+                count = mixer_voice_mix_rendered(mixer, voice, output + done * 2, frames - done);
+            }
+
+            if (count == 0) {
+                mixer_voice_finish(mixer, voice);
+                break;
+            }
+
+            done += count;
+        }
+    }
+
+    mtx_unlock(&mixer->lock);
+
+    for (i = 0; i < frames * 2; i++) {
+        output[i] = Clamp(output[i], -1.0f, 1.0f);
+    }
+}
+
+void mixer_stream_callback(void *buffer, unsigned int frames) {
+    if (mixer_stream_owner == NULL) {
+        memset(buffer, 0, sizeof(f32) * 2 * frames);
+        return;
+    }
+
+    mixer_render(mixer_stream_owner, (f32*)buffer, frames);
+}
+
+// needs audio device
+b32 mixer_stream_open(Mixer *mixer) {
+    if (mixer_stream_owner != NULL) {
+        ERRLOG("Mixer: only one mixer can play at a time.");
+        return false;
+    }
+
+    if (mixer->resampler.filter == NULL) {
+        ERRLOG("Mixer: can't play without resampler.");
+        return false;
+    }
+
+    SetAudioStreamBufferSizeDefault(mixer->resampler.rate * MIXER_BLOCK_MS / 1000);
+
+    mixer->stream = LoadAudioStream(mixer->resampler.rate, 32, 2);
+
+    if (!IsAudioStreamValid(mixer->stream)) {
+        ERRLOG("Mixer: failed to open audio stream.");
+        return false;
+    }
+
+    mixer_stream_owner = mixer;
+    mixer->streaming   = true;
+
+    SetAudioStreamCallback(mixer->stream, mixer_stream_callback);
+    PlayAudioStream(mixer->stream);
+
+    return true;
+}
+
+void mixer_stream_close(Mixer *mixer) {
+    if (!mixer->streaming) return;
+
+    StopAudioStream(mixer->stream);
+    UnloadAudioStream(mixer->stream);
+
+    mixer_stream_owner = NULL;
+    mixer->streaming   = false;
+}
+
+void mixer_free(Mixer *mixer) {
+    u32 i;
+
+    mixer_stream_close(mixer);
+
+    for (i = 0; i < mixer->phrase_count; i++) {
+        if (mixer->phrases[i].used) mixer_phrase_remove(mixer, i + 1);
+    }
+
+    if (mixer->phrases) mem_free(mixer->allocator, mixer->phrases);
+
+    lpc_resampler_free(mixer->context, &mixer->resampler);
+
+    mtx_destroy(&mixer->lock);
+    memset(mixer, 0, sizeof(Mixer));
+}
@@ -0,0 +1,449 @@
+// Things raylib doesn't cover: threads, time, virtual memory, file mapping, streams, directory watch and processor info.
+// windows.h doesn't get along with raylib.h (Rectangle, CloseWindow, ...),
+// so the few functions we need from it are declared by hand.
+
+#include <threads.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#   define ALL_PROCESSOR_GROUPS 0xffff
+#   define MEM_COMMIT           0x00001000
+#   define MEM_RESERVE          0x00002000
+#   define MEM_DECOMMIT         0x00004000
+#   define MEM_RELEASE          0x00008000
+#   define PAGE_NOACCESS        0x01
+#   define PAGE_READWRITE       0x04
+#   define PAGE_READONLY        0x02
+#   define FILE_MAP_READ        0x0004
+
+__declspec(dllimport) unsigned long __stdcall GetActiveProcessorCount(unsigned short group_number);
+__declspec(dllimport) void *__stdcall VirtualAlloc(void *address, size_t size, unsigned long type, unsigned long protect);
+__declspec(dllimport) int   __stdcall VirtualFree(void *address, size_t size, unsigned long type);
+__declspec(dllimport) void *__stdcall CreateFileMappingA(void *file, void *attributes, unsigned long protect, unsigned long size_high, unsigned long size_low, const char *name);
+__declspec(dllimport) void *__stdcall MapViewOfFile(void *mapping, unsigned long access, unsigned long offset_high, unsigned long offset_low, size_t size);
+__declspec(dllimport) int   __stdcall UnmapViewOfFile(const void *address);
+__declspec(dllimport) int   __stdcall CloseHandle(void *handle);
+
+#   include <io.h>
+#   include <fcntl.h>
+#else
+#   include <unistd.h>
+#   include <signal.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <sys/socket.h>
+#   include <sys/un.h>
+#   include <sys/inotify.h>
+#   include <poll.h>
+#endif
+
+#define MAX_THREADS 64
+
+typedef int (*Thread_Proc)(void *data);
+
+typedef struct {
+    thrd_t handle;
+    b32    running;
+} Thread;
+
+u32 platform_get_processor_count(void) {
+    s64 count;
+
+#if defined(_WIN32)
+    count = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+#else
+    count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if (count < 1)           count = 1;
+    if (count > MAX_THREADS) count = MAX_THREADS;
+
+    return (u32)count;
+}
+
+b32 thread_start(Thread *thread, Thread_Proc proc, void *data) {
+    assert(thread != NULL);
+
+    thread->running = thrd_create(&thread->handle, proc, data) == thrd_success;
+
+    if (!thread->running) {
+        ERRLOG("Failed to start thread.");
+    }
+
+    return thread->running;
+}
+
+s32 thread_join(Thread *thread) {
+    int result = 0;
+
+    assert(thread != NULL);
+
+    if (!thread->running) return 0;
+
+    thrd_join(thread->handle, &result);
+    thread->running = false;
+
+    return result;
+}
+
+// seconds from some point, for measuring only, works without a window
+f64 platform_get_time(void) {
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return (f64)ts.tv_sec + (f64)ts.tv_nsec * 1e-9;
+}
+
+/// Virtual memory
+// Reserved range takes only address space, pages become real memory on commit.
+// Sizes and pointers should be multiple of PG(1), fresh pages are zeroed by the os.
+
+void *platform_reserve(u64 size) {
+    void *ptr;
+
+#if defined(_WIN32)
+    ptr = VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+    ptr = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ptr == MAP_FAILED) ptr = NULL;
+#endif
+
+    if (ptr == NULL) {
+        ERRLOG("Failed to reserve %llu bytes of address space.", (unsigned long long)size);
+    }
+
+    return ptr;
+}
+
+b32 platform_commit(void *ptr, u64 size) {
+    b32 result;
+
+    assert(ptr != NULL);
+
+#if defined(_WIN32)
+    result = VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+    result = mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+
+    if (!result) {
+        ERRLOG("Failed to commit %llu bytes.", (unsigned long long)size);
+    }
+
+    return result;
+}
+
+void platform_decommit(void *ptr, u64 size) {
+    assert(ptr != NULL);
+
+#if defined(_WIN32)
+    VirtualFree(ptr, size, MEM_DECOMMIT);
+#else
+    madvise(ptr, size, MADV_DONTNEED);
+    mprotect(ptr, size, PROT_NONE);
+#endif
+}
+
+void platform_release(void *ptr, u64 size) {
+    if (ptr == NULL) return;
+
+#if defined(_WIN32)
+    UNUSED(size);
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    munmap(ptr, size);
+#endif
+}
+
+/// File mapping
+// Read only view of the whole file, pages are read by the os when they are touched.
+// View stays valid after the file is closed, and until it's unmapped.
+
+void *platform_map_file(const char *path, u64 *size) {
+    void *ptr = NULL;
+    s32 fd;
+#if defined(_WIN32)
+    void *mapping;
+#else
+    struct stat info;
+#endif
+
+    *size = 0;
+
+#if defined(_WIN32)
+    fd = _open(path, _O_RDONLY | _O_BINARY);
+    if (fd < 0) return NULL;
+
+    *size   = (u64)_filelengthi64(fd);
+    mapping = *size ? CreateFileMappingA((void*)_get_osfhandle(fd), NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+
+    if (mapping != NULL) {
+        ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+
+    _close(fd);
+#else
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        *size = (u64)info.st_size;
+        ptr   = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) ptr = NULL;
+    }
+
+    close(fd);
+#endif
+
+    if (ptr == NULL) {
+        ERRLOG("Failed to map %s.", path);
+        *size = 0;
+    }
+
+    return ptr;
+}
+
+void platform_unmap_file(void *ptr, u64 size) {
+    if (ptr == NULL) return;
+
+#if defined(_WIN32)
+    UNUSED(size);
+    UnmapViewOfFile(ptr);
+#else
+    munmap(ptr, size);
+#endif
+}
+
+/// Streams
+// Plain file descriptors: stdin, stdout and unix sockets.
+// Unix sockets are not supported on windows, stdio works everywhere.
+
+#define PLATFORM_STDIN  0
+#define PLATFORM_STDOUT 1
+
+#define PLATFORM_IO_CHUNK MB(1)
+
+// so binary data goes through stdin/stdout untouched
+void platform_stdio_binary(void) {
+#if defined(_WIN32)
+    _setmode(PLATFORM_STDIN,  _O_BINARY);
+    _setmode(PLATFORM_STDOUT, _O_BINARY);
+#endif
+}
+
+// false on error or end of stream before size bytes were read
+b32 platform_read_all(s32 fd, void *data, u64 size) {
+    u8 *pos = (u8*)data;
+    s64 result;
+
+    while (size > 0) {
+#if defined(_WIN32)
+        result = _read(fd, pos, (unsigned)(MIN(size, PLATFORM_IO_CHUNK)));
+#else
+        result = read(fd, pos, MIN(size, PLATFORM_IO_CHUNK));
+#endif
+
+        if (result <= 0) return false;
+
+        pos  += result;
+        size -= result;
+    }
+
+    return true;
+}
+
+b32 platform_write_all(s32 fd, const void *data, u64 size) {
+    const u8 *pos = (const u8*)data;
+    s64 result;
+
+    while (size > 0) {
+#if defined(_WIN32)
+        result = _write(fd, pos, (unsigned)(MIN(size, PLATFORM_IO_CHUNK)));
+#else
+        result = write(fd, pos, MIN(size, PLATFORM_IO_CHUNK));
+#endif
+
+        if (result <= 0) return false;
+
+        pos  += result;
+        size -= result;
+    }
+
+    return true;
+}
+
+void platform_close(s32 fd) {
+    if (fd < 0) return;
+
+#if defined(_WIN32)
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+// returns listening socket or -1, old socket file at path is replaced
+s32 platform_socket_listen(const char *path) {
+#if defined(_WIN32)
+    UNUSED(path);
+    ERRLOG("Unix sockets are not supported on this platform, use stdio.");
+    return -1;
+#else
+    struct sockaddr_un address;
+    s32 fd;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        ERRLOG("Socket path is too long: %s.", path);
+        return -1;
+    }
+
+    // closed connection shouldn't kill the whole process on write
+    signal(SIGPIPE, SIG_IGN);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0) {
+        ERRLOG("Failed to create socket.");
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 64) != 0) {
+        ERRLOG("Failed to listen on %s.", path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+#endif
+}
+
+// blocks until connection comes, -1 after platform_socket_shutdown
+s32 platform_socket_accept(s32 listener) {
+#if defined(_WIN32)
+    UNUSED(listener);
+    return -1;
+#else
+    return accept(listener, NULL, NULL);
+#endif
+}
+
+// wakes up threads that wait in platform_socket_accept
+void platform_socket_shutdown(s32 listener) {
+#if defined(_WIN32)
+    UNUSED(listener);
+#else
+    shutdown(listener, SHUT_RDWR);
+#endif
+}
+
+/// Directory watch
+// inotify on linux, watch is not recursive, every directory is added by caller.
+// On other platforms platform_watch_open returns -1 and caller has to poll.
+
+#define PLATFORM_WATCH_MAX_EVENTS 256 // enough for one read of PLATFORM_WATCH_BUFFER
+#define PLATFORM_WATCH_BUFFER     KB(4)
+#define PLATFORM_WATCH_NAME_SIZE  256
+
+typedef struct {
+    s32  dir;        // id from platform_watch_add, -1 when events were lost and everything should be rescanned
+    b32  is_dir;
+    b32  removed;    // deleted or moved away
+    char name[PLATFORM_WATCH_NAME_SIZE];
+} Platform_Watch_Event;
+
+s32 platform_watch_open(void) {
+#if defined(_WIN32)
+    return -1;
+#else
+    s32 fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (fd < 0) {
+        ERRLOG("Failed to initialize inotify.");
+    }
+
+    return fd;
+#endif
+}
+
+// returns id of directory in events or -1
+s32 platform_watch_add(s32 watch, const char *path) {
+#if defined(_WIN32)
+    UNUSED(watch);
+    UNUSED(path);
+    return -1;
+#else
+    s32 dir;
+
+    // only finished writes and renames, so half written files don't come up
+    dir = inotify_add_watch(watch, path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE);
+
+    if (dir < 0) {
+        ERRLOG("Failed to watch %s.", path);
+    }
+
+    return dir;
+#endif
+}
+
+// waits up to timeout for events, returns how many were written, events should have PLATFORM_WATCH_MAX_EVENTS
+u32 platform_watch_read(s32 watch, Platform_Watch_Event *events, u32 timeout_ms) {
+#if defined(_WIN32)
+    UNUSED(watch);
+    UNUSED(events);
+    UNUSED(timeout_ms);
+    return 0;
+#else
+    _Alignas(struct inotify_event) u8 buffer[PLATFORM_WATCH_BUFFER];
+    struct inotify_event *event;
+    struct pollfd request;
+    Platform_Watch_Event *output;
+    s64 size, offset;
+    u32 count = 0;
+
+    request.fd      = watch;
+    request.events  = POLLIN;
+    request.revents = 0;
+
+    if (poll(&request, 1, (int)timeout_ms) <= 0) return 0;
+
+    size = read(watch, buffer, sizeof(buffer));
+    if (size <= 0) return 0;
+
+    for (offset = 0; offset < size && count < PLATFORM_WATCH_MAX_EVENTS; offset += sizeof(struct inotify_event) + event->len) {
+        event  = (struct inotify_event*)(buffer + offset);
+        output = &events[count];
+
+        if (event->mask & IN_Q_OVERFLOW) {
+            memset(output, 0, sizeof(Platform_Watch_Event));
+            output->dir = -1;
+            count++;
+            continue;
+        }
+
+        if (event->len == 0) continue;
+
+        // created file is still being written, its close comes later
+        if ((event->mask & IN_CREATE) && !(event->mask & IN_ISDIR)) continue;
+
+        output->dir     = event->wd;
+        output->is_dir  = (event->mask & IN_ISDIR) != 0;
+        output->removed = (event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0;
+
+        strncpy(output->name, event->name, PLATFORM_WATCH_NAME_SIZE - 1);
+        output->name[PLATFORM_WATCH_NAME_SIZE - 1] = 0;
+
+        count++;
+    }
+
+    return count;
+#endif
+}
@@ -1,8 +1,12 @@
-#define LPC_STATIC_DECL
-#define LPC_ENC_DEC_IMPLEMENTATION
-#include "lpc10_enc_dec.h" 
 #include "blissful_orange.h" 
 
+// everything that program and library allocate goes through it,
+// in debug builds it is tracking allocator and it's report is printed on exit
+Allocator main_allocator;
+
+// library context of the main thread, worker threads make their own
+Lpc_Context lpc_context;
+
 #define MAX_SAMPLES_UPDATE 512
 #define SAMPLE_RATE 8000
 
@@ -11,6 +15,21 @@
 
 #define BACKGROUND_COLOR CLITERAL(Color) {0x1c, 0x1c, 0x1c, 0xff}
 
+#define ROM_NAME_SIZE 64
+#define ROM_MACRO_SIZE (ROM_NAME_SIZE + 16) // with _N suffix of repeated names
+#define SCAN_MIN_BYTES_PER_THREAD KB(16)
+
+// file is encoded in steps, so window stays responsive, budget is time spent on it in one frame
+#define ENCODE_BUDGET_S      0.008
+#define ENCODE_STEP_SEGMENTS 16
+
+#define BANK_KEY_COUNT 9 // KEY_ONE to KEY_NINE, first phrases of dropped bank
+
+#define STREAM_CHECK_CHUNK    16  // bytes, fifo of tms5220
+#define STREAM_CHECK_SEEK_MS  100
+#define STREAM_CHECK_INTERVAL 10  // frames between index entries
+#define STREAM_CHECK_CODES    8   // written by one push, decoded after seek
+
 // AudioStream audio_stream;
 
 typedef enum {
@@ -18,25 +37,577 @@ typedef enum {
     STATUS_CONVERTING,
 } Program_Status;
 
+typedef enum {
+    PAGE_ENCODER,
+    PAGE_OUTPUT,
+    PAGE_VIEWER,
+} Program_Page;
+
+typedef enum {
+    ROM_SIZE_16K,
+    ROM_SIZE_32K,
+} Rom_Size;
+
+typedef struct {
+    char               name[ROM_NAME_SIZE];
+    Lpc_TMS5220_Buffer buffer;
+} Rom_Phrase;
+
+typedef struct {
+    Lpc_Context        context;
+    Lpc_TMS5220_Buffer dump;
+    u32                first, last;
+    Lpc_TMS5220_Scan   scan;
+} Scan_Job;
+
 typedef struct {
     Program_Status status;
+    s32            page;
     u64            index;
     FilePathList   path_list;
     Lpc_Encoder_Settings settings;
+
+    b32         encoding; // file before index is in encoder
+    Lpc_Encoder encoder;
+    Wave        wave;
+
+    b32         build_rom;
+    s32         rom_size;
+    u64         rom_phrase_count;
+    Rom_Phrase *rom_phrases;
+
+    Viewer viewer;
+
+    Mixer mixer;
+    u32   last_phrase; // last converted file, space plays it
+
+    Lpc_Bank bank;       // dropped .lpcbank, keys 1-9 play it's first phrases in place
+    void    *bank_bytes;
+    u64      bank_size;
 } Program_State;
 
 Program_State state;
 
-void program_init(void) {
+// library passes it's own file and line, so tracking report shows where in the library memory went
+void *lpc_allocator_alloc(void *user, u64 size, const char *file, s32 line) {
+    Allocator *alloc = (Allocator*)user;
+    return alloc->proc(NULL, size, ALLOCATOR_ALLOCATE, alloc->data, file, line);
+}
+
+void lpc_allocator_free(void *user, void *ptr, const char *file, s32 line) {
+    Allocator *alloc = (Allocator*)user;
+    alloc->proc(ptr, 0, ALLOCATOR_DEALLOCATE, alloc->data, file, line);
+}
+
+// main_allocator is shared between threads, tracking allocator locks, stdlib is thread safe
+void program_lpc_context_init(Lpc_Context *context) {
+    lpc_context_init(context);
+
+    context->allocator.alloc = lpc_allocator_alloc;
+    context->allocator.free  = lpc_allocator_free;
+    context->allocator.user  = &main_allocator;
+}
+
+// memory setup without window, daemon uses it too
+void program_memory_init(void) {
+#if DEBUG
+    main_allocator = create_tracking_allocator(get_stdlib_allocator());
+#else
+    main_allocator = get_stdlib_allocator();
+#endif
+
+    program_lpc_context_init(&lpc_context);
+}
+
+void program_memory_deinit(void) {
+    lpc_context_free(&lpc_context);
+
+#if DEBUG
+    tracking_report(main_allocator, "main allocator");
+    tracking_allocator_destroy(&main_allocator);
+#endif
+}
+
+/// Banks
+
+void program_bank_close(void) {
+    if (state.bank_bytes == NULL) return;
+
+    // mixer has phrases that point into the mapping
+    mixer_bank_remove(&state.mixer, state.bank);
+    platform_unmap_file(state.bank_bytes, state.bank_size);
+
+    state.bank_bytes = NULL;
+    state.bank_size  = 0;
+    memset(&state.bank, 0, sizeof(Lpc_Bank));
+}
+
+void program_bank_open(const char *path) {
+    u32 i, count;
+
+    program_bank_close();
+
+    state.bank_bytes = platform_map_file(path, &state.bank_size);
+
+    if (!lpc_bank_open(&state.bank, state.bank_bytes, state.bank_size)) {
+        ERRLOG("Bank: %s is not a phrase bank.", path);
+        platform_unmap_file(state.bank_bytes, state.bank_size);
+        state.bank_bytes = NULL;
+        state.bank_size  = 0;
+        return;
+    }
+
+    count = MIN(state.bank.header->entry_count, BANK_KEY_COUNT);
+
+    for (i = 0; i < count; i++) {
+        INFLOG("Bank: key %u plays %s.", i + 1, lpc_bank_name(state.bank, i));
+    }
+}
+
+// keys 1-9 play phrases of the bank by name
+void program_bank_update(void) {
+    u32 i, count;
+
+    if (state.bank_bytes == NULL) return;
+
+    count = MIN(state.bank.header->entry_count, BANK_KEY_COUNT);
+
+    for (i = 0; i < count; i++) {
+        if (IsKeyPressed(KEY_ONE + i)) {
+            mixer_bank_play(&state.mixer, state.bank, lpc_bank_name(state.bank, i), 1.0f, 0.0f);
+        }
+    }
+}
+
+// sample_rate is rate of the audio device, 0 if it's not known
+void program_init(u32 sample_rate) {
+    program_memory_init();
+
     state.status = STATUS_IDLE;
     state.settings = LPC_DEFAULT_SETTINGS; 
 
+    viewer_init(&state.viewer, main_allocator);
+
+    mixer_init(&state.mixer, main_allocator, &lpc_context, MIXER_CACHE_BUDGET, sample_rate);
+    mixer_stream_open(&state.mixer);
+
     SetWindowMinSize(WINDOW_WIDTH, WINDOW_HEIGHT);
     GuiLoadStyleBlissfulOrange();
     GuiSetStyle(DEFAULT, TEXT_ALIGNMENT, TEXT_ALIGN_CENTER);
 }
 
 void program_deinit(void) {
+    if (state.encoding) {
+        lpc_encode_end(&lpc_context, &state.encoder, NULL);
+        UnloadWave(state.wave);
+    }
+
+    program_bank_close();
+    mixer_free(&state.mixer);
+    viewer_free(&state.viewer);
+    program_memory_deinit();
+}
+
+u32 rom_size_in_bytes(Rom_Size size) {
+    switch (size) {
+        case ROM_SIZE_16K: return KB(16);
+        case ROM_SIZE_32K: return KB(32);
+    }
+
+    return 0;
+}
+
+void rom_phrases_free(void) {
+    u64 i;
+
+    if (state.rom_phrases == NULL) return;
+
+    for (i = 0; i < state.rom_phrase_count; i++) {
+        lpc_tms5220_buffer_free(&lpc_context, &state.rom_phrases[i].buffer);
+    }
+
+    mem_free(main_allocator, state.rom_phrases);
+    state.rom_phrases      = NULL;
+    state.rom_phrase_count = 0;
+}
+
+// name as a part of C macro: upper case, other symbols become '_', returns written length
+u64 macro_name_write(char *text, const char *name) {
+    u64 i;
+
+    for (i = 0; name[i] != 0; i++) {
+        char c = name[i];
+
+        if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))) c = '_';
+
+        text[i] = c;
+    }
+
+    return i;
+}
+
+// macro names of rom phrases, ROM_MACRO_SIZE each. Files from different folders can have the same
+// name, and different names can turn into the same macro, so repeated ones get _2, _3... suffix.
+// SIZE and USED are taken by the header itself.
+char *rom_macro_names(Allocator alloc) {
+    char *names, *name;
+    u64 i, j, length;
+    u32 suffix;
+    b32 taken;
+
+    names = (char*)mem_alloc(alloc, ROM_MACRO_SIZE * state.rom_phrase_count);
+
+    for (i = 0; i < state.rom_phrase_count; i++) {
+        name   = names + i * ROM_MACRO_SIZE;
+        length = macro_name_write(name, state.rom_phrases[i].name);
+        suffix = 1;
+
+        name[length] = 0;
+
+        do {
+            taken = strcmp(name, "SIZE") == 0 || strcmp(name, "USED") == 0;
+
+            for (j = 0; j < i && !taken; j++) {
+                taken = strcmp(name, names + j * ROM_MACRO_SIZE) == 0;
+            }
+
+            if (taken) {
+                snprintf(name + length, ROM_MACRO_SIZE - length, "_%u", ++suffix);
+            }
+        } while (taken);
+
+        if (suffix > 1) {
+            INFLOG("ROM: phrase %s is LPC10_ROM_%s, name is already used.", state.rom_phrases[i].name, name);
+        }
+    }
+
+    return names;
+}
+
+void rom_export(void) {
+    Lpc_TMS5220_Buffer *buffers;
+    Lpc_TMS5220_Rom rom;
+    Allocator alloc;
+    char *text, *names;
+    u64 i, text_size, length;
+    u32 size, total;
+
+    if (state.rom_phrase_count == 0) return;
+
+    TRACE_BEGIN("rom export");
+
+    alloc   = main_allocator;
+    size    = rom_size_in_bytes(state.rom_size);
+    buffers = (Lpc_TMS5220_Buffer*)mem_alloc(alloc, sizeof(Lpc_TMS5220_Buffer) * state.rom_phrase_count);
+
+    total = 0;
+    for (i = 0; i < state.rom_phrase_count; i++) {
+        buffers[i] = state.rom_phrases[i].buffer;
+        total += buffers[i].count;
+    }
+
+    rom = lpc_tms5220_rom_build(&lpc_context, buffers, state.rom_phrase_count, size);
+    mem_free(alloc, buffers);
+
+    if (rom.bytes == NULL) {
+        ERRLOG("ROM: phrases need %u bytes, but rom is only %u bytes.", rom.used, size);
+        lpc_tms5220_rom_free(&lpc_context, &rom);
+        TRACE_END();
+        return;
+    }
+
+    INFLOG("ROM: %u phrases, %u of %u bytes used, %u bytes saved by sharing.", rom.phrase_count, rom.used, rom.count, total - rom.used);
+
+    SaveFileData("lpc10_rom.bin", rom.bytes, rom.count);
+
+    // every phrase takes one line with name and address in it
+    text_size = KB(1) + state.rom_phrase_count * (ROM_MACRO_SIZE + 64);
+    text      = (char*)mem_alloc(alloc, text_size);
+    names     = rom_macro_names(alloc);
+    length    = 0;
+
+    length += snprintf(text + length, text_size - length, "// Generated by c-wizard, addresses of phrases in lpc10_rom.bin\n\n");
+    length += snprintf(text + length, text_size - length, "#define LPC10_ROM_SIZE %u\n", rom.count);
+    length += snprintf(text + length, text_size - length, "#define LPC10_ROM_USED %u\n\n", rom.used);
+
+    for (i = 0; i < state.rom_phrase_count; i++) {
+        length += snprintf(text + length, text_size - length, "#define LPC10_ROM_%s 0x%04X\n", names + i * ROM_MACRO_SIZE, rom.offsets[i]);
+    }
+
+    SaveFileText("lpc10_rom.h", text);
+
+    mem_free(alloc, names);
+    mem_free(alloc, text);
+    lpc_tms5220_rom_free(&lpc_context, &rom);
+
+    TRACE_END();
+}
+
+s32 rom_scan_thread_proc(void *data) {
+    Scan_Job *job = (Scan_Job*)data;
+
+    TRACE_THREAD("rom scan");
+
+    job->scan = lpc_tms5220_scan(&job->context, job->dump, job->first, job->last, LPC_DEFAULT_SCAN_SETTINGS);
+
+    return 0;
+}
+
+void rom_scan_export(Lpc_TMS5220_Buffer dump, Lpc_TMS5220_Scan scan, const char *file_name) {
+    Lpc_TMS5220_Phrase phrase;
+    Lpc_Sample_Buffer samples;
+    Lpc_Codes codes;
+    Lpc_Code code;
+    Allocator alloc;
+    Wave wave;
+    char *text;
+    u64 i, j, text_size, length, frame_count;
+
+    alloc = main_allocator;
+
+    frame_count = 0;
+    for (i = 0; i < scan.count; i++) {
+        frame_count += scan.phrases[i].frame_count;
+    }
+
+    // table line for every phrase and line for every code
+    text_size = KB(1) + scan.count * 128 + frame_count * 64;
+    text      = (char*)mem_alloc(alloc, text_size);
+    length    = 0;
+
+    length += snprintf(text + length, text_size - length, "// Generated by c-wizard, phrases found in %s\n\n", file_name);
+    length += snprintf(text + length, text_size - length, "// offset    bytes  frames  score\n");
+
+    for (i = 0; i < scan.count; i++) {
+        phrase  = scan.phrases[i];
+        length += snprintf(text + length, text_size - length, "0x%06X %8u %7u  %.2f\n", phrase.offset, (phrase.bits_count + 7) / 8, phrase.frame_count, phrase.score);
+    }
+
+    for (i = 0; i < scan.count; i++) {
+        phrase = scan.phrases[i];
+        codes  = lpc_tms5220_decode(&lpc_context, lpc_tms5220_phrase_buffer(dump, phrase));
+
+        length += snprintf(text + length, text_size - length, "\n// 0x%06X: energy repeat pitch k1 .. k10\n", phrase.offset);
+
+        for (j = 0; j < codes.count; j++) {
+            code = codes.code[j];
+            if (code.energy == LPC_ENERGY_STOP) break;
+
+            length += snprintf(text + length, text_size - length, "%2u %u %2u  %2u %2u %2u %2u %2u %2u %2u %u %u %u\n",
+                               code.energy, code.repeat, code.pitch,
+                               code.k1, code.k2, code.k3, code.k4, code.k5, code.k6, code.k7, code.k8, code.k9, code.k10);
+        }
+
+        samples = lpc_decode(&lpc_context, codes);
+
+        memset(&wave, 0, sizeof(Wave));
+        wave.sampleRate = samples.sample_rate;
+        wave.sampleSize = 32;
+        wave.channels   = 1;
+        wave.frameCount = samples.frame_count;
+        wave.data       = (void*)samples.samples;
+
+        ExportWave(wave, TextFormat("lpc10_%s_%06X.wav", file_name, phrase.offset));
+
+        lpc_codes_free(&lpc_context, &codes);
+        lpc_buffer_free(&lpc_context, &samples);
+    }
+
+    SaveFileText(TextFormat("lpc10_%s_scan.txt", file_name), text);
+    mem_free(alloc, text);
+}
+
+// Every byte offset of the dump is tried as phrase start, dump is split
+// between threads and the candidates are merged in order after that.
+// dump is split between threads, threads_used gets count of them
+Lpc_TMS5220_Scan rom_scan_dump(Lpc_TMS5220_Buffer dump, u32 *threads_used) {
+    Thread   threads[MAX_THREADS];
+    Scan_Job jobs[MAX_THREADS];
+    Lpc_TMS5220_Scan scans[MAX_THREADS];
+    Lpc_TMS5220_Scan scan;
+    u32 i, thread_count;
+
+    thread_count = platform_get_processor_count();
+    thread_count = MIN(thread_count, dump.count / SCAN_MIN_BYTES_PER_THREAD + 1);
+
+    memset(threads, 0, sizeof(threads));
+
+    for (i = 0; i < thread_count; i++) {
+        program_lpc_context_init(&jobs[i].context);
+        jobs[i].dump  = dump;
+        jobs[i].first = (u32)((u64)dump.count * i / thread_count);
+        jobs[i].last  = (u32)((u64)dump.count * (i + 1) / thread_count);
+
+        // this thread does the last part itself
+        if (i == thread_count - 1 || !thread_start(&threads[i], rom_scan_thread_proc, &jobs[i])) {
+            rom_scan_thread_proc(&jobs[i]);
+        }
+    }
+
+    for (i = 0; i < thread_count; i++) {
+        thread_join(&threads[i]);
+        scans[i] = jobs[i].scan;
+    }
+
+    scan = lpc_tms5220_scan_merge(&lpc_context, dump, scans, thread_count);
+
+    for (i = 0; i < thread_count; i++) {
+        lpc_tms5220_scan_free(&jobs[i].context, &scans[i]);
+        lpc_context_free(&jobs[i].context);
+    }
+
+    *threads_used = thread_count;
+
+    return scan;
+}
+
+void rom_scan(const char *path, const char *file_name) {
+    Lpc_TMS5220_Scan scan;
+    Lpc_TMS5220_Buffer dump;
+    s32 size;
+    u32 thread_count;
+    f64 start;
+
+    dump.bytes = LoadFileData(path, &size);
+    dump.count = (u32)size;
+
+    if (dump.bytes == NULL || size <= 0) {
+        ERRLOG("Scan: failed to load %s.", path);
+        return;
+    }
+
+    start = GetTime();
+    scan  = rom_scan_dump(dump, &thread_count);
+
+    INFLOG("Scan: %u phrases found in %s (%u bytes), %.2f s on %u threads.", scan.count, file_name, dump.count, GetTime() - start, thread_count);
+
+    rom_scan_export(dump, scan, file_name);
+
+    lpc_tms5220_scan_free(&lpc_context, &scan);
+    UnloadFileData(dump.bytes);
+}
+
+// one line summary, and a line for every underrun, so phrases that the host can't stream are visible in the log
+void fifo_report_log(const char *name, Lpc_Fifo_Settings settings, Lpc_Fifo_Report report) {
+    u32 i;
+
+    INFLOG("FIFO: %s, %u frames, %.0f B/s average, %.0f B/s peak at frame %u, %u voiced frames in a row at frame %u.",
+           name, report.frame_count, report.average_bytes_per_second, report.peak_bytes_per_second, report.peak_frame,
+           report.burst_frames, report.burst_frame);
+
+    if (report.required_bytes_per_second) {
+        INFLOG("FIFO: host needs %u B/s with %u us latency, at %u B/s lowest fill is %u bits, %u interrupts.",
+               report.required_bytes_per_second, settings.latency_us, settings.host_bytes_per_second,
+               report.min_fifo_bits, report.interrupt_count);
+    } else {
+        ERRLOG("FIFO: %s can't be streamed with %u us latency at any rate.", name, settings.latency_us);
+    }
+
+    for (i = 0; i < report.underrun_count; i++) {
+        ERRLOG("FIFO: underrun at frame %u (%.3f s), %u bits missing.", report.underruns[i].frame,
+               report.underruns[i].time_us / 1e6, report.underruns[i].missing_bits);
+    }
+}
+
+// rough part of the file that is encoded, pitch search and analysis take most of the time
+f32 program_encode_progress(void) {
+    Lpc_Encoder *encoder = &state.encoder;
+    f32 part;
+
+    if (encoder->segments.count == 0) return 0;
+
+    part = (f32)encoder->cursor / (f32)encoder->segments.count;
+
+    switch (encoder->stage) {
+        case LPC_ENCODE_STAGE_PITCH:    return part * 0.5f;
+        case LPC_ENCODE_STAGE_ANALYSIS: return 0.5f + part * 0.5f;
+        case LPC_ENCODE_STAGE_CODES:
+        case LPC_ENCODE_STAGE_TRACE:
+        case LPC_ENCODE_STAGE_DONE:     return 1.0f;
+    }
+
+    return 0;
+}
+
+// encoder is advanced for ENCODE_BUDGET_S, when it's done file is decoded and exported
+void program_encode_update(void) {
+    Lpc_Sample_Buffer samples, decoded;
+    Lpc_TMS5220_Buffer buffer;
+    Lpc_Fifo_Report fifo;
+    Lpc_Bitcodes bitcodes;
+    Lpc_Codes codes;
+    Wave wave;
+    const char *file_name;
+    u32 lead_in;
+    b32 done;
+    f64 deadline;
+
+    TRACE_BEGIN("encode");
+    deadline = GetTime() + ENCODE_BUDGET_S;
+
+    do {
+        done = lpc_encode_step(&lpc_context, &state.encoder, ENCODE_STEP_SEGMENTS);
+    } while (!done && GetTime() < deadline);
+
+    TRACE_END();
+
+    if (!done) return;
+
+    bitcodes = lpc_encode_end(&lpc_context, &state.encoder, &lead_in);
+    codes    = lpc_bitcodes_unpack(&lpc_context, bitcodes);
+    lpc_bitcodes_free(&lpc_context, &bitcodes);
+
+    wave      = state.wave;
+    file_name = GetFileNameWithoutExt(state.path_list.paths[state.index - 1]);
+
+    state.encoding = false;
+    memset(&state.wave, 0, sizeof(Wave));
+
+    samples.sample_rate = LPC_SAMPLE_RATE;
+    samples.channels    = 1;
+    samples.frame_count = wave.frameCount;
+    samples.samples     = (f32*)wave.data;
+
+    buffer  = lpc_tms5220_encode(&lpc_context, codes);
+    decoded = lpc_decode(&lpc_context, codes);
+
+    // viewer keeps it's own copies, last file stays in it
+    viewer_load(&state.viewer, samples, decoded, codes, lead_in);
+
+    if (state.last_phrase) mixer_phrase_remove(&state.mixer, state.last_phrase);
+    state.last_phrase = mixer_phrase_add(&state.mixer, codes);
+
+    UnloadWave(wave);
+    memset(&wave, 0, sizeof(Wave));
+
+    samples         = decoded;
+    wave.sampleRate = samples.sample_rate;
+    wave.sampleSize = 32;
+    wave.channels   = 1;
+    wave.frameCount = samples.frame_count;
+    wave.data       = (void*)samples.samples;
+
+    TRACE_BEGIN("export");
+    ExportWave(wave, TextFormat("lpc10_%s.wav", file_name));
+    ExportDataAsCode(buffer.bytes, buffer.count, TextFormat("lpc10_%s.h", file_name));
+    TRACE_END();
+
+    fifo = lpc_tms5220_fifo_simulate(&lpc_context, buffer, LPC_DEFAULT_FIFO_SETTINGS);
+    fifo_report_log(file_name, LPC_DEFAULT_FIFO_SETTINGS, fifo);
+    lpc_fifo_report_free(&lpc_context, &fifo);
+
+    if (state.rom_phrases != NULL) {
+        Rom_Phrase *phrase = &state.rom_phrases[state.rom_phrase_count++];
+
+        TextCopy(phrase->name, TextSubtext(file_name, 0, ROM_NAME_SIZE - 1));
+        phrase->buffer = buffer;
+    } else {
+        lpc_tms5220_buffer_free(&lpc_context, &buffer);
+    }
+
+    lpc_codes_free(&lpc_context, &codes);
+    lpc_buffer_free(&lpc_context, &samples);
 }
 
 void program_update(void) {
@@ -51,59 +622,88 @@ void program_update(void) {
 
                 state.path_list = LoadDroppedFiles();
 
+                rom_phrases_free();
+
+                if (state.build_rom) {
+                    state.rom_phrases = (Rom_Phrase*)mem_alloc(main_allocator, sizeof(Rom_Phrase) * state.path_list.count);
+                }
+
                 state.status = STATUS_CONVERTING;
+                break;
+            }
+
+            if (IsKeyPressed(KEY_SPACE) && state.last_phrase) {
+                mixer_play(&state.mixer, state.last_phrase, 1.0f, 0.0f);
+            }
+
+            program_bank_update();
+
+            if (state.page == PAGE_VIEWER) {
+                f32 height = window_height / 20;
+                viewer_update(&state.viewer, CLITERAL(Rectangle) { PADDING_PX, height + PADDING_PX / 2, window_width - PADDING_PX * 2, window_height - height * 2 - PADDING_PX });
             }
         } break;
 
         case STATUS_CONVERTING:
         {
             Lpc_Sample_Buffer samples;
-            Lpc_TMS5220_Buffer buffer;
-            Lpc_Codes codes;
             Wave wave;
             const char *file_name;
 
+            if (state.encoding) {
+                program_encode_update();
+                break;
+            }
+
             if (state.index >= state.path_list.count) {
+                if (state.build_rom) {
+                    rom_export();
+                    rom_phrases_free();
+                }
+
                 state.status = STATUS_IDLE;
                 state.index  = 0;
                 break;
             }
 
-            wave      = LoadWave(state.path_list.paths[state.index]);
             file_name = GetFileNameWithoutExt(state.path_list.paths[state.index]);
 
+            if (IsFileExtension(state.path_list.paths[state.index], ".lpcbank")) {
+                program_bank_open(state.path_list.paths[state.index]);
+                state.index++;
+                break;
+            }
+
+            // raw rom dumps are searched for phrases instead of being encoded
+            if (IsFileExtension(state.path_list.paths[state.index], ".bin;.rom")) {
+                rom_scan(state.path_list.paths[state.index], file_name);
+                state.index++;
+                break;
+            }
+
+            TRACE_BEGIN("load");
+            wave = LoadWave(state.path_list.paths[state.index]);
+
             state.index++;
 
             if (!IsWaveValid(wave)) { 
+                TRACE_END();
                 break;
             }
 
             WaveFormat(&wave, LPC_SAMPLE_RATE, 32, 1);
+            TRACE_END();
 
             samples.sample_rate = LPC_SAMPLE_RATE;
             samples.channels    = 1;
             samples.frame_count = wave.frameCount;
             samples.samples     = (f32*)wave.data;
 
-            codes  = lpc_encode(samples, state.settings);
-            buffer = lpc_tms5220_encode(codes);
-
-            UnloadWave(wave);
-            memset(&wave, 0, sizeof(Wave));
+            // wave stays loaded until encoder is done, it's read in the first step
+            lpc_encode_begin(&lpc_context, &state.encoder, samples, state.settings);
 
-            samples         = lpc_decode(codes);
-            wave.sampleRate = samples.sample_rate;
-            wave.sampleSize = 32;
-            wave.channels   = 1;
-            wave.frameCount = samples.frame_count;
-            wave.data       = (void*)samples.samples;
-
-            ExportWave(wave, TextFormat("lpc10_%s.wav", file_name));
-            ExportDataAsCode(buffer.bytes, buffer.count, TextFormat("lpc10_%s.h", file_name));
-
-            lpc_codes_free(&codes);
-            lpc_buffer_free(&samples);
-            lpc_tms5220_buffer_free(&buffer);
+            state.wave     = wave;
+            state.encoding = true;
         } break;
     }
 }
@@ -112,7 +712,7 @@ void program_render(void) {
     Font font;
     Vector2 pos, size;
     const char *text;
-    u64 i;
+    u64 i, first;
     Rectangle rect;
     s32 x, height, width;
 
@@ -127,49 +727,93 @@ void program_render(void) {
             x = rect.x = window_width / 4;
 
             width  = rect.width  = window_width  /  2;
-            height = rect.height = window_height / 15;
+            height = rect.height = window_height / 20;
             rect.height -= PADDING_PX / 2;
             rect.y       = PADDING_PX / 2;
 
-            rect.width = window_width;
-            rect.x     = 0;
-            GuiLabel(rect, "Pitch buffer settings");
+            rect.x     = PADDING_PX;
+            rect.width = (window_width - PADDING_PX * 2) / 3 - GuiGetStyle(TOGGLE, GROUP_PADDING);
+            GuiToggleGroup(rect, "Encoder;Output;Viewer", &state.page);
             rect.x     = x;
             rect.width = width;
 
             rect.y += height;
-            GuiSlider(rect, "Low-cut", TextFormat("%.0f", state.settings.pitch_low_cut), &state.settings.pitch_low_cut, 1.0f, 500.0f);
-            rect.y += height;
-            GuiSlider(rect, "High-cut", TextFormat("%.0f", state.settings.pitch_high_cut), &state.settings.pitch_high_cut, 100.0f, 1000.0f);
-            rect.y += height;
-            GuiSlider(rect, "Q-Factor", TextFormat("%.2f", state.settings.pitch_q_factor), &state.settings.pitch_q_factor, 0.01f, 8.0f);
 
-            rect.y += height;
-            rect.width = window_width;
-            rect.x     = 0;
-            GuiLabel(rect, "Ks processing buffer settings");
-            rect.x     = x;
-            rect.width = width;
+            switch (state.page) {
+                case PAGE_ENCODER:
+                {
+                    rect.width = window_width;
+                    rect.x     = 0;
+                    GuiLabel(rect, "Pitch buffer settings");
+                    rect.x     = x;
+                    rect.width = width;
 
-            rect.y += height;
-            GuiSlider(rect, "Low-cut", TextFormat("%.0f",  state.settings.processing_low_cut),  &state.settings.processing_low_cut, 1.0f, 500.0f);
-            rect.y += height;
-            GuiSlider(rect, "High-cut", TextFormat("%.0f", state.settings.processing_high_cut), &state.settings.processing_high_cut, 100.0f, 4000.0f);
-            rect.y += height;
-            GuiSlider(rect, "Q-Factor", TextFormat("%.2f", state.settings.processing_q_factor), &state.settings.processing_q_factor, 0.01f, 8.0f);
-            rect.y += height;
+                    rect.y += height;
+                    GuiSlider(rect, "Low-cut", TextFormat("%.0f", state.settings.pitch_low_cut), &state.settings.pitch_low_cut, 1.0f, 500.0f);
+                    rect.y += height;
+                    GuiSlider(rect, "High-cut", TextFormat("%.0f", state.settings.pitch_high_cut), &state.settings.pitch_high_cut, 100.0f, 1000.0f);
+                    rect.y += height;
+                    GuiSlider(rect, "Q-Factor", TextFormat("%.2f", state.settings.pitch_q_factor), &state.settings.pitch_q_factor, 0.01f, 8.0f);
+                    rect.y += height;
+                    GuiToggle(rect, "Tracking pitch search", (bool*)&state.settings.pitch_search);
 
-            rect.y += height;
-            GuiSlider(rect, "Unvoiced thresh.", TextFormat("%.2f",  state.settings.unvoiced_thresh),  &state.settings.unvoiced_thresh, -1.0f, 1.0f);
-            rect.y += height;
-            GuiSlider(rect, "Unvoiced RMS mult.", TextFormat("%.2f", state.settings.unvoiced_rms_multiply), &state.settings.unvoiced_rms_multiply, 0.0f, 8.0f);
+                    rect.y += height;
+                    rect.width = window_width;
+                    rect.x     = 0;
+                    GuiLabel(rect, "Ks processing buffer settings");
+                    rect.x     = x;
+                    rect.width = width;
 
-            rect.y += height;
-            GuiToggle(rect, "Pre Emphasis", (bool*)&state.settings.do_pre_emphasis);
-            rect.y += height;
-            GuiSlider(rect, "Alpha", TextFormat("%.6f", state.settings.pre_emphasis_alpha), &state.settings.pre_emphasis_alpha, -1.0f, 1.0f);
+                    rect.y += height;
+                    GuiSlider(rect, "Low-cut", TextFormat("%.0f",  state.settings.processing_low_cut),  &state.settings.processing_low_cut, 1.0f, 500.0f);
+                    rect.y += height;
+                    GuiSlider(rect, "High-cut", TextFormat("%.0f", state.settings.processing_high_cut), &state.settings.processing_high_cut, 100.0f, 4000.0f);
+                    rect.y += height;
+                    GuiSlider(rect, "Q-Factor", TextFormat("%.2f", state.settings.processing_q_factor), &state.settings.processing_q_factor, 0.01f, 8.0f);
+                    rect.y += height;
+
+                    rect.y += height;
+                    GuiSlider(rect, "Unvoiced thresh.", TextFormat("%.2f",  state.settings.unvoiced_thresh),  &state.settings.unvoiced_thresh, -1.0f, 1.0f);
+                    rect.y += height;
+                    GuiSlider(rect, "Unvoiced RMS mult.", TextFormat("%.2f", state.settings.unvoiced_rms_multiply), &state.settings.unvoiced_rms_multiply, 0.0f, 8.0f);
+
+                    rect.y += height;
+                    GuiToggle(rect, "Pre Emphasis", (bool*)&state.settings.do_pre_emphasis);
+                    rect.y += height;
+                    GuiSlider(rect, "Alpha", TextFormat("%.6f", state.settings.pre_emphasis_alpha), &state.settings.pre_emphasis_alpha, -1.0f, 1.0f);
+
+                    rect.y += height;
+                    GuiSlider(rect, "Repeat thresh.", TextFormat("%.3f", state.settings.repeat_thresh), &state.settings.repeat_thresh, -0.01f, 0.5f);
+                    rect.y += height;
+                    GuiSlider(rect, "RD lambda", TextFormat("%.4f", state.settings.rd_lambda), &state.settings.rd_lambda, 0.0f, 0.03f);
+                    rect.y += height;
+                    GuiSlider(rect, "Silence thresh.", TextFormat("%.4f", state.settings.silence_thresh), &state.settings.silence_thresh, 0.0f, 0.01f);
+                } break;
+
+                case PAGE_OUTPUT:
+                {
+                    rect.width = window_width;
+                    rect.x     = 0;
+                    GuiLabel(rect, "ROM settings");
+                    rect.x     = x;
+                    rect.width = width;
+
+                    rect.y += height;
+                    GuiToggle(rect, "Build ROM from dropped files", (bool*)&state.build_rom);
+
+                    rect.y += height;
+                    rect.width = width / 2 - GuiGetStyle(TOGGLE, GROUP_PADDING);
+                    GuiToggleGroup(rect, "VSM 16K;VSM 32K", &state.rom_size);
+                    rect.width = width;
+                } break;
+
+                case PAGE_VIEWER:
+                {
+                    viewer_render(&state.viewer);
+                } break;
+            }
 
-            rect.y    += height * 2;
+            rect.y     = window_height - height;
             rect.width = window_width;
             rect.x     = 0;
             GuiLabel(rect, "Drag and drop files you need to convert");
@@ -183,16 +827,24 @@ void program_render(void) {
 
             DrawTextEx(font, text, pos, 24, 1, WHITE);
 
+            // file in encoder is still in the list, with it's progress
+            first = state.encoding ? state.index - 1 : state.index;
+
             for (i = 0; i < state.path_list.count; i++) {
-                if (i < state.index) continue;
+                if (i < first) continue;
 
                 text = GetFileNameWithoutExt(state.path_list.paths[i]);
 
-                text = TextFormat("%s", text);
+                if (state.encoding && i == first) {
+                    text = TextFormat("%s %3.0f%%", text, program_encode_progress() * 100.0f);
+                } else {
+                    text = TextFormat("%s", text);
+                }
+
                 size = MeasureTextEx(font, text, 24, 1);
 
                 pos.x = size.y;
-                pos.y = size.y * ((i - state.index) + 1);
+                pos.y = size.y * ((i - first) + 1);
 
                 DrawTextEx(font, text, pos, 24, 1, WHITE);
             }
@@ -201,3 +853,437 @@ void program_render(void) {
 
     EndDrawing();
 }
+
+/// Synthesis benchmark
+// Random codes with runs of voiced, unvoiced and silent frames, rendered on one thread.
+// Real-time factor is seconds of audio rendered per second.
+
+#define SYNTH_BENCH_FRAMES 40000 // about 16 minutes of speech
+#define SYNTH_BENCH_ROUNDS 10
+
+void synth_benchmark(void) {
+    Lpc_Codes codes;
+    Lpc_Code *code;
+    Lpc_Decoder decoder;
+    Lpc_Resampler resampler;
+    Lpc_Sample_Buffer samples;
+    f32 *output;
+    u32 seed, i, j, round;
+    b32 voiced;
+    f64 start, elapsed, seconds;
+
+    program_memory_init();
+
+    codes.count = SYNTH_BENCH_FRAMES;
+    codes.code  = (Lpc_Code*)mem_alloc(main_allocator, sizeof(Lpc_Code) * codes.count);
+    output      = (f32*)mem_alloc(main_allocator, sizeof(f32) * LPC_SAMPLES * codes.count);
+
+    seed   = 1;
+    voiced = true;
+
+    for (i = 0; i < codes.count; i++) {
+        code = &codes.code[i];
+
+        seed = seed * 1103515245 + 12345;
+        if (((seed >> 16) % 10) == 0) voiced = !voiced;
+
+        code->energy = 1 + (seed >> 8) % 14;
+        code->pitch  = voiced ? 1 + (seed >> 12) % LPC_PITCH_MASK : 0;
+        code->repeat = ((seed >> 20) % 6) == 0;
+
+        if (((seed >> 24) % 12) == 0) code->energy = LPC_ENERGY_ZERO;
+
+        for (j = 0; j < 10; j++) {
+            seed = seed * 1103515245 + 12345;
+            code->k[j] = (u8)((seed >> 16) % lpc_context.tables->k_sizes[j]);
+        }
+    }
+
+    seconds = (f64)codes.count * LPC_FRAME_SIZE_MS / 1000.0 * SYNTH_BENCH_ROUNDS;
+
+    start = platform_get_time();
+
+    for (round = 0; round < SYNTH_BENCH_ROUNDS; round++) {
+        lpc_decoder_init(&lpc_context, &decoder);
+
+        for (i = 0; i < codes.count; i++) {
+            lpc_decoder_render_frame(&decoder, codes.code[i], output + (u64)i * LPC_SAMPLES);
+        }
+    }
+
+    elapsed = platform_get_time() - start;
+
+    INFLOG("BENCH: render_frame %8.2f ms, %6.2f ns per sample, x%.0f real-time.", elapsed * 1000.0,
+           elapsed * 1e9 / (seconds * LPC_SAMPLE_RATE), seconds / elapsed);
+
+    start = platform_get_time();
+
+    for (round = 0; round < SYNTH_BENCH_ROUNDS; round++) {
+        samples = lpc_decode(&lpc_context, codes);
+        lpc_buffer_free(&lpc_context, &samples);
+    }
+
+    elapsed = platform_get_time() - start;
+
+    INFLOG("BENCH: lpc_decode   %8.2f ms, %6.2f ns per sample, x%.0f real-time.", elapsed * 1000.0,
+           elapsed * 1e9 / (seconds * LPC_SAMPLE_RATE), seconds / elapsed);
+
+    // same at rate of the mixer, synthesis and interpolation in one pass
+    if (lpc_resampler_init(&lpc_context, &resampler, MIXER_SAMPLE_RATE)) {
+        start = platform_get_time();
+
+        for (round = 0; round < SYNTH_BENCH_ROUNDS; round++) {
+            samples = lpc_decode_resampled(&lpc_context, codes, &resampler);
+            lpc_buffer_free(&lpc_context, &samples);
+        }
+
+        elapsed = platform_get_time() - start;
+
+        INFLOG("BENCH: decode %u Hz %8.2f ms, %6.2f ns per sample, x%.0f real-time.", MIXER_SAMPLE_RATE, elapsed * 1000.0,
+               elapsed * 1e9 / (seconds * MIXER_SAMPLE_RATE), seconds / elapsed);
+
+        lpc_resampler_free(&lpc_context, &resampler);
+    }
+
+    mem_free(main_allocator, output);
+    mem_free(main_allocator, codes.code);
+
+    program_memory_deinit();
+}
+
+// tms5220 stream (.bin) as it is, or audio file encoded with default settings, bytes are NULL on failure
+Lpc_TMS5220_Buffer program_stream_load(const char *path) {
+    Lpc_Sample_Buffer samples;
+    Lpc_TMS5220_Buffer buffer;
+    Lpc_Bitcodes codes;
+    Wave wave;
+    s32 size;
+
+    memset(&buffer, 0, sizeof(Lpc_TMS5220_Buffer));
+
+    if (IsFileExtension(path, ".bin")) {
+        buffer.bytes = LoadFileData(path, &size);
+        buffer.count = size > 0 ? (u32)size : 0;
+        return buffer;
+    }
+
+    wave = LoadWave(path);
+
+    if (IsWaveValid(wave)) {
+        WaveFormat(&wave, LPC_SAMPLE_RATE, 32, 1);
+
+        samples.sample_rate = LPC_SAMPLE_RATE;
+        samples.channels    = 1;
+        samples.frame_count = wave.frameCount;
+        samples.samples     = (f32*)wave.data;
+
+        codes  = lpc_encode_bitcodes(&lpc_context, samples, LPC_DEFAULT_SETTINGS);
+        buffer = lpc_tms5220_encode_bitcodes(&lpc_context, codes);
+
+        lpc_bitcodes_free(&lpc_context, &codes);
+    }
+
+    UnloadWave(wave);
+
+    return buffer;
+}
+
+void program_stream_free(const char *path, Lpc_TMS5220_Buffer *buffer) {
+    if (IsFileExtension(path, ".bin")) {
+        UnloadFileData(buffer->bytes);
+        memset(buffer, 0, sizeof(Lpc_TMS5220_Buffer));
+    } else {
+        lpc_tms5220_buffer_free(&lpc_context, buffer);
+    }
+}
+
+// Checks that phrase can be streamed to the chip in Speak External mode, path is tms5220 stream (.bin)
+// or audio file that is encoded with default settings. Zero rate and negative latency mean defaults.
+// Returns 1 if fifo runs out, so it can be used in scripts.
+s32 fifo_check_run(const char *path, u32 bytes_per_second, s32 latency_us) {
+    Lpc_Fifo_Settings settings;
+    Lpc_Fifo_Report report;
+    Lpc_TMS5220_Buffer buffer;
+    s32 result;
+
+    program_memory_init();
+
+    settings = LPC_DEFAULT_FIFO_SETTINGS;
+    if (bytes_per_second) settings.host_bytes_per_second = bytes_per_second;
+    if (latency_us >= 0)  settings.latency_us            = (u32)latency_us;
+
+    buffer = program_stream_load(path);
+
+    if (buffer.bytes == NULL) {
+        ERRLOG("FIFO: failed to load %s.", path);
+        program_memory_deinit();
+        return 1;
+    }
+
+    report = lpc_tms5220_fifo_simulate(&lpc_context, buffer, settings);
+    fifo_report_log(GetFileName(path), settings, report);
+
+    result = report.underrun_count > 0 ? 1 : 0;
+
+    lpc_fifo_report_free(&lpc_context, &report);
+    program_stream_free(path, &buffer);
+
+    program_memory_deinit();
+
+    return result;
+}
+
+// Checks playback of stream that arrives in chunks and seeking in it, path is the same as for fifo check.
+// Stream is pushed into Lpc_TMS5220_Parser chunk_bytes at a time and every frame has to match
+// lpc_tms5220_decode. Then it's seeked every seek_ms with Lpc_TMS5220_Index, codes and excitation
+// state of the decoder have to match decoder that rendered every frame before. Zeroes mean defaults.
+// Returns 1 on any mismatch.
+s32 stream_check_run(const char *path, u32 chunk_bytes, u32 seek_ms) {
+    Lpc_TMS5220_Buffer buffer;
+    Lpc_TMS5220_Parser parser;
+    Lpc_TMS5220_Index index;
+    Lpc_Decoder decoder;
+    Lpc_Codes codes, part;
+    Lpc_Code parsed[STREAM_CHECK_CODES];
+    f32 samples[LPC_SAMPLES];
+    u32 *phases, *noises;
+    u32 i, offset, chunk, consumed, written, frame, count, parse_errors, seek_errors, seeks;
+
+    program_memory_init();
+
+    if (chunk_bytes == 0) chunk_bytes = STREAM_CHECK_CHUNK;
+    if (seek_ms == 0)     seek_ms     = STREAM_CHECK_SEEK_MS;
+
+    buffer = program_stream_load(path);
+
+    if (buffer.bytes == NULL) {
+        ERRLOG("STREAM: failed to load %s.", path);
+        program_memory_deinit();
+        return 1;
+    }
+
+    // whatever is after stop frame is padding
+    codes = lpc_tms5220_decode(&lpc_context, buffer);
+
+    for (i = 0; i < codes.count; i++) {
+        if (codes.code[i].energy == LPC_ENERGY_STOP) {
+            codes.count = i + 1;
+            break;
+        }
+    }
+
+    TRACE_BEGIN("stream parse");
+
+    lpc_tms5220_parser_init(&parser);
+
+    parse_errors = 0;
+    frame        = 0;
+    written      = 0;
+
+    for (offset = 0; offset < buffer.count && !parser.stopped; offset += chunk) {
+        chunk = MIN(chunk_bytes, buffer.count - offset);
+
+        // frames that didn't fit are written by the next push, nothing is consumed after stop frame
+        for (i = 0; (i < chunk || written) && !parser.stopped; i += consumed) {
+            written = lpc_tms5220_parser_push(&parser, buffer.bytes + offset + i, chunk - i, &consumed, parsed, STREAM_CHECK_CODES);
+
+            for (count = 0; count < written; count++, frame++) {
+                if (frame >= codes.count || memcmp(&parsed[count], &codes.code[frame], sizeof(Lpc_Code)) != 0) parse_errors++;
+            }
+        }
+    }
+
+    if (frame != codes.count) parse_errors++;
+
+    TRACE_END();
+
+    INFLOG("STREAM: %s, %u frames parsed in chunks of %u bytes, %u of %u expected, %u mismatches.",
+           GetFileName(path), frame, chunk_bytes, MIN(frame, codes.count), codes.count, parse_errors);
+
+    TRACE_BEGIN("stream seek");
+
+    // excitation state at the start of every frame
+    count  = MAX(codes.count, 1);
+    phases = (u32*)mem_alloc(main_allocator, sizeof(u32) * count);
+    noises = (u32*)mem_alloc(main_allocator, sizeof(u32) * count);
+
+    lpc_decoder_init(&lpc_context, &decoder);
+
+    for (i = 0; i < codes.count; i++) {
+        phases[i] = decoder.phase_counter;
+        noises[i] = decoder.noise;
+
+        lpc_decoder_render_frame(&decoder, codes.code[i], samples);
+    }
+
+    index = lpc_tms5220_index_build(&lpc_context, buffer, STREAM_CHECK_INTERVAL);
+
+    seek_errors = 0;
+    seeks       = 0;
+
+    for (frame = 0; frame < index.frame_count; frame = lpc_tms5220_frame_from_ms(++seeks * seek_ms)) {
+        part = lpc_tms5220_decode_from(&lpc_context, buffer, index, frame, STREAM_CHECK_CODES, &decoder);
+
+        if (part.count == 0 || frame >= codes.count) {
+            seek_errors++;
+        } else if (memcmp(part.code, &codes.code[frame], sizeof(Lpc_Code)) != 0
+                || decoder.phase_counter != phases[frame] || decoder.noise != noises[frame]) {
+            seek_errors++;
+        }
+
+        lpc_codes_free(&lpc_context, &part);
+    }
+
+    TRACE_END();
+
+    INFLOG("STREAM: %u seeks every %u ms, index of %u entries every %u frames, %u mismatches.",
+           seeks, seek_ms, index.count, index.interval, seek_errors);
+
+    mem_free(main_allocator, phases);
+    mem_free(main_allocator, noises);
+
+    lpc_tms5220_index_free(&lpc_context, &index);
+    lpc_codes_free(&lpc_context, &codes);
+    program_stream_free(path, &buffer);
+
+    program_memory_deinit();
+
+    return parse_errors > 0 || seek_errors > 0 ? 1 : 0;
+}
+
+// true if offset is inside some phrase of the rom, not at it's start
+b32 scan_check_inside(Lpc_TMS5220_Rom rom, Lpc_TMS5220_Buffer *buffers, u32 count, u32 offset) {
+    u32 i;
+
+    for (i = 0; i < count; i++) {
+        if (rom.offsets[i] < offset && offset < rom.offsets[i] + buffers[i].count) return true;
+    }
+
+    return false;
+}
+
+// Checks that phrases packed by lpc_tms5220_rom_build are found by the scanner at their exact offsets,
+// files are the same as for fifo check. Phrases that start inside another one (shared suffixes and
+// overlaps) can't be found on their own, and phrases that don't pass plausibility checks by themselves
+// (mostly silence) are not found either, both are only counted. Rest of the phrase that starts inside
+// another one can be found after it's end, that is counted too. Returns 1 on any missing or extra phrase.
+s32 scan_check_run(char **files, u32 file_count) {
+    Lpc_TMS5220_Buffer *buffers;
+    Lpc_TMS5220_Buffer dump;
+    char **paths;
+    Lpc_TMS5220_Rom rom;
+    Lpc_TMS5220_Scan scan;
+    Lpc_TMS5220_Phrase phrase;
+    u32 i, j, count, total, shared, rejected, found, missing, tails, extra, thread_count;
+    b32 listed, tail;
+
+    program_memory_init();
+
+    buffers = (Lpc_TMS5220_Buffer*)mem_alloc(main_allocator, sizeof(Lpc_TMS5220_Buffer) * file_count);
+    paths   = (char**)mem_alloc(main_allocator, sizeof(char*) * file_count);
+    count   = 0;
+    total   = 0;
+
+    for (i = 0; i < file_count; i++) {
+        buffers[count] = program_stream_load(files[i]);
+
+        if (buffers[count].bytes == NULL) {
+            ERRLOG("SCAN: failed to load %s.", files[i]);
+            continue;
+        }
+
+        paths[count] = files[i];
+        total        += buffers[count].count;
+        count++;
+    }
+
+    // sharing only makes it smaller, so rom of whole chips always fits
+    memset(&rom, 0, sizeof(Lpc_TMS5220_Rom));
+    if (count > 0) rom = lpc_tms5220_rom_build(&lpc_context, buffers, count, (u32)ALIGN_UP(total, KB(16)));
+
+    if (count == 0 || rom.bytes == NULL) {
+        ERRLOG("SCAN: failed to build rom of %u phrases.", count);
+
+        for (i = 0; i < count; i++) program_stream_free(paths[i], &buffers[i]);
+
+        lpc_tms5220_rom_free(&lpc_context, &rom);
+        mem_free(main_allocator, buffers);
+        mem_free(main_allocator, paths);
+        program_memory_deinit();
+        return 1;
+    }
+
+    dump.bytes = rom.bytes;
+    dump.count = rom.count;
+
+    scan = rom_scan_dump(dump, &thread_count);
+
+    shared   = 0;
+    rejected = 0;
+    found    = 0;
+    missing  = 0;
+
+    for (i = 0; i < count; i++) {
+        if (scan_check_inside(rom, buffers, count, rom.offsets[i])) {
+            shared++;
+            continue;
+        }
+
+        if (!lpc_tms5220_scan_offset(dump, rom.offsets[i], LPC_DEFAULT_SCAN_SETTINGS, &phrase)) {
+            rejected++;
+            INFLOG("SCAN: phrase %u at 0x%04X doesn't look like speech to the scanner.", i, rom.offsets[i]);
+            continue;
+        }
+
+        listed = false;
+
+        for (j = 0; j < scan.count; j++) {
+            if (scan.phrases[j].offset == rom.offsets[i]) listed = true;
+        }
+
+        if (listed) {
+            found++;
+        } else {
+            missing++;
+            INFLOG("SCAN: phrase %u at 0x%04X is not found.", i, rom.offsets[i]);
+        }
+    }
+
+    tails = 0;
+    extra = 0;
+
+    for (j = 0; j < scan.count; j++) {
+        listed = false;
+        tail   = false;
+
+        for (i = 0; i < count; i++) {
+            if (scan.phrases[j].offset == rom.offsets[i]) listed = true;
+
+            if (scan_check_inside(rom, buffers, count, rom.offsets[i])
+             && rom.offsets[i] < scan.phrases[j].offset && scan.phrases[j].offset < rom.offsets[i] + buffers[i].count) tail = true;
+        }
+
+        if (!listed && tail) {
+            tails++;
+        } else if (!listed) {
+            extra++;
+            INFLOG("SCAN: phrase at 0x%04X is not in the rom.", scan.phrases[j].offset);
+        }
+    }
+
+    INFLOG("SCAN: %u phrases in rom of %u bytes, %u inside others, %u rejected, %u found at their offsets, %u missing, %u extra, %u tails.",
+           count, rom.count, shared, rejected, found, missing, extra, tails);
+
+    lpc_tms5220_scan_free(&lpc_context, &scan);
+    lpc_tms5220_rom_free(&lpc_context, &rom);
+
+    for (i = 0; i < count; i++) {
+        program_stream_free(paths[i], &buffers[i]);
+    }
+
+    mem_free(main_allocator, buffers);
+    mem_free(main_allocator, paths);
+    program_memory_deinit();
+
+    return missing > 0 || extra > 0 ? 1 : 0;
+}
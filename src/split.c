@@ -0,0 +1,207 @@
+// Splitting of long recordings (session files with many lines) into phrases:
+//
+//     c_wizard --split <file> [output dir]
+//
+// File is cut at silence with lpc_split, and phrases are encoded on worker threads, each worker
+// takes every thread_count-th phrase. Every phrase goes to lpc10_<name>_NNN.bin, all of them are
+// packed into lpc10_<name>_rom.bin (16K VSM chips), and lpc10_<name>_index.h has their addresses
+// in that rom with times in the recording. Encoder trims silence at the ends of every phrase,
+// so times are of the encoded part, lead in moves the start.
+
+typedef struct {
+    Lpc_Context        context;
+    Lpc_Sample_Buffer  samples;
+    Lpc_Split          split;
+    u32                first, step;
+
+    Lpc_TMS5220_Buffer *buffers; // one for every phrase, shared by jobs
+    u32                *frames;
+    u32                *lead_ins;
+} Split_Job;
+
+s32 split_thread_proc(void *data) {
+    Split_Job *job = (Split_Job*)data;
+    Lpc_Sample_Buffer samples;
+    Lpc_Encoder encoder;
+    Lpc_Bitcodes codes;
+    u32 i;
+
+    TRACE_THREAD("split");
+
+    for (i = job->first; i < job->split.count; i += job->step) {
+        samples = lpc_split_range_buffer(job->samples, job->split.ranges[i]);
+
+        lpc_encode_begin(&job->context, &encoder, samples, LPC_DEFAULT_SETTINGS);
+        while (!lpc_encode_step(&job->context, &encoder, 0));
+        codes = lpc_encode_end(&job->context, &encoder, &job->lead_ins[i]);
+
+        job->buffers[i] = lpc_tms5220_encode_bitcodes(&job->context, codes);
+        job->frames[i]  = codes.count;
+
+        lpc_bitcodes_free(&job->context, &codes);
+    }
+
+    return 0;
+}
+
+void split_export(const char *output, const char *name, Lpc_Split split, Lpc_TMS5220_Buffer *buffers, u32 *frames, u32 *lead_ins) {
+    Lpc_TMS5220_Rom rom;
+    Lpc_Split_Range range;
+    char *text;
+    u64 i, text_size, length;
+    f64 at, duration;
+    u32 total;
+
+    TRACE_BEGIN("split export");
+
+    total = 0;
+
+    for (i = 0; i < split.count; i++) {
+        SaveFileData(TextFormat("%s/lpc10_%s_%03u.bin", output, name, (u32)i), buffers[i].bytes, buffers[i].count);
+        total += buffers[i].count;
+    }
+
+    // sharing only makes it smaller, so rom of whole chips always fits
+    rom = lpc_tms5220_rom_build(&lpc_context, buffers, split.count, (u32)ALIGN_UP(total, KB(16)));
+
+    if (rom.bytes == NULL) {
+        ERRLOG("Split: failed to build rom of %u phrases.", split.count);
+        TRACE_END();
+        return;
+    }
+
+    SaveFileData(TextFormat("%s/lpc10_%s_rom.bin", output, name), rom.bytes, rom.count);
+
+    // line for every phrase with address in the rom, time and size
+    text_size = KB(1) + split.count * (strlen(name) + 128);
+    text      = (char*)mem_alloc(main_allocator, text_size);
+    length    = 0;
+
+    length += snprintf(text + length, text_size - length, "// Generated by c-wizard, phrases of %s in lpc10_%s_rom.bin\n\n", name, name);
+    length += snprintf(text + length, text_size - length, "#define LPC10_");
+    length += macro_name_write(text + length, name);
+    length += snprintf(text + length, text_size - length, "_COUNT %u\n\n", split.count);
+
+    for (i = 0; i < split.count; i++) {
+        range = split.ranges[i];
+
+        // last frame is stop code
+        at       = (f64)(range.first + lead_ins[i]) / LPC_SAMPLE_RATE;
+        duration = frames[i] > 0 ? (f64)(frames[i] - 1) * LPC_SAMPLES / LPC_SAMPLE_RATE : 0;
+
+        length += snprintf(text + length, text_size - length, "#define LPC10_");
+        length += macro_name_write(text + length, name);
+        length += snprintf(text + length, text_size - length, "_%03u 0x%04X // at %8.3f s, %6.3f s, %5u bytes, %4u frames\n", (u32)i, rom.offsets[i],
+                           at, duration, buffers[i].count, frames[i]);
+    }
+
+    SaveFileText(TextFormat("%s/lpc10_%s_index.h", output, name), text);
+
+    INFLOG("Split: %u phrases of %s, rom is %u bytes, %u of them used.", split.count, name, rom.count, rom.used);
+
+    mem_free(main_allocator, text);
+    lpc_tms5220_rom_free(&lpc_context, &rom);
+
+    TRACE_END();
+}
+
+s32 split_run(const char *path, const char *output) {
+    Thread    threads[MAX_THREADS];
+    Split_Job jobs[MAX_THREADS];
+    Lpc_TMS5220_Buffer *buffers;
+    Lpc_Sample_Buffer samples;
+    Lpc_Split split;
+    Wave wave;
+    char name[256];
+    u32 *frames, *lead_ins;
+    u32 i, thread_count;
+    f64 start;
+
+    program_memory_init();
+
+    if (output == NULL) output = ".";
+
+    TRACE_BEGIN("load");
+    wave = LoadWave(path);
+
+    if (!IsWaveValid(wave)) {
+        ERRLOG("Split: failed to load %s.", path);
+        TRACE_END();
+        program_memory_deinit();
+        return 1;
+    }
+
+    WaveFormat(&wave, LPC_SAMPLE_RATE, 32, 1);
+    TRACE_END();
+
+    TextCopy(name, TextSubtext(GetFileNameWithoutExt(path), 0, sizeof(name) - 1));
+
+    samples.sample_rate = LPC_SAMPLE_RATE;
+    samples.channels    = 1;
+    samples.frame_count = wave.frameCount;
+    samples.samples     = (f32*)wave.data;
+
+    start = platform_get_time();
+    split = lpc_split(&lpc_context, samples, LPC_DEFAULT_SPLIT_SETTINGS);
+
+    if (split.count == 0) {
+        ERRLOG("Split: no speech in %s.", path);
+        lpc_split_free(&lpc_context, &split);
+        UnloadWave(wave);
+        program_memory_deinit();
+        return 1;
+    }
+
+    buffers  = (Lpc_TMS5220_Buffer*)mem_alloc(main_allocator, sizeof(Lpc_TMS5220_Buffer) * split.count);
+    frames   = (u32*)mem_alloc(main_allocator, sizeof(u32) * split.count);
+    lead_ins = (u32*)mem_alloc(main_allocator, sizeof(u32) * split.count);
+
+    thread_count = platform_get_processor_count();
+    thread_count = MIN(thread_count, split.count);
+
+    memset(threads, 0, sizeof(threads));
+
+    for (i = 0; i < thread_count; i++) {
+        program_lpc_context_init(&jobs[i].context);
+        jobs[i].samples  = samples;
+        jobs[i].split    = split;
+        jobs[i].first    = i;
+        jobs[i].step     = thread_count;
+        jobs[i].buffers  = buffers;
+        jobs[i].frames   = frames;
+        jobs[i].lead_ins = lead_ins;
+
+        // this thread does the last part itself
+        if (i == thread_count - 1 || !thread_start(&threads[i], split_thread_proc, &jobs[i])) {
+            split_thread_proc(&jobs[i]);
+        }
+    }
+
+    for (i = 0; i < thread_count; i++) {
+        thread_join(&threads[i]);
+    }
+
+    INFLOG("Split: %u phrases found in %s (%.2f s), encoded in %.2f s on %u threads.", split.count, path,
+           (f64)samples.frame_count / LPC_SAMPLE_RATE, platform_get_time() - start, thread_count);
+
+    split_export(output, name, split, buffers, frames, lead_ins);
+
+    for (i = 0; i < split.count; i++) {
+        lpc_tms5220_buffer_free(&jobs[i % thread_count].context, &buffers[i]);
+    }
+
+    for (i = 0; i < thread_count; i++) {
+        lpc_context_free(&jobs[i].context);
+    }
+
+    mem_free(main_allocator, buffers);
+    mem_free(main_allocator, frames);
+    mem_free(main_allocator, lead_ins);
+
+    lpc_split_free(&lpc_context, &split);
+    UnloadWave(wave);
+
+    program_memory_deinit();
+
+    return 0;
+}
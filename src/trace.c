@@ -0,0 +1,190 @@
+// Timeline of nested zones on every thread, written as Chrome Trace Event JSON at exit,
+// open it in ui.perfetto.dev or chrome://tracing. Enabled with TRACE=1 (/D TRACE), without it
+// macros below are empty and none of this is compiled.
+//
+//     TRACE_BEGIN("export");
+//     ...
+//     TRACE_END();
+//
+// Zone is closed on the same thread in reverse order, names are string literals. Thread writes
+// finished zones to it's own ring, so recording doesn't lock anything, only first zone of thread
+// takes lock to get the ring. When ring is full oldest zones are overwritten.
+
+#if TRACE
+
+#define TRACE_FILE        "c_wizard_trace.json"
+#define TRACE_MAX_THREADS 128
+#define TRACE_RING_SIZE   KB(16) // zones per thread
+#define TRACE_STACK_DEPTH 64
+#define TRACE_NAME_SIZE   32
+
+#define TRACE_INIT()       trace_init()
+#define TRACE_THREAD(name) trace_thread_name(name)
+#define TRACE_BEGIN(name)  trace_begin(name)
+#define TRACE_END()        trace_end()
+
+typedef struct {
+    const char *name;
+    f64 start;
+    f64 duration;
+} Trace_Zone;
+
+typedef struct {
+    u64 count; // zones written, next one goes to count % TRACE_RING_SIZE
+    u32 depth;
+    char name[TRACE_NAME_SIZE];
+
+    Trace_Zone  stack[TRACE_STACK_DEPTH];
+    Trace_Zone *ring;
+} Trace_Thread;
+
+typedef struct {
+    b32   ready;
+    mtx_t lock;
+    f64   start;
+
+    u32          thread_count;
+    Trace_Thread threads[TRACE_MAX_THREADS];
+} Trace_State;
+
+Trace_State trace;
+
+THREAD_LOCAL Trace_Thread *trace_thread;
+THREAD_LOCAL b32           trace_thread_dropped; // no free slot, zones of this thread are not recorded
+
+Trace_Thread *trace_thread_get(void) {
+    Trace_Thread *thread;
+    void *ring;
+    u64 size;
+
+    if (trace_thread != NULL)                 return trace_thread;
+    if (!trace.ready || trace_thread_dropped) return NULL;
+
+    size = ALIGN_UP(sizeof(Trace_Zone) * TRACE_RING_SIZE, PG(1));
+    ring = platform_reserve(size);
+
+    if (ring != NULL && !platform_commit(ring, size)) {
+        platform_release(ring, size);
+        ring = NULL;
+    }
+
+    mtx_lock(&trace.lock);
+
+    if (ring != NULL && trace.thread_count < TRACE_MAX_THREADS) {
+        thread       = &trace.threads[trace.thread_count];
+        thread->ring = (Trace_Zone*)ring;
+
+        snprintf(thread->name, TRACE_NAME_SIZE, "thread %u", trace.thread_count);
+
+        trace.thread_count++;
+        trace_thread = thread;
+    } else {
+        if (ring != NULL) platform_release(ring, size);
+        trace_thread_dropped = true;
+    }
+
+    mtx_unlock(&trace.lock);
+
+    return trace_thread;
+}
+
+void trace_thread_name(const char *name) {
+    Trace_Thread *thread = trace_thread_get();
+
+    if (thread == NULL) return;
+
+    snprintf(thread->name, TRACE_NAME_SIZE, "%s", name);
+}
+
+void trace_begin(const char *name) {
+    Trace_Thread *thread = trace_thread_get();
+
+    if (thread == NULL) return;
+
+    // zones deeper than stack are not recorded, but still counted so ends match
+    if (thread->depth < TRACE_STACK_DEPTH) {
+        thread->stack[thread->depth].name  = name;
+        thread->stack[thread->depth].start = platform_get_time();
+    }
+
+    thread->depth++;
+}
+
+void trace_end(void) {
+    Trace_Thread *thread = trace_thread;
+    Trace_Zone zone;
+
+    if (thread == NULL) return;
+
+    assert(thread->depth > 0);
+    thread->depth--;
+
+    if (thread->depth >= TRACE_STACK_DEPTH) return;
+
+    zone          = thread->stack[thread->depth];
+    zone.duration = platform_get_time() - zone.start;
+
+    thread->ring[thread->count % TRACE_RING_SIZE] = zone;
+    thread->count++;
+}
+
+// runs at exit, other threads are joined by then
+void trace_dump(void) {
+    Trace_Thread *thread;
+    Trace_Zone *zone;
+    FILE *file;
+    u64 i, first, zone_count;
+    u32 t;
+
+    file = fopen(TRACE_FILE, "w");
+
+    if (file == NULL) {
+        ERRLOG("Trace: failed to open %s.", TRACE_FILE);
+        return;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"c-wizard\"}}");
+
+    zone_count = 0;
+
+    for (t = 0; t < trace.thread_count; t++) {
+        thread = &trace.threads[t];
+        first  = thread->count > TRACE_RING_SIZE ? thread->count - TRACE_RING_SIZE : 0;
+
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", t, thread->name);
+
+        for (i = first; i < thread->count; i++) {
+            zone = &thread->ring[i % TRACE_RING_SIZE];
+
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    zone->name, t, (zone->start - trace.start) * 1e6, zone->duration * 1e6);
+        }
+
+        zone_count += thread->count - first;
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    INFLOG("Trace: %llu zones on %u threads written to %s.", (unsigned long long)zone_count, trace.thread_count, TRACE_FILE);
+}
+
+void trace_init(void) {
+    mtx_init(&trace.lock, mtx_plain);
+
+    trace.start = platform_get_time();
+    trace.ready = true;
+
+    trace_thread_name("main");
+    atexit(trace_dump);
+}
+
+#else
+
+#define TRACE_INIT()
+#define TRACE_THREAD(name)
+#define TRACE_BEGIN(name)
+#define TRACE_END()
+
+#endif
@@ -0,0 +1,769 @@
+// Viewer of the last converted file: source and decoded waveforms, spectrogram of the
+// source and energy, pitch and voicing of every frame.
+//
+// Waveforms are drawn from min/max pyramid, every level halves the previous one, so at
+// zoom of 2^z samples per pixel every pixel is exactly one entry of level z - 1.
+// Tracks are rendered into VIEWER_TILE_WIDTH wide render textures that are cached per zoom
+// level, so panning and zooming renders only tiles that weren't visible before, zoom between
+// powers of two just scales them. Spectrogram is computed on another thread and columns are
+// uploaded into textures as they come.
+//
+// Mouse wheel zooms around the cursor, dragging pans, F fits the whole file.
+
+#define VIEWER_TILE_WIDTH      256
+#define VIEWER_TILE_COUNT      96
+#define VIEWER_TILES_PER_FRAME 8  // rendering of new tiles is spread between frames
+#define VIEWER_MIN_ZOOM       -4  // 16 pixels per sample
+#define VIEWER_MAX_LEVELS      32
+#define VIEWER_PADDING         4
+
+#define VIEWER_FFT_SIZE       256
+#define VIEWER_FFT_HOP        80  // 10 ms at LPC_SAMPLE_RATE
+#define VIEWER_FFT_BINS       (VIEWER_FFT_SIZE / 2)
+#define VIEWER_FFT_FLOOR_DB  -80.0f
+#define VIEWER_SPECTRUM_TILE  256 // columns in one spectrogram texture
+
+#define VIEWER_TRACK_COLOR   CLITERAL(Color) {0x26, 0x26, 0x26, 0xff}
+#define VIEWER_SOURCE_COLOR  CLITERAL(Color) {0xfa, 0x9a, 0x3c, 0xff}
+#define VIEWER_DECODED_COLOR CLITERAL(Color) {0x5a, 0xb4, 0xe6, 0xff}
+
+typedef enum {
+    VIEWER_TRACK_SOURCE,
+    VIEWER_TRACK_DECODED,
+    VIEWER_TRACK_FRAMES,
+    VIEWER_TRACK_COUNT,
+} Viewer_Track;
+
+// rows from top to bottom, spectrogram isn't tiled, so it's not a track
+typedef enum {
+    VIEWER_ROW_SOURCE,
+    VIEWER_ROW_DECODED,
+    VIEWER_ROW_SPECTROGRAM,
+    VIEWER_ROW_FRAMES,
+    VIEWER_ROW_COUNT,
+} Viewer_Row;
+
+typedef struct {
+    u32  count;
+    f32 *min, *max;
+} Viewer_Level;
+
+typedef struct {
+    f32         *samples;
+    u32          count;
+    f32          scale;       // 1 / peak, so quiet files are visible too
+    u32          level_count;
+    Viewer_Level levels[VIEWER_MAX_LEVELS]; // levels[i] has buckets of 2^(i + 1) samples
+} Viewer_Waveform;
+
+typedef struct {
+    RenderTexture2D texture;
+    s32 track;
+    s32 zoom;
+    s64 index;
+    u64 last_used;
+    b32 valid;
+} Viewer_Tile;
+
+// twiddles, bit reversal and window are computed once per spectrogram
+typedef struct {
+    f32 cos[VIEWER_FFT_SIZE / 2];
+    f32 sin[VIEWER_FFT_SIZE / 2];
+    u32 reverse[VIEWER_FFT_SIZE];
+    f32 window[VIEWER_FFT_SIZE];
+} Viewer_Fft_Plan;
+
+typedef struct {
+    Thread       thread;
+    volatile b32 cancel;
+    volatile u32 columns_done; // thread writes it after pixels of the column are ready
+
+    const f32 *samples;
+    u32        sample_count;
+
+    u32    column_count;
+    u32    columns_uploaded;
+    Color *pixels;             // column after column, VIEWER_FFT_BINS pixels each
+
+    u32        texture_count;
+    Texture2D *textures;
+} Viewer_Spectrogram;
+
+typedef struct {
+    Allocator allocator;
+    b32       loaded;
+
+    Viewer_Waveform waves[2];  // VIEWER_TRACK_SOURCE, VIEWER_TRACK_DECODED
+    Lpc_Code       *codes;
+    u32             code_count;
+
+    Viewer_Spectrogram spectrogram;
+
+    Viewer_Tile tiles[VIEWER_TILE_COUNT];
+    s32         tile_height;
+    u64         frame_index;
+
+    Rectangle area;
+    f64       start;           // first visible sample
+    f64       samples_per_pixel;
+} Viewer;
+
+void viewer_init(Viewer *viewer, Allocator allocator) {
+    memset(viewer, 0, sizeof(Viewer));
+    viewer->allocator = allocator;
+}
+
+/// FFT
+
+void viewer_fft_plan(Viewer_Fft_Plan *plan) {
+    u32 i, j, bits;
+
+    for (i = 0; i < VIEWER_FFT_SIZE / 2; i++) {
+        plan->cos[i] =  cosf(TAU * i / VIEWER_FFT_SIZE);
+        plan->sin[i] = -sinf(TAU * i / VIEWER_FFT_SIZE);
+    }
+
+    for (bits = 0; (1u << bits) < VIEWER_FFT_SIZE; bits++);
+
+    for (i = 0; i < VIEWER_FFT_SIZE; i++) {
+        plan->reverse[i] = 0;
+
+        for (j = 0; j < bits; j++) {
+            plan->reverse[i] |= ((i >> j) & 1) << (bits - 1 - j);
+        }
+
+        plan->window[i] = 0.5f - 0.5f * cosf(TAU * i / (VIEWER_FFT_SIZE - 1));
+    }
+}
+
+// in place radix-2
+void viewer_fft(Viewer_Fft_Plan *plan, f32 *re, f32 *im) {
+    u32 i, j, k, size, half, step;
+    f32 tr, ti, wr, wi;
+
+    for (i = 0; i < VIEWER_FFT_SIZE; i++) {
+        j = plan->reverse[i];
+        if (j <= i) continue;
+
+        tr = re[i]; re[i] = re[j]; re[j] = tr;
+        ti = im[i]; im[i] = im[j]; im[j] = ti;
+    }
+
+    for (size = 2; size <= VIEWER_FFT_SIZE; size *= 2) {
+        half = size / 2;
+        step = VIEWER_FFT_SIZE / size;
+
+        for (i = 0; i < VIEWER_FFT_SIZE; i += size) {
+            for (k = 0; k < half; k++) {
+                wr = plan->cos[k * step];
+                wi = plan->sin[k * step];
+                j  = i + k + half;
+
+                tr = re[j] * wr - im[j] * wi;
+                ti = re[j] * wi + im[j] * wr;
+
+                re[j] = re[i + k] - tr;
+                im[j] = im[i + k] - ti;
+                re[i + k] += tr;
+                im[i + k] += ti;
+            }
+        }
+    }
+}
+
+// t in [0, 1], black -> purple -> orange -> yellow
+Color viewer_heat_color(f32 t) {
+    static const Color keys[] = {
+        {0x00, 0x00, 0x00, 0xff},
+        {0x5a, 0x1e, 0x78, 0xff},
+        {0xe6, 0x6e, 0x28, 0xff},
+        {0xff, 0xf0, 0x8c, 0xff},
+    };
+    Color a, b, result;
+    u32 i;
+
+    t = Clamp(t, 0.0f, 1.0f) * 3.0f;
+    i = MIN((u32)t, 2);
+    t = t - i;
+    a = keys[i];
+    b = keys[i + 1];
+
+    result.r = (u8)(a.r + (b.r - a.r) * t);
+    result.g = (u8)(a.g + (b.g - a.g) * t);
+    result.b = (u8)(a.b + (b.b - a.b) * t);
+    result.a = 0xff;
+
+    return result;
+}
+
+s32 viewer_spectrogram_proc(void *data) {
+    Viewer_Spectrogram *spectrogram = (Viewer_Spectrogram*)data;
+    Viewer_Fft_Plan plan;
+    f32 re[VIEWER_FFT_SIZE], im[VIEWER_FFT_SIZE];
+    f32 db, norm;
+    s64 offset, sample;
+    u32 i, column;
+    Color *pixels;
+
+    viewer_fft_plan(&plan);
+
+    // full scale sine with hann window peaks at size / 4
+    norm = 1.0f / ((VIEWER_FFT_SIZE / 4.0f) * (VIEWER_FFT_SIZE / 4.0f));
+
+    for (column = 0; column < spectrogram->column_count; column++) {
+        if (spectrogram->cancel) break;
+
+        offset = (s64)column * VIEWER_FFT_HOP + VIEWER_FFT_HOP / 2 - VIEWER_FFT_SIZE / 2;
+
+        for (i = 0; i < VIEWER_FFT_SIZE; i++) {
+            sample = offset + i;
+            re[i]  = (sample >= 0 && sample < spectrogram->sample_count) ? spectrogram->samples[sample] * plan.window[i] : 0;
+            im[i]  = 0;
+        }
+
+        viewer_fft(&plan, re, im);
+
+        pixels = spectrogram->pixels + (u64)column * VIEWER_FFT_BINS;
+
+        for (i = 0; i < VIEWER_FFT_BINS; i++) {
+            db = 10.0f * log10f((re[i] * re[i] + im[i] * im[i]) * norm + 1e-12f);
+            pixels[i] = viewer_heat_color(1.0f - db / VIEWER_FFT_FLOOR_DB);
+        }
+
+        spectrogram->columns_done = column + 1;
+    }
+
+    return 0;
+}
+
+// new columns are copied into row major rect, as texture update wants it
+void viewer_spectrogram_upload(Viewer_Spectrogram *spectrogram) {
+    u32 done, tile, first, last, width, i, j;
+    Color *rect;
+
+    done = spectrogram->columns_done;
+
+    while (spectrogram->columns_uploaded < done) {
+        tile  = spectrogram->columns_uploaded / VIEWER_SPECTRUM_TILE;
+        first = spectrogram->columns_uploaded;
+        last  = MIN((tile + 1) * VIEWER_SPECTRUM_TILE, done);
+        width = last - first;
+
+        rect = (Color*)temp_allocate_nozero(sizeof(Color) * width * VIEWER_FFT_BINS);
+
+        for (i = 0; i < VIEWER_FFT_BINS; i++) {
+            for (j = 0; j < width; j++) {
+                rect[i * width + j] = spectrogram->pixels[(u64)(first + j) * VIEWER_FFT_BINS + i];
+            }
+        }
+
+        UpdateTextureRec(spectrogram->textures[tile], CLITERAL(Rectangle) { first - tile * VIEWER_SPECTRUM_TILE, 0, width, VIEWER_FFT_BINS }, rect);
+
+        spectrogram->columns_uploaded = last;
+    }
+}
+
+void viewer_spectrogram_start(Viewer *viewer, Viewer_Waveform *wave) {
+    Viewer_Spectrogram *spectrogram = &viewer->spectrogram;
+    Image image;
+    u32 i;
+
+    memset(spectrogram, 0, sizeof(Viewer_Spectrogram));
+
+    spectrogram->samples       = wave->samples;
+    spectrogram->sample_count  = wave->count;
+    spectrogram->column_count  = (wave->count + VIEWER_FFT_HOP - 1) / VIEWER_FFT_HOP;
+    spectrogram->texture_count = (spectrogram->column_count + VIEWER_SPECTRUM_TILE - 1) / VIEWER_SPECTRUM_TILE;
+
+    spectrogram->pixels   = (Color*)mem_alloc(viewer->allocator, sizeof(Color) * spectrogram->column_count * VIEWER_FFT_BINS);
+    spectrogram->textures = (Texture2D*)mem_alloc(viewer->allocator, sizeof(Texture2D) * spectrogram->texture_count);
+
+    image = GenImageColor(VIEWER_SPECTRUM_TILE, VIEWER_FFT_BINS, BLACK);
+
+    for (i = 0; i < spectrogram->texture_count; i++) {
+        spectrogram->textures[i] = LoadTextureFromImage(image);
+        SetTextureFilter(spectrogram->textures[i], TEXTURE_FILTER_BILINEAR);
+    }
+
+    UnloadImage(image);
+
+    if (!thread_start(&spectrogram->thread, viewer_spectrogram_proc, spectrogram)) {
+        viewer_spectrogram_proc(spectrogram);
+    }
+}
+
+void viewer_spectrogram_stop(Viewer *viewer) {
+    Viewer_Spectrogram *spectrogram = &viewer->spectrogram;
+    u32 i;
+
+    spectrogram->cancel = true;
+    thread_join(&spectrogram->thread);
+
+    for (i = 0; i < spectrogram->texture_count; i++) {
+        UnloadTexture(spectrogram->textures[i]);
+    }
+
+    if (spectrogram->textures) mem_free(viewer->allocator, spectrogram->textures);
+    if (spectrogram->pixels)   mem_free(viewer->allocator, spectrogram->pixels);
+
+    memset(spectrogram, 0, sizeof(Viewer_Spectrogram));
+}
+
+/// Waveforms
+
+// offset is count of silent samples put before the buffer
+void viewer_waveform_build(Viewer *viewer, Viewer_Waveform *wave, Lpc_Sample_Buffer buffer, u32 offset) {
+    Viewer_Level *level;
+    const f32 *min, *max;
+    f32 peak;
+    u32 i, a, b, count;
+
+    memset(wave, 0, sizeof(Viewer_Waveform));
+
+    wave->count   = offset + buffer.frame_count;
+    wave->samples = (f32*)mem_alloc(viewer->allocator, sizeof(f32) * (MAX(wave->count, 1)));
+    memset(wave->samples, 0, sizeof(f32) * offset);
+    memcpy(wave->samples + offset, buffer.samples, sizeof(f32) * buffer.frame_count);
+
+    peak = 0;
+    for (i = 0; i < wave->count; i++) {
+        peak = MAX(peak, fabsf(wave->samples[i]));
+    }
+
+    wave->scale = peak > 0 ? 1.0f / peak : 1.0f;
+
+    min   = wave->samples;
+    max   = wave->samples;
+    count = wave->count;
+
+    while (count > 1 && wave->level_count < VIEWER_MAX_LEVELS) {
+        level = &wave->levels[wave->level_count++];
+
+        level->count = (count + 1) / 2;
+        level->min   = (f32*)mem_alloc(viewer->allocator, sizeof(f32) * level->count);
+        level->max   = (f32*)mem_alloc(viewer->allocator, sizeof(f32) * level->count);
+
+        for (i = 0; i < level->count; i++) {
+            a = i * 2;
+            b = MIN(a + 1, count - 1);
+
+            level->min[i] = MIN(min[a], min[b]);
+            level->max[i] = MAX(max[a], max[b]);
+        }
+
+        min   = level->min;
+        max   = level->max;
+        count = level->count;
+    }
+}
+
+void viewer_waveform_free(Viewer *viewer, Viewer_Waveform *wave) {
+    u32 i;
+
+    for (i = 0; i < wave->level_count; i++) {
+        mem_free(viewer->allocator, wave->levels[i].min);
+        mem_free(viewer->allocator, wave->levels[i].max);
+    }
+
+    if (wave->samples) mem_free(viewer->allocator, wave->samples);
+
+    memset(wave, 0, sizeof(Viewer_Waveform));
+}
+
+/// Tiles
+
+void viewer_tiles_unload(Viewer *viewer) {
+    u32 i;
+
+    for (i = 0; i < VIEWER_TILE_COUNT; i++) {
+        if (viewer->tiles[i].texture.id != 0) {
+            UnloadRenderTexture(viewer->tiles[i].texture);
+        }
+    }
+
+    memset(viewer->tiles, 0, sizeof(viewer->tiles));
+}
+
+Viewer_Tile *viewer_tile_find(Viewer *viewer, s32 track, s32 zoom, s64 index) {
+    Viewer_Tile *tile;
+    u32 i;
+
+    for (i = 0; i < VIEWER_TILE_COUNT; i++) {
+        tile = &viewer->tiles[i];
+
+        if (tile->valid && tile->track == track && tile->zoom == zoom && tile->index == index) {
+            return tile;
+        }
+    }
+
+    return NULL;
+}
+
+// least recently used tile, that is not visible in this frame
+Viewer_Tile *viewer_tile_take(Viewer *viewer) {
+    Viewer_Tile *tile, *result;
+    u32 i;
+
+    result = NULL;
+
+    for (i = 0; i < VIEWER_TILE_COUNT; i++) {
+        tile = &viewer->tiles[i];
+
+        if (!tile->valid) return tile;
+        if (tile->last_used == viewer->frame_index) continue;
+
+        if (result == NULL || tile->last_used < result->last_used) {
+            result = tile;
+        }
+    }
+
+    return result;
+}
+
+void viewer_draw_waveform(Viewer_Waveform *wave, s32 zoom, s64 index, s32 height, Color color) {
+    Viewer_Level *level;
+    f64 tile_spp, first_sample;
+    f32 mid, y0, y1, x0, x1;
+    s64 i, first, last, bucket;
+    s32 x;
+
+    if (wave->count == 0) return;
+
+    mid = height / 2.0f;
+
+    if (zoom > 0 && wave->level_count > 0) {
+        level = &wave->levels[(MIN((u32)zoom, wave->level_count)) - 1];
+
+        for (x = 0; x < VIEWER_TILE_WIDTH; x++) {
+            bucket = index * VIEWER_TILE_WIDTH + x;
+            if (bucket >= level->count) break;
+
+            y0 = mid - level->max[bucket] * wave->scale * mid;
+            y1 = mid - level->min[bucket] * wave->scale * mid;
+
+            DrawRectangleRec(CLITERAL(Rectangle) { x, y0, 1, MAX(y1 - y0, 1) }, color);
+        }
+
+        return;
+    }
+
+    // zoomed in, line between samples
+    tile_spp     = ldexp(1.0, zoom);
+    first_sample = index * VIEWER_TILE_WIDTH * tile_spp;
+
+    first = MAX((s64)floor(first_sample) - 1, 0);
+    last  = MIN((s64)ceil(first_sample + VIEWER_TILE_WIDTH * tile_spp) + 1, (s64)wave->count - 1);
+
+    for (i = first; i < last; i++) {
+        x0 = (f32)((i     - first_sample) / tile_spp);
+        x1 = (f32)((i + 1 - first_sample) / tile_spp);
+        y0 = mid - wave->samples[i]     * wave->scale * mid;
+        y1 = mid - wave->samples[i + 1] * wave->scale * mid;
+
+        DrawLineV(CLITERAL(Vector2) { x0, y0 }, CLITERAL(Vector2) { x1, y1 }, color);
+    }
+}
+
+// energy as bar from the bottom, colored by voicing, pitch as a tick
+void viewer_draw_frames(Viewer *viewer, s32 zoom, s64 index, s32 height) {
+    Lpc_Code code;
+    f64 tile_spp, first_sample;
+    f32 x0, x1, bar;
+    s64 i, first, last;
+    Color color;
+
+    tile_spp     = ldexp(1.0, zoom);
+    first_sample = index * VIEWER_TILE_WIDTH * tile_spp;
+
+    first = MAX((s64)(first_sample / LPC_SAMPLES), 0);
+    last  = MIN((s64)((first_sample + VIEWER_TILE_WIDTH * tile_spp) / LPC_SAMPLES) + 1, (s64)viewer->code_count);
+
+    for (i = first; i < last; i++) {
+        code = viewer->codes[i];
+
+        x0 = (f32)((i * LPC_SAMPLES - first_sample) / tile_spp);
+        x1 = (f32)(((i + 1) * LPC_SAMPLES - first_sample) / tile_spp);
+        x1 = MAX(x1 - 1, x0 + 1); // gap between frames when they are wide enough
+
+        if (code.energy == LPC_ENERGY_STOP) {
+            DrawRectangleRec(CLITERAL(Rectangle) { x0, 0, 1, height }, RED);
+            continue;
+        }
+
+        if (code.energy == LPC_ENERGY_ZERO) {
+            DrawRectangleRec(CLITERAL(Rectangle) { x0, height - 2, x1 - x0, 2 }, GRAY);
+            continue;
+        }
+
+        color = code.pitch ? VIEWER_SOURCE_COLOR : VIEWER_DECODED_COLOR;
+        if (code.repeat) color = Fade(color, 0.6f);
+
+        bar = height * 0.8f * code.energy / (LPC_ENERGY_STOP - 1);
+        DrawRectangleRec(CLITERAL(Rectangle) { x0, height - bar, x1 - x0, bar }, color);
+
+        if (code.pitch) {
+            DrawRectangleRec(CLITERAL(Rectangle) { x0, height - 2 - (height - 4) * (f32)code.pitch / LPC_PITCH_MASK, x1 - x0, 2 }, WHITE);
+        }
+    }
+}
+
+void viewer_tile_render(Viewer *viewer, Viewer_Tile *tile) {
+    if (tile->texture.id == 0) {
+        tile->texture = LoadRenderTexture(VIEWER_TILE_WIDTH, viewer->tile_height);
+    }
+
+    BeginTextureMode(tile->texture);
+    ClearBackground(VIEWER_TRACK_COLOR);
+
+    switch (tile->track) {
+        case VIEWER_TRACK_SOURCE:
+            viewer_draw_waveform(&viewer->waves[VIEWER_TRACK_SOURCE], tile->zoom, tile->index, viewer->tile_height, VIEWER_SOURCE_COLOR);
+            break;
+        case VIEWER_TRACK_DECODED:
+            viewer_draw_waveform(&viewer->waves[VIEWER_TRACK_DECODED], tile->zoom, tile->index, viewer->tile_height, VIEWER_DECODED_COLOR);
+            break;
+        case VIEWER_TRACK_FRAMES:
+            viewer_draw_frames(viewer, tile->zoom, tile->index, viewer->tile_height);
+            break;
+    }
+
+    EndTextureMode();
+}
+
+/// Viewer
+
+void viewer_clear(Viewer *viewer) {
+    u32 i;
+
+    viewer_spectrogram_stop(viewer);
+
+    viewer_waveform_free(viewer, &viewer->waves[VIEWER_TRACK_SOURCE]);
+    viewer_waveform_free(viewer, &viewer->waves[VIEWER_TRACK_DECODED]);
+
+    if (viewer->codes) mem_free(viewer->allocator, viewer->codes);
+
+    viewer->codes      = NULL;
+    viewer->code_count = 0;
+    viewer->loaded     = false;
+
+    // tiles of the previous file are useless, textures are kept
+    for (i = 0; i < VIEWER_TILE_COUNT; i++) {
+        viewer->tiles[i].valid = false;
+    }
+}
+
+void viewer_free(Viewer *viewer) {
+    viewer_clear(viewer);
+    viewer_tiles_unload(viewer);
+}
+
+// everything is copied, buffers can be freed after that
+// lead_in is silence trimmed by encoder, decoded and codes are moved by it to line up with source
+void viewer_load(Viewer *viewer, Lpc_Sample_Buffer source, Lpc_Sample_Buffer decoded, Lpc_Codes codes, u32 lead_in) {
+    u32 i, skipped;
+
+    viewer_clear(viewer);
+
+    skipped = lead_in / LPC_SAMPLES;
+
+    viewer_waveform_build(viewer, &viewer->waves[VIEWER_TRACK_SOURCE],  source,  0);
+    viewer_waveform_build(viewer, &viewer->waves[VIEWER_TRACK_DECODED], decoded, lead_in);
+
+    viewer->code_count = skipped + codes.count;
+    viewer->codes      = (Lpc_Code*)mem_alloc(viewer->allocator, sizeof(Lpc_Code) * (MAX(viewer->code_count, 1)));
+
+    for (i = 0; i < skipped; i++) {
+        memset(&viewer->codes[i], 0, sizeof(Lpc_Code));
+        viewer->codes[i].energy = LPC_ENERGY_ZERO;
+    }
+
+    memcpy(viewer->codes + skipped, codes.code, sizeof(Lpc_Code) * codes.count);
+
+    viewer_spectrogram_start(viewer, &viewer->waves[VIEWER_TRACK_SOURCE]);
+
+    viewer->start             = 0;
+    viewer->samples_per_pixel = 0; // fitted on next update
+    viewer->loaded            = true;
+}
+
+Rectangle viewer_row_rect(Viewer *viewer, Viewer_Row row) {
+    Rectangle rect = viewer->area;
+
+    rect.height = (f32)viewer->tile_height;
+    rect.y     += row * (viewer->tile_height + VIEWER_PADDING);
+
+    return rect;
+}
+
+u32 viewer_length(Viewer *viewer) {
+    return MAX(viewer->waves[VIEWER_TRACK_SOURCE].count, viewer->waves[VIEWER_TRACK_DECODED].count);
+}
+
+s32 viewer_zoom(Viewer *viewer) {
+    s32 zoom, max_zoom;
+
+    max_zoom = MAX(viewer->waves[VIEWER_TRACK_SOURCE].level_count, viewer->waves[VIEWER_TRACK_DECODED].level_count);
+    zoom     = (s32)floor(log2(viewer->samples_per_pixel));
+
+    if (zoom < VIEWER_MIN_ZOOM) zoom = VIEWER_MIN_ZOOM;
+    if (zoom > max_zoom)        zoom = max_zoom;
+
+    return zoom;
+}
+
+// interaction and rendering of missing tiles, has to be called before BeginDrawing
+void viewer_update(Viewer *viewer, Rectangle area) {
+    Viewer_Tile *tile;
+    Vector2 mouse;
+    f64 anchor, min_spp, max_spp, max_start, tile_samples;
+    s64 i, first, last;
+    s32 height, zoom, track, rendered;
+
+    viewer->area = area;
+    viewer->frame_index++;
+
+    if (!viewer->loaded) return;
+
+    viewer_spectrogram_upload(&viewer->spectrogram);
+
+    height = (s32)((area.height - VIEWER_PADDING * (VIEWER_ROW_COUNT - 1)) / VIEWER_ROW_COUNT);
+    if (height <= 0 || area.width <= 0) return;
+
+    if (height != viewer->tile_height) {
+        viewer_tiles_unload(viewer);
+        viewer->tile_height = height;
+    }
+
+    min_spp = ldexp(1.0, VIEWER_MIN_ZOOM);
+    max_spp = MAX(viewer_length(viewer) / area.width, min_spp);
+
+    if (viewer->samples_per_pixel <= 0 || IsKeyPressed(KEY_F)) {
+        viewer->samples_per_pixel = max_spp;
+        viewer->start             = 0;
+    }
+
+    mouse = GetMousePosition();
+
+    if (CheckCollisionPointRec(mouse, area)) {
+        if (GetMouseWheelMove() != 0) {
+            anchor = viewer->start + (mouse.x - area.x) * viewer->samples_per_pixel;
+
+            viewer->samples_per_pixel *= pow(0.8, GetMouseWheelMove());
+
+            if (viewer->samples_per_pixel < min_spp) viewer->samples_per_pixel = min_spp;
+            if (viewer->samples_per_pixel > max_spp) viewer->samples_per_pixel = max_spp;
+
+            viewer->start = anchor - (mouse.x - area.x) * viewer->samples_per_pixel;
+        }
+
+        if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
+            viewer->start -= GetMouseDelta().x * viewer->samples_per_pixel;
+        }
+    }
+
+    max_start = viewer_length(viewer) - area.width * viewer->samples_per_pixel;
+
+    if (viewer->start > max_start) viewer->start = max_start;
+    if (viewer->start < 0)         viewer->start = 0;
+
+    zoom         = viewer_zoom(viewer);
+    tile_samples = VIEWER_TILE_WIDTH * ldexp(1.0, zoom);
+    first        = (s64)floor(viewer->start / tile_samples);
+    last         = (s64)floor((viewer->start + area.width * viewer->samples_per_pixel) / tile_samples);
+    rendered     = 0;
+
+    for (track = 0; track < VIEWER_TRACK_COUNT; track++) {
+        for (i = first; i <= last; i++) {
+            tile = viewer_tile_find(viewer, track, zoom, i);
+
+            if (tile == NULL) {
+                if (rendered >= VIEWER_TILES_PER_FRAME) continue;
+
+                tile = viewer_tile_take(viewer);
+                if (tile == NULL) continue;
+
+                tile->track = track;
+                tile->zoom  = zoom;
+                tile->index = i;
+                tile->valid = true;
+
+                viewer_tile_render(viewer, tile);
+                rendered++;
+            }
+
+            tile->last_used = viewer->frame_index;
+        }
+    }
+}
+
+void viewer_render(Viewer *viewer) {
+    static const char *names[VIEWER_ROW_COUNT] = { "source", "decoded", "spectrogram", "frames" };
+    static const Viewer_Row rows[VIEWER_TRACK_COUNT] = { VIEWER_ROW_SOURCE, VIEWER_ROW_DECODED, VIEWER_ROW_FRAMES };
+    Viewer_Spectrogram *spectrogram;
+    Viewer_Tile *tile;
+    Rectangle row, dest;
+    f64 tile_samples, spp;
+    s64 i, first, last;
+    s32 zoom, track;
+
+    if (!viewer->loaded || viewer->tile_height <= 0) {
+        DrawRectangleRec(viewer->area, VIEWER_TRACK_COLOR);
+        DrawText("Convert a file to see it here", viewer->area.x + VIEWER_PADDING, viewer->area.y + VIEWER_PADDING, 20, LIGHTGRAY);
+        return;
+    }
+
+    for (i = 0; i < VIEWER_ROW_COUNT; i++) {
+        DrawRectangleRec(viewer_row_rect(viewer, i), VIEWER_TRACK_COLOR);
+    }
+
+    spp          = viewer->samples_per_pixel;
+    zoom         = viewer_zoom(viewer);
+    tile_samples = VIEWER_TILE_WIDTH * ldexp(1.0, zoom);
+    first        = (s64)floor(viewer->start / tile_samples);
+    last         = (s64)floor((viewer->start + viewer->area.width * spp) / tile_samples);
+
+    BeginScissorMode(viewer->area.x, viewer->area.y, viewer->area.width, viewer->area.height);
+
+    for (track = 0; track < VIEWER_TRACK_COUNT; track++) {
+        row = viewer_row_rect(viewer, rows[track]);
+
+        for (i = first; i <= last; i++) {
+            tile = viewer_tile_find(viewer, track, zoom, i);
+            if (tile == NULL) continue; // rendered in one of the next frames
+
+            dest.x      = row.x + (f32)((i * tile_samples - viewer->start) / spp);
+            dest.y      = row.y;
+            dest.width  = (f32)(tile_samples / spp);
+            dest.height = row.height;
+
+            // render textures are upside down
+            DrawTexturePro(tile->texture.texture, CLITERAL(Rectangle) { 0, 0, VIEWER_TILE_WIDTH, -viewer->tile_height }, dest, CLITERAL(Vector2) { 0, 0 }, 0, WHITE);
+        }
+    }
+
+    spectrogram = &viewer->spectrogram;
+    row         = viewer_row_rect(viewer, VIEWER_ROW_SPECTROGRAM);
+
+    for (i = 0; i < spectrogram->texture_count; i++) {
+        dest.x      = row.x + (f32)(((f64)i * VIEWER_SPECTRUM_TILE * VIEWER_FFT_HOP - viewer->start) / spp);
+        dest.y      = row.y;
+        dest.width  = (f32)((f64)VIEWER_SPECTRUM_TILE * VIEWER_FFT_HOP / spp);
+        dest.height = row.height;
+
+        if (dest.x > row.x + row.width || dest.x + dest.width < row.x) continue;
+
+        // low frequencies at the bottom
+        DrawTexturePro(spectrogram->textures[i], CLITERAL(Rectangle) { 0, 0, VIEWER_SPECTRUM_TILE, -VIEWER_FFT_BINS }, dest, CLITERAL(Vector2) { 0, 0 }, 0, WHITE);
+    }
+
+    EndScissorMode();
+
+    for (i = 0; i < VIEWER_ROW_COUNT; i++) {
+        row = viewer_row_rect(viewer, i);
+        DrawText(names[i], row.x + VIEWER_PADDING, row.y + VIEWER_PADDING, 10, LIGHTGRAY);
+    }
+
+    row = viewer_row_rect(viewer, VIEWER_ROW_FRAMES);
+    DrawText(TextFormat("%u samples, %u frames, %.2f samples/px", viewer_length(viewer), viewer->code_count, spp),
+             row.x + VIEWER_PADDING, row.y + row.height - 10 - VIEWER_PADDING, 10, LIGHTGRAY);
+}
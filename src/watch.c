@@ -0,0 +1,441 @@
+// Watch mode: directory tree is watched and audio files are encoded when they are written.
+//
+//     c_wizard --watch <dir> [output dir]
+//
+// Outputs go to output dir (watched dir by default) as lpc10_<path>.h and lpc10_<path>.bin,
+// where path is relative to watched dir with separators replaced by '_'. Manifest next to
+// them keeps hash of every encoded file, so files whose content didn't change (touched,
+// copied over with the same take, or already encoded before restart) aren't encoded again.
+//
+// Changes come from inotify, only for files that were written or moved in. Writes are
+// debounced, file is encoded when nothing happened to it for WATCH_DEBOUNCE seconds.
+// Without inotify (windows) the tree is polled for modification times instead.
+
+#define WATCH_MANIFEST      "lpc10_manifest.txt"
+#define WATCH_EXTENSIONS    ".wav;.ogg;.mp3;.flac;.qoa"
+#define WATCH_PATH_SIZE     512
+#define WATCH_DEBOUNCE      0.25 // seconds
+#define WATCH_POLL_INTERVAL 0.5  // seconds, without inotify
+#define WATCH_WAIT_MS       50
+
+typedef struct {
+    char path[WATCH_PATH_SIZE]; // relative to watched dir
+    u64  hash;                  // content and settings, 0 while it's not encoded
+    s64  mod_time;              // for polling only
+} Watch_Entry;
+
+typedef struct {
+    char path[WATCH_PATH_SIZE];
+    f64  time;                  // of the last change
+} Watch_Pending;
+
+typedef struct {
+    s32  id;
+    char path[WATCH_PATH_SIZE];
+} Watch_Dir;
+
+typedef struct {
+    const char *root;
+    const char *output;
+    s32         watch;
+    u64         settings_hash;
+
+    u32          entry_count, entry_capacity;
+    Watch_Entry *entries;
+
+    u32            pending_count, pending_capacity;
+    Watch_Pending *pending;
+
+    u32        dir_count, dir_capacity;
+    Watch_Dir *dirs;
+
+    b32 manifest_dirty;
+} Watch_State;
+
+// grows array of item_size items to fit one more
+void *watch_grow(void *items, u32 count, u32 *capacity, u64 item_size) {
+    if (count < *capacity) return items;
+
+    *capacity = MAX(*capacity * 2, 16);
+
+    return mem_realloc(main_allocator, items, item_size * *capacity);
+}
+
+u64 watch_hash(const u8 *data, u64 size, u64 hash) {
+    u64 i;
+
+    // FNV-1a
+    for (i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/// Manifest
+
+Watch_Entry *watch_entry_find(Watch_State *watch, const char *path) {
+    u32 i;
+
+    for (i = 0; i < watch->entry_count; i++) {
+        if (strcmp(watch->entries[i].path, path) == 0) return &watch->entries[i];
+    }
+
+    return NULL;
+}
+
+Watch_Entry *watch_entry_get(Watch_State *watch, const char *path) {
+    Watch_Entry *entry = watch_entry_find(watch, path);
+
+    if (entry != NULL) return entry;
+
+    watch->entries = (Watch_Entry*)watch_grow(watch->entries, watch->entry_count, &watch->entry_capacity, sizeof(Watch_Entry));
+
+    entry = &watch->entries[watch->entry_count++];
+    memset(entry, 0, sizeof(Watch_Entry));
+    TextCopy(entry->path, TextSubtext(path, 0, WATCH_PATH_SIZE - 1));
+
+    return entry;
+}
+
+void watch_entry_remove(Watch_State *watch, const char *path) {
+    Watch_Entry *entry = watch_entry_find(watch, path);
+
+    if (entry == NULL) return;
+
+    *entry = watch->entries[--watch->entry_count];
+    watch->manifest_dirty = true;
+}
+
+// line per file: hash in hex, space, relative path
+void watch_manifest_load(Watch_State *watch) {
+    char *text, *line, *next;
+    const char *path;
+    Watch_Entry *entry;
+    u64 hash;
+
+    path = TextFormat("%s/%s", watch->output, WATCH_MANIFEST);
+    if (!FileExists(path)) return;
+
+    text = LoadFileText(path);
+    if (text == NULL) return;
+
+    for (line = text; *line; line = next) {
+        next = strchr(line, '\n');
+
+        if (next) {
+            *next++ = 0;
+        } else {
+            next = line + strlen(line);
+        }
+
+        if (strlen(line) < 18 || line[16] != ' ') continue;
+
+        hash = strtoull(line, NULL, 16);
+
+        entry       = watch_entry_get(watch, line + 17);
+        entry->hash = hash;
+    }
+
+    UnloadFileText(text);
+
+    INFLOG("Watch: manifest has %u files.", watch->entry_count);
+}
+
+void watch_manifest_save(Watch_State *watch) {
+    char *text, *pos;
+    const char *path, *temp_path;
+    u64 size;
+    u32 i;
+
+    size = (u64)watch->entry_count * (WATCH_PATH_SIZE + 18) + 1;
+    text = pos = (char*)temp_allocate_nozero(size);
+
+    for (i = 0; i < watch->entry_count; i++) {
+        if (watch->entries[i].hash == 0) continue;
+
+        pos += sprintf(pos, "%016llx %s\n", (unsigned long long)watch->entries[i].hash, watch->entries[i].path);
+    }
+
+    // replaced at once, so it's never half written
+    path      = TextFormat("%s/%s", watch->output, WATCH_MANIFEST);
+    temp_path = TextFormat("%s/%s.tmp", watch->output, WATCH_MANIFEST);
+
+    if (SaveFileData(temp_path, text, (int)(pos - text))) {
+        remove(path);
+        rename(temp_path, path);
+    }
+
+    watch->manifest_dirty = false;
+}
+
+/// Changes
+
+void watch_queue(Watch_State *watch, const char *path, f64 time) {
+    Watch_Pending *pending;
+    u32 i;
+
+    for (i = 0; i < watch->pending_count; i++) {
+        if (strcmp(watch->pending[i].path, path) == 0) {
+            watch->pending[i].time = time;
+            return;
+        }
+    }
+
+    watch->pending = (Watch_Pending*)watch_grow(watch->pending, watch->pending_count, &watch->pending_capacity, sizeof(Watch_Pending));
+
+    pending = &watch->pending[watch->pending_count++];
+    TextCopy(pending->path, TextSubtext(path, 0, WATCH_PATH_SIZE - 1));
+    pending->time = time;
+}
+
+void watch_dir_add(Watch_State *watch, const char *path) {
+    Watch_Dir *dir;
+    s32 id;
+    u32 i;
+
+    if (watch->watch < 0) return;
+
+    id = platform_watch_add(watch->watch, TextFormat("%s/%s", watch->root, path));
+    if (id < 0) return;
+
+    // same directory gets the same id again
+    for (i = 0; i < watch->dir_count; i++) {
+        if (watch->dirs[i].id == id) return;
+    }
+
+    watch->dirs = (Watch_Dir*)watch_grow(watch->dirs, watch->dir_count, &watch->dir_capacity, sizeof(Watch_Dir));
+
+    dir = &watch->dirs[watch->dir_count++];
+    dir->id = id;
+    TextCopy(dir->path, TextSubtext(path, 0, WATCH_PATH_SIZE - 1));
+}
+
+const char *watch_dir_path(Watch_State *watch, s32 id) {
+    u32 i;
+
+    for (i = 0; i < watch->dir_count; i++) {
+        if (watch->dirs[i].id == id) return watch->dirs[i].path;
+    }
+
+    return NULL;
+}
+
+// walks subtree once: adds watches for new directories, queues files with new modification time.
+// it's startup, new directories and polling, inotify events don't need it
+void watch_scan(Watch_State *watch, const char *subdir, f64 time) {
+    FilePathList list;
+    Watch_Entry *entry;
+    const char *path, *relative;
+    u64 root_length;
+    s64 mod_time;
+    u32 i;
+
+    path        = subdir[0] ? TextFormat("%s/%s", watch->root, subdir) : watch->root;
+    root_length = strlen(watch->root) + 1;
+    list        = LoadDirectoryFilesEx(path, "DIR;" WATCH_EXTENSIONS, true);
+
+    for (i = 0; i < list.count; i++) {
+        relative = list.paths[i] + root_length;
+
+        if (!IsPathFile(list.paths[i])) {
+            watch_dir_add(watch, relative);
+            continue;
+        }
+
+        mod_time = GetFileModTime(list.paths[i]);
+        entry    = watch_entry_get(watch, relative);
+
+        if (entry->mod_time != mod_time) {
+            entry->mod_time = mod_time;
+            watch_queue(watch, relative, time);
+        }
+    }
+
+    UnloadDirectoryFiles(list);
+}
+
+void watch_events(Watch_State *watch, f64 time) {
+    Platform_Watch_Event events[PLATFORM_WATCH_MAX_EVENTS];
+    char path[WATCH_PATH_SIZE];
+    const char *dir;
+    u32 i, count;
+
+    count = platform_watch_read(watch->watch, events, WATCH_WAIT_MS);
+
+    for (i = 0; i < count; i++) {
+        if (events[i].dir < 0) {
+            ERRLOG("Watch: events were lost, scanning everything.");
+            watch_scan(watch, "", time);
+            continue;
+        }
+
+        dir = watch_dir_path(watch, events[i].dir);
+        if (dir == NULL) continue;
+
+        TextCopy(path, TextSubtext(dir[0] ? TextFormat("%s/%s", dir, events[i].name) : events[i].name, 0, WATCH_PATH_SIZE - 1));
+
+        if (events[i].is_dir) {
+            if (!events[i].removed) {
+                watch_dir_add(watch, path);
+                watch_scan(watch, path, time); // files could be there before watch was added
+            }
+        } else if (IsFileExtension(path, WATCH_EXTENSIONS)) {
+            watch_queue(watch, path, time);
+        }
+    }
+}
+
+/// Encoding
+
+b32 watch_encode(Watch_State *watch, const char *path, u8 *data, s32 size) {
+    Lpc_Sample_Buffer samples;
+    Lpc_TMS5220_Buffer buffer;
+    Lpc_Bitcodes codes;
+    Wave wave;
+    char name[WATCH_PATH_SIZE];
+    u32 i;
+
+    wave = LoadWaveFromMemory(GetFileExtension(path), data, size);
+
+    if (!IsWaveValid(wave)) {
+        ERRLOG("Watch: failed to load %s.", path);
+        return false;
+    }
+
+    WaveFormat(&wave, LPC_SAMPLE_RATE, 32, 1);
+
+    samples.sample_rate = LPC_SAMPLE_RATE;
+    samples.channels    = 1;
+    samples.frame_count = wave.frameCount;
+    samples.samples     = (f32*)wave.data;
+
+    codes  = lpc_encode_bitcodes(&lpc_context, samples, LPC_DEFAULT_SETTINGS);
+    buffer = lpc_tms5220_encode_bitcodes(&lpc_context, codes);
+
+    UnloadWave(wave);
+
+    TextCopy(name, TextSubtext(path, 0, (s32)(strlen(path) - strlen(GetFileExtension(path)))));
+
+    for (i = 0; name[i]; i++) {
+        if (name[i] == '/' || name[i] == '\\') name[i] = '_';
+    }
+
+    ExportDataAsCode(buffer.bytes, buffer.count, TextFormat("%s/lpc10_%s.h", watch->output, name));
+    SaveFileData(TextFormat("%s/lpc10_%s.bin", watch->output, name), buffer.bytes, buffer.count);
+
+    INFLOG("Watch: encoded %s, %u frames, %u bytes.", path, codes.count, buffer.count);
+
+    lpc_bitcodes_free(&lpc_context, &codes);
+    lpc_tms5220_buffer_free(&lpc_context, &buffer);
+
+    return true;
+}
+
+// encodes pending files that weren't touched for the debounce time
+void watch_process(Watch_State *watch, f64 time, f64 debounce) {
+    Watch_Pending pending;
+    Watch_Entry *entry;
+    const char *full_path;
+    u8 *data;
+    s32 size;
+    u64 hash;
+    u32 i;
+
+    for (i = 0; i < watch->pending_count;) {
+        if (time - watch->pending[i].time < debounce) {
+            i++;
+            continue;
+        }
+
+        pending = watch->pending[i];
+        watch->pending[i] = watch->pending[--watch->pending_count];
+
+        full_path = TextFormat("%s/%s", watch->root, pending.path);
+
+        if (!FileExists(full_path)) {
+            watch_entry_remove(watch, pending.path);
+            continue;
+        }
+
+        data = LoadFileData(full_path, &size);
+        if (data == NULL) continue;
+
+        hash  = watch_hash(data, size, watch->settings_hash);
+        entry = watch_entry_get(watch, pending.path);
+
+        if (entry->hash != hash && watch_encode(watch, pending.path, data, size)) {
+            entry->hash = hash;
+            watch->manifest_dirty = true;
+        }
+
+        UnloadFileData(data);
+    }
+
+    if (watch->manifest_dirty) {
+        watch_manifest_save(watch);
+    }
+}
+
+s32 watch_run(const char *root, const char *output) {
+    Watch_State watch;
+    Lpc_Encoder_Settings settings = LPC_DEFAULT_SETTINGS;
+    f64 time, last_poll, debounce;
+
+    if (!DirectoryExists(root)) {
+        ERRLOG("Watch: %s is not a directory.", root);
+        return 1;
+    }
+
+    if (output == NULL) output = root;
+
+    if (!DirectoryExists(output) && MakeDirectory(output) != 0) {
+        ERRLOG("Watch: failed to create %s.", output);
+        return 1;
+    }
+
+    program_memory_init();
+
+    memset(&watch, 0, sizeof(Watch_State));
+    watch.root          = root;
+    watch.output        = output;
+    watch.settings_hash = watch_hash((const u8*)&settings, sizeof(settings), 0xcbf29ce484222325ULL);
+    watch.watch         = platform_watch_open();
+
+    watch_manifest_load(&watch);
+
+    watch_dir_add(&watch, "");
+    watch_scan(&watch, "", 0);
+
+    if (watch.watch < 0) {
+        INFLOG("Watch: no inotify, polling %s every %.1f s.", root, WATCH_POLL_INTERVAL);
+    } else {
+        INFLOG("Watch: watching %s, %u directories.", root, watch.dir_count);
+    }
+
+    // polling sees a file that is still being written, so it waits for a quiet poll too
+    debounce  = watch.watch < 0 ? WATCH_POLL_INTERVAL * 2 : WATCH_DEBOUNCE;
+    last_poll = platform_get_time();
+
+    for (;;) {
+        temp_reset();
+
+        time = platform_get_time();
+
+        if (watch.watch >= 0) {
+            watch_events(&watch, time);
+        } else {
+            thrd_sleep(&(struct timespec) { 0, WATCH_WAIT_MS * 1000000L }, NULL);
+
+            if (time - last_poll >= WATCH_POLL_INTERVAL) {
+                watch_scan(&watch, "", time);
+                last_poll = time;
+            }
+        }
+
+        watch_process(&watch, platform_get_time(), debounce);
+    }
+
+    return 0;
+}